@@ -68,6 +68,8 @@ def create_flow_mod(routemod):
         ofm.command = OFPFC_ADD
     elif mod == RMT_DELETE:
         ofm.command = OFPFC_DELETE_STRICT
+    elif mod == RMT_MODIFY:
+        ofm.command = OFPFC_MODIFY_STRICT
     else:
         log.error("Unrecognised RouteMod Type (type: %s)" % (mod))
         return None
@@ -68,6 +68,14 @@ ipc = MongoIPC.MongoIPCMessageService(MONGO_ADDRESS, MONGO_DB_NAME, str(ID),
                                       threading.Thread, time.sleep)
 table = Table()
 
+# Flows awaiting acknowledgement to RFServer, keyed by (dp_id, xid) of their
+# flow mod, and the flow mod xid each barrier request follows. OpenFlow 1.0
+# doesn't confirm flow mods, but a switch answers a barrier only once it has
+# processed everything sent before it, and reports failed flow mods first.
+ack_lock = threading.Lock()
+pending_flows = {}
+pending_barriers = {}
+
 # Logging
 log = core.getLogger("rfproxy")
 
@@ -84,6 +92,10 @@ def send_of_msg(dp_id, ofmsg):
     else:
         return FAILURE
 
+def ack_route_mod(dp_id, seq, status):
+    msg = RouteModAck(id=dp_id, seq=seq, status=status)
+    ipc.send(RFSERVER_RFPROXY_CHANNEL, RFSERVER_ID, msg)
+
 def send_packet_out(dp_id, port, data):
     msg = ofp_packet_out()
     msg.actions.append(ofp_action_output(port=port))
@@ -120,6 +132,15 @@ def on_datapath_down(event):
 
     table.delete_dp(dp_id)
 
+    # RFServer fails the flows still awaiting acknowledgement.
+    with ack_lock:
+        for key in pending_flows.keys():
+            if key[0] == dp_id:
+                del pending_flows[key]
+        for key in pending_barriers.keys():
+            if key[0] == dp_id:
+                del pending_barriers[key]
+
     msg = DatapathDown(ct_id=ID, dp_id=dp_id)
     ipc.send(RFSERVER_RFPROXY_CHANNEL, RFSERVER_ID, msg)
 
@@ -163,22 +184,60 @@ def on_packet_in(event):
             log.debug("Unmapped datapath port (dp_id=%s, dp_port=%d)",
                       format_id(dp_id), in_port)
 
+def on_barrier_in(event):
+    with ack_lock:
+        xid = pending_barriers.pop((event.dpid, event.xid), None)
+        seq = pending_flows.pop((event.dpid, xid), None)
+    if seq is not None:
+        ack_route_mod(event.dpid, seq, RMS_SUCCESS)
+
+def on_error_in(event):
+    with ack_lock:
+        seq = pending_flows.pop((event.dpid, event.ofp.xid), None)
+    if seq is not None:
+        log.info("Datapath rejected routemod (dp_id=%s): %s",
+                 format_id(event.dpid), event.asString())
+        ack_route_mod(event.dpid, seq, RMS_FAILED)
+
 # IPC message Processing
 class RFProcessor(IPC.IPCMessageProcessor):
     def process(self, from_, to, channel, msg):
         topology = core.components['topology']
         type_ = msg.get_type()
         if type_ == ROUTE_MOD:
+            dp_id = msg.get_id()
+            seq = msg.get_seq()
             try:
                 ofmsg = create_flow_mod(msg)
             except Warning as e:
-                log.info("Error creating FlowMod: {}" % str(e))
-            if send_of_msg(msg.get_id(), ofmsg) == SUCCESS:
+                log.info("Error creating FlowMod: %s" % str(e))
+                ofmsg = None
+            if ofmsg is None:
+                if seq:
+                    ack_route_mod(dp_id, seq, RMS_FAILED)
+                return True
+
+            # A RouteMod with a sequence number is acknowledged once the
+            # barrier following its flow mod is answered.
+            barrier = None
+            if seq:
+                barrier = ofp_barrier_request()
+                with ack_lock:
+                    pending_flows[(dp_id, ofmsg.xid)] = seq
+                    pending_barriers[(dp_id, barrier.xid)] = ofmsg.xid
+
+            if send_of_msg(dp_id, ofmsg) == SUCCESS and \
+               (barrier is None or send_of_msg(dp_id, barrier) == SUCCESS):
                 log.info("routemod sent to datapath (dp_id=%s)",
-                         format_id(msg.get_id()))
+                         format_id(dp_id))
             else:
                 log.info("Error sending routemod to datapath (dp_id=%s)",
-                         format_id(msg.get_id()))
+                         format_id(dp_id))
+                if seq:
+                    with ack_lock:
+                        pending_flows.pop((dp_id, ofmsg.xid), None)
+                        pending_barriers.pop((dp_id, barrier.xid), None)
+                    ack_route_mod(dp_id, seq, RMS_FAILED)
         if type_ == DATA_PLANE_MAP:
             table.update_dp_port(msg.get_dp_id(), msg.get_dp_port(),
                                  msg.get_vs_id(), msg.get_vs_port())
@@ -190,5 +249,7 @@ def launch ():
     core.openflow.addListenerByName("ConnectionUp", on_datapath_up)
     core.openflow.addListenerByName("ConnectionDown", on_datapath_down)
     core.openflow.addListenerByName("PacketIn", on_packet_in)
+    core.openflow.addListenerByName("BarrierIn", on_barrier_in)
+    core.openflow.addListenerByName("ErrorIn", on_error_in)
     ipc.listen(RFSERVER_RFPROXY_CHANNEL, RFProtocolFactory(), RFProcessor(), False)
     log.info("RFProxy running.")
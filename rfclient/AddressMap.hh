@@ -0,0 +1,183 @@
+#ifndef ADDRESSMAP_HH
+#define ADDRESSMAP_HH
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "types/IPAddress.h"
+
+#define ADDRESS_KEY_LEN 16
+#define ADDRESS_MAP_MIN_SLOTS 16
+
+/**
+ * Fixed-size binary form of an IPAddress, or of a prefix, suitable for
+ * hashing. Building one does not allocate, unlike IPAddress::toString().
+ */
+struct AddressKey {
+    uint8_t version;
+    uint8_t prefix_len;
+    uint8_t data[ADDRESS_KEY_LEN];
+
+    AddressKey() {
+        this->version = 0;
+        this->prefix_len = 0;
+        memset(this->data, 0, ADDRESS_KEY_LEN);
+    }
+
+    explicit AddressKey(const IPAddress& addr) {
+        this->version = (uint8_t) addr.getVersion();
+        this->prefix_len = 0;
+        memset(this->data, 0, ADDRESS_KEY_LEN);
+        addr.toArray(this->data);
+    }
+
+    AddressKey(const IPAddress& addr, int prefix_len) {
+        this->version = (uint8_t) addr.getVersion();
+        this->prefix_len = (uint8_t) prefix_len;
+        memset(this->data, 0, ADDRESS_KEY_LEN);
+        addr.toArray(this->data);
+    }
+
+    bool operator==(const AddressKey& other) const {
+        return (this->version == other.version) and
+            (this->prefix_len == other.prefix_len) and
+            (memcmp(this->data, other.data, ADDRESS_KEY_LEN) == 0);
+    }
+
+    /* 32-bit FNV-1a over the version, prefix length and address bytes */
+    uint32_t hash() const {
+        uint32_t h = 2166136261u;
+        h = (h ^ this->version) * 16777619u;
+        h = (h ^ this->prefix_len) * 16777619u;
+        for (int i = 0; i < ADDRESS_KEY_LEN; i++) {
+            h = (h ^ this->data[i]) * 16777619u;
+        }
+        return h;
+    }
+};
+
+/**
+ * Hash map from IP addresses (or prefixes) to T, using open addressing with linear probing.
+ *
+ * Slots are stored inline, so lookups touch a single contiguous array and do
+ * not allocate. The table is kept at most half full and removal shifts later
+ * entries back, so no tombstones are left behind.
+ *
+ * Pointers returned by find() are invalidated by any insertion or removal.
+ * AddressMap does no locking of its own.
+ */
+template<typename T>
+class AddressMap {
+    public:
+        AddressMap() : slots(ADDRESS_MAP_MIN_SLOTS), count(0) {}
+
+        T* find(const AddressKey& key) {
+            size_t i = this->probe(key, key.hash());
+            return this->slots[i].used ? &this->slots[i].value : NULL;
+        }
+
+        const T* find(const AddressKey& key) const {
+            size_t i = this->probe(key, key.hash());
+            return this->slots[i].used ? &this->slots[i].value : NULL;
+        }
+
+        /* Returns the value stored for 'key', inserting T() if needed */
+        T& operator[](const AddressKey& key) {
+            uint32_t hash = key.hash();
+            size_t i = this->probe(key, hash);
+            if (this->slots[i].used) {
+                return this->slots[i].value;
+            }
+
+            if ((this->count + 1) * 2 > this->slots.size()) {
+                this->resize(this->slots.size() * 2);
+                i = this->probe(key, hash);
+            }
+
+            Slot& slot = this->slots[i];
+            slot.used = true;
+            slot.hash = hash;
+            slot.key = key;
+            this->count++;
+            return slot.value;
+        }
+
+        /* Returns true if an entry was removed */
+        bool erase(const AddressKey& key) {
+            size_t i = this->probe(key, key.hash());
+            if (not this->slots[i].used) {
+                return false;
+            }
+
+            // Shift back any following entries that probed past this slot.
+            size_t mask = this->slots.size() - 1;
+            for (size_t j = (i + 1) & mask; this->slots[j].used;
+                    j = (j + 1) & mask) {
+                size_t home = this->slots[j].hash & mask;
+                if (((j - home) & mask) >= ((j - i) & mask)) {
+                    this->slots[i] = this->slots[j];
+                    i = j;
+                }
+            }
+
+            this->slots[i] = Slot();
+            this->count--;
+            return true;
+        }
+
+        size_t size() const {
+            return this->count;
+        }
+
+        void clear() {
+            std::vector<Slot>(ADDRESS_MAP_MIN_SLOTS).swap(this->slots);
+            this->count = 0;
+        }
+
+    private:
+        struct Slot {
+            bool used;
+            uint32_t hash;
+            AddressKey key;
+            T value;
+
+            Slot() : used(false), hash(0), key(), value() {}
+        };
+
+        std::vector<Slot> slots;
+        size_t count;
+
+        /* Index of the slot holding 'key', or of the empty slot ending its
+         * probe sequence */
+        size_t probe(const AddressKey& key, uint32_t hash) const {
+            size_t mask = this->slots.size() - 1;
+            size_t i = hash & mask;
+            while (this->slots[i].used) {
+                if (this->slots[i].hash == hash && this->slots[i].key == key) {
+                    break;
+                }
+                i = (i + 1) & mask;
+            }
+            return i;
+        }
+
+        void resize(size_t size) {
+            std::vector<Slot> old(size);
+            old.swap(this->slots);
+
+            size_t mask = size - 1;
+            for (size_t j = 0; j < old.size(); j++) {
+                if (old[j].used) {
+                    size_t i = old[j].hash & mask;
+                    while (this->slots[i].used) {
+                        i = (i + 1) & mask;
+                    }
+                    this->slots[i] = old[j];
+                }
+            }
+        }
+};
+
+#endif /* ADDRESSMAP_HH */
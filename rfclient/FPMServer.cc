@@ -34,6 +34,7 @@
 
 #include "fpm_lsp.h"
 
+#include "log/Log.h"
 #include "FPMServer.hh"
 #include "FlowTable.h"
 
@@ -45,20 +46,6 @@ typedef struct glob_t_ {
 glob_t glob_space;
 glob_t *glob = &glob_space;
 
-/* TODO: Integrate logging with RFClient */
-int log_level = 1;
-
-#define log(level, format...)     \
-if (level <= log_level) {     \
-    fprintf(stderr, format);      \
-    fprintf(stderr, "\n");      \
-}
-
-#define info_msg(format...) log(1, format)
-#define warn_msg(format...) log(0, format)
-#define err_msg(format...) log(-1, format)
-#define trace log
-
 /*
  * create_listen_sock
  */
@@ -69,14 +56,14 @@ int FPMServer::create_listen_sock(int port, int *sock_p) {
 
     sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
     if (sock < 0) {
-        err_msg( "Failed to create socket: %s", strerror(errno));
+        RFLOG_ERROR("Failed to create socket: %s", strerror(errno));
         return 0;
     }
 
     reuse = 1;
     if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse,
                      sizeof(reuse)) < 0) {
-        warn_msg("Failed to set reuse addr option: %s", strerror(errno));
+        RFLOG_WARN("Failed to set reuse addr option: %s", strerror(errno));
     }
 
     memset(&addr, 0, sizeof(addr));
@@ -85,13 +72,13 @@ int FPMServer::create_listen_sock(int port, int *sock_p) {
     addr.sin_port = htons(port);
 
     if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
-        err_msg("Failed to bind to port %d: %s", port, strerror(errno));
+        RFLOG_ERROR("Failed to bind to port %d: %s", port, strerror(errno));
         close(sock);
         return 0;
     }
 
     if (listen(sock, 5)) {
-        err_msg("Failed to listen on socket: %s", strerror(errno));
+        RFLOG_ERROR("Failed to listen on socket: %s", strerror(errno));
         close(sock);
         return 0;
     }
@@ -109,17 +96,17 @@ int FPMServer::accept_conn(int listen_sock) {
     unsigned int client_len;
 
     while (1) {
-        trace(1, "Waiting for client connection...");
+        RFLOG_INFO("Waiting for client connection...");
         client_len = sizeof(client_addr);
         sock = accept(listen_sock, (struct sockaddr *) &client_addr,
                         &client_len);
 
         if (sock >= 0) {
-            trace(1, "Accepted client %s", inet_ntoa(client_addr.sin_addr));
+            RFLOG_INFO("Accepted client %s", inet_ntoa(client_addr.sin_addr));
             return sock;
         }
 
-        err_msg("Failed to accept socket: %s", strerror(errno));
+        RFLOG_ERROR("Failed to accept socket: %s", strerror(errno));
     }
 }
 
@@ -155,15 +142,15 @@ FPMServer::read_fpm_msg(char *buf, size_t buf_len) {
             reading_full_msg = 1;
         }
 
-        trace(3, "Looking to read %d bytes", need_len);
+        RFLOG_DEBUG("Looking to read %d bytes", need_len);
         bytes_read = read(glob->sock, cur, need_len);
 
         if (bytes_read <= 0) {
-            err_msg("Error reading from socket: %s", strerror(errno));
+            RFLOG_ERROR("Error reading from socket: %s", strerror(errno));
             return NULL;
         }
 
-        trace(3, "Read %d bytes", bytes_read);
+        RFLOG_DEBUG("Read %d bytes", bytes_read);
         cur += bytes_read;
 
         if (bytes_read < need_len) {
@@ -177,7 +164,7 @@ FPMServer::read_fpm_msg(char *buf, size_t buf_len) {
         }
 
         if (!fpm_msg_ok(hdr, buf_len)) {
-            err_msg("Malformed fpm message");
+            RFLOG_ERROR("Malformed fpm message");
             return NULL;
         }
     }
@@ -194,15 +181,15 @@ void FPMServer::print_nhlfe(const nhlfe_msg_t *msg) {
     const uint8_t *data = reinterpret_cast<const uint8_t*>(&msg->next_hop_ip);
     IPAddress ip(msg->ip_version, data);
 
-    info_msg("fpm->%s %s %s %d %d", op, ip.toString().c_str(), type,
-             ntohl(msg->in_label), ntohl(msg->out_label));
+    RFLOG_INFO("fpm->%s %s %s %d %d", op, ip, type,
+               ntohl(msg->in_label), ntohl(msg->out_label));
 }
 
 /*
  * process_fpm_msg
  */
 void FPMServer::process_fpm_msg(fpm_msg_hdr_t *hdr) {
-    trace(1, "FPM message - Type: %d, Length %d", hdr->msg_type,
+    RFLOG_INFO("FPM message - Type: %d, Length %d", hdr->msg_type,
             ntohs(hdr->msg_len));
 
     /**
@@ -222,9 +209,9 @@ void FPMServer::process_fpm_msg(fpm_msg_hdr_t *hdr) {
         print_nhlfe(lsp_msg);
         FlowTable::updateNHLFE(lsp_msg);
     } else if (hdr->msg_type == FPM_MSG_TYPE_FTN) {
-        warn_msg("FTN not yet implemented");
+        RFLOG_WARN("FTN not yet implemented");
     } else {
-        warn_msg("Unknown fpm message type %u", hdr->msg_type);
+        RFLOG_WARN("Unknown fpm message type %u", hdr->msg_type);
     }
 }
 
@@ -255,7 +242,7 @@ void FPMServer::start() {
     while (1) {
         glob->sock = FPMServer::accept_conn(glob->server_sock);
         FPMServer::fpm_serve();
-        trace(1, "Done serving client");
+        RFLOG_INFO("Done serving client");
     }
 }
 
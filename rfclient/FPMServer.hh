@@ -6,6 +6,8 @@
 class FPMServer {
     public:
         static void start();
+        /* Handle one message, as read from zebra */
+        static void process_fpm_msg(fpm_msg_hdr_t* hdr);
 
     private:
         static int create_listen_sock(int port, int* sock_p);
@@ -13,7 +15,6 @@ class FPMServer {
         static void fpm_serve();
         static void print_nhlfe(const nhlfe_msg_t *msg);
         static fpm_msg_hdr_t* read_fpm_msg (char* buf, size_t buf_len);
-        static void process_fpm_msg(fpm_msg_hdr_t* hdr);
 };
 
 #endif /* RFCLIENT_FPMSERVER_H_ */
@@ -1,17 +1,19 @@
 #include <stdio.h>
-#include <fcntl.h>
+#include <errno.h>
 #include <unistd.h>
 #include <arpa/inet.h>
-#include <netinet/ether.h>
+#include <net/if.h>
 #include <sys/socket.h>
 #include <time.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <cstring>
-#include <iostream>
 
 #include "converter.h"
+#include "log/Log.h"
+#include "metrics/Metrics.h"
 #include "FlowTable.h"
 #ifdef FPM_ENABLED
   #include "FPMServer.hh"
@@ -24,6 +26,27 @@ using namespace std;
 
 #define EMPTY_MAC_ADDRESS "00:00:00:00:00:00"
 
+/* Route updates are timestamped as they are received from netlink or FPM,
+ * queued, taken by a resolver and resolved. */
+static Counter routesReceived("rfclient_routes_received_total",
+    "Route updates received for the main table");
+static Counter routesQueued("rfclient_routes_queued_total",
+    "Route updates queued for the resolvers, including requeued ones");
+static Counter routesResolved("rfclient_routes_resolved_total",
+    "Route updates taken from the queues and resolved");
+static Counter routeModsSent("rfclient_route_mods_sent_total",
+    "RouteMods sent to RFServer, including retries");
+static Histogram parseLatency("rfclient_route_parse_seconds",
+    "Time from receiving a route update to queueing it");
+static Histogram queueLatency("rfclient_route_queue_seconds",
+    "Time route updates wait in the queues, including the flap window");
+static Histogram resolveLatency("rfclient_route_resolve_seconds",
+    "Time taken to resolve a route update and hand its RouteMod on");
+static Histogram routeLatency("rfclient_route_latency_seconds",
+    "Time from receiving a route update to handing its RouteMod on");
+static Histogram ackLatency("rfclient_route_mod_ack_seconds",
+    "Time from sending a RouteMod to RFServer acknowledging it");
+
 const MACAddress FlowTable::MAC_ADDR_NONE(EMPTY_MAC_ADDRESS);
 
 int FlowTable::family = AF_UNSPEC;
@@ -32,77 +55,274 @@ int FlowTable::llink = 0;
 int FlowTable::laddr = 0;
 int FlowTable::lroute = 0;
 
-boost::thread FlowTable::GWResolver;
+boost::thread_group FlowTable::resolvers;
+unsigned FlowTable::resolverThreads = 0;
 boost::thread FlowTable::HTPolling;
-struct rtnl_handle FlowTable::rthNeigh;
+NetlinkReader FlowTable::neighReader;
+boost::thread FlowTable::NDProbing;
+NeighbourProber FlowTable::prober;
+boost::thread FlowTable::TimerPolling;
+TimerWheel FlowTable::timers;
+int FlowTable::netlinkBuffer = NETLINK_READER_RCVBUF;
 
 #ifdef FPM_ENABLED
   boost::thread FlowTable::FPMClient;
 #else
   boost::thread FlowTable::RTPolling;
-  struct rtnl_handle FlowTable::rth;
+  NetlinkReader FlowTable::routeReader;
 #endif /* FPM_ENABLED */
 
-map<string, Interface> FlowTable::interfaces;
-vector<uint32_t>* FlowTable::down_ports;
+InterfaceCache FlowTable::interfaces;
+PortState* FlowTable::ports;
 IPCMessageService* FlowTable::ipc;
+boost::system_time FlowTable::syncStart;
+size_t FlowTable::syncRoutes = 0;
+bool FlowTable::syncing = false;
 uint64_t FlowTable::vm_id;
+RouteModWindow FlowTable::routeMods;
+bool FlowTable::installing = false;
+
+/* Set on resolver threads, the only ones that wait for room in routeMods.
+ * The others go over the limit, so that acknowledgements, port changes and
+ * timers are never held up behind the datapaths. */
+static __thread bool resolving = false;
+
+vector<RouteQueue*> FlowTable::pendingRoutes;
+size_t FlowTable::queueCapacity = MPSC_RING_CAPACITY;
+RingPolicy FlowTable::queuePolicy = RING_COALESCE;
+long FlowTable::queuedRoutes = 0;
+unsigned FlowTable::flapWindow = ROUTE_FLAP_WINDOW;
+long FlowTable::suppressedRoutes = 0;
+vector<RouteShard*> FlowTable::shards;
 
-typedef std::pair<RouteModType,RouteEntry> PendingRoute;
-SyncQueue<PendingRoute> FlowTable::pendingRoutes;
-list<RouteEntry> FlowTable::routeTable;
 boost::mutex hostTableMutex;
-map<string, HostEntry> FlowTable::hostTable;
+AddressMap<HostEntry> FlowTable::hostTable;
+PortIndex<HostEntry> FlowTable::portHosts;
 
+/* When both are held, ndMutex is taken before the mutex of a shard. */
 boost::mutex ndMutex;
-map<string, int> FlowTable::pendingNeighbours;
-
-// TODO: implement a way to pause the flow table updates when the VM is not
-//       associated with a valid datapath
+AddressMap<PendingNeighbour> FlowTable::pendingNeighbours;
+unsigned FlowTable::neighbourSerial = 0;
 
 void FlowTable::HTPollingCb() {
-    rtnl_listen(&rthNeigh, FlowTable::updateHostTable, NULL);
+    neighReader.listen(FlowTable::updateLinkOrHostTable,
+                       &FlowTable::resyncNeighbours);
 }
 
 #ifndef FPM_ENABLED
 void FlowTable::RTPollingCb() {
-    rtnl_listen(&rth, FlowTable::updateRouteTable, NULL);
+    routeReader.listen(FlowTable::updateRouteTable, &FlowTable::resyncRoutes);
 }
 #endif /* FPM_ENABLED */
 
 void FlowTable::start(uint64_t vm_id, map<string, Interface> interfaces,
-                      IPCMessageService* ipc, vector<uint32_t>* down_ports) {
-    FlowTable::vm_id = vm_id;
-    FlowTable::interfaces = interfaces;
-    FlowTable::ipc = ipc;
-    FlowTable::down_ports = down_ports;
+                      IPCMessageService* ipc, PortState* ports) {
+    FlowTable::init(vm_id, interfaces, ipc, ports);
+
+    if (prober.open() == 0) {
+        NDProbing = boost::thread(boost::bind(&NeighbourProber::run,
+                                              &FlowTable::prober));
+    }
+
+    // Subscribe before dumping the tables, so no change is missed between
+    // the dump and the first update.
+    neighReader.open("Neighbour", RTMGRP_LINK | RTMGRP_NEIGH,
+                     FlowTable::netlinkBuffer);
+#ifndef FPM_ENABLED
+    routeReader.open("Route", RTMGRP_IPV4_MROUTE | RTMGRP_IPV4_ROUTE
+                              | RTMGRP_IPV6_MROUTE | RTMGRP_IPV6_ROUTE,
+                     FlowTable::netlinkBuffer);
+#endif /* FPM_ENABLED */
+    FlowTable::syncTables();
 
-    rtnl_open(&rthNeigh, RTMGRP_NEIGH);
     HTPolling = boost::thread(&FlowTable::HTPollingCb);
 
 #ifdef FPM_ENABLED
-    std::cout << "FPM interface enabled\n";
+    RFLOG_INFO("FPM interface enabled");
     FPMClient = boost::thread(&FPMServer::start);
 #else
-    std::cout << "Netlink interface enabled\n";
-    rtnl_open(&rth, RTMGRP_IPV4_MROUTE | RTMGRP_IPV4_ROUTE
-                  | RTMGRP_IPV6_MROUTE | RTMGRP_IPV6_ROUTE);
+    RFLOG_INFO("Netlink interface enabled");
     RTPolling = boost::thread(&FlowTable::RTPollingCb);
 #endif /* FPM_ENABLED */
 
-    GWResolver = boost::thread(&FlowTable::GWResolverCb);
-    GWResolver.join();
+    resolvers.join_all();
+}
+
+/**
+ * Set up the route pipeline and start its threads: the resolvers, the timer
+ * wheel and the RouteMod batchers. Nothing is read from the kernel, so links,
+ * neighbours and routes only arrive through the update functions.
+ */
+void FlowTable::init(uint64_t vm_id, const map<string, Interface>& interfaces,
+                     IPCMessageService* ipc, PortState* ports) {
+    FlowTable::vm_id = vm_id;
+    FlowTable::interfaces.setManaged(interfaces);
+    FlowTable::ipc = ipc;
+    FlowTable::ports = ports;
+    ports->addCallback(&FlowTable::updatePortState);
+
+    if (FlowTable::resolverThreads == 0) {
+        FlowTable::resolverThreads = boost::thread::hardware_concurrency();
+    }
+    FlowTable::resolverThreads = std::max(FlowTable::resolverThreads, 1U);
+    for (unsigned i = 0; i < FlowTable::resolverThreads; i++) {
+        FlowTable::pendingRoutes.push_back(new RouteQueue(
+            FlowTable::queueCapacity, FlowTable::queuePolicy,
+            FlowTable::flapWindow));
+        RouteShard* shard = new RouteShard(i, FlowTable::resolverThreads);
+        shard->batcher.start(ipc, vm_id);
+        FlowTable::shards.push_back(shard);
+    }
+
+    /* The resolvers work through routes while the tables are still being
+     * dumped, so that a full queue can't hold up the dump. */
+    TimerPolling = boost::thread(boost::bind(&TimerWheel::run,
+                                             &FlowTable::timers));
+    RFLOG_INFO("Resolving routes on %u threads", FlowTable::resolverThreads);
+    for (unsigned i = 0; i < FlowTable::resolverThreads; i++) {
+        resolvers.create_thread(boost::bind(&FlowTable::GWResolverCb, i));
+    }
+}
+
+void FlowTable::setResolverThreads(unsigned threads) {
+    FlowTable::resolverThreads = threads;
+}
+
+void FlowTable::setFlapWindow(unsigned window) {
+    FlowTable::flapWindow = window;
+}
+
+void FlowTable::setNetlinkBuffer(int bytes) {
+    FlowTable::netlinkBuffer = bytes;
+}
+
+void FlowTable::setQueue(size_t capacity, RingPolicy policy) {
+    FlowTable::queueCapacity = capacity;
+    FlowTable::queuePolicy = policy;
+}
+
+void FlowTable::setAckWindow(size_t size) {
+    FlowTable::routeMods.setSize(size);
+}
+
+/**
+ * Dump one kernel table over a separate netlink socket, passing every entry
+ * to 'filter'. Returns -1 if the dump failed.
+ */
+int FlowTable::dumpTable(int type, rtnl_filter_t filter, void* arg) {
+    struct rtnl_handle rthDump;
+
+    if (rtnl_open(&rthDump, 0) < 0) {
+        RFLOG_ERROR("Cannot open netlink socket for dump");
+        return -1;
+    }
+
+    int ret = 0;
+    if (rtnl_wilddump_request(&rthDump, AF_UNSPEC, type) < 0) {
+        RFLOG_ERROR("Cannot request dump: %s", strerror(errno));
+        ret = -1;
+    } else if (rtnl_dump_filter(&rthDump, filter, arg, NULL, NULL) < 0) {
+        RFLOG_ERROR("Dump terminated");
+        ret = -1;
+    }
+
+    rtnl_close(&rthDump);
+    return ret;
+}
+
+/**
+ * Learn the links, neighbours and routes that exist before rfclient starts,
+ * by dumping the kernel tables over netlink. Links and neighbours go straight
+ * into the interface cache and host table; routes are queued for the
+ * resolver, which reports the time taken to sync once it has worked through
+ * them. If there are none, the sync is reported here.
+ */
+void FlowTable::syncTables() {
+    FlowTable::syncStart = boost::get_system_time();
+
+    // Keep the count of queued routes above zero until the dump is done, so
+    // that the resolvers don't report the sync finished part way through.
+    __sync_add_and_fetch(&FlowTable::queuedRoutes, 1);
+    FlowTable::syncing = true;
+
+    FlowTable::dumpTable(RTM_GETLINK, FlowTable::updateLinkTable, NULL);
+    FlowTable::dumpTable(RTM_GETNEIGH, FlowTable::updateHostTable, NULL);
+#ifndef FPM_ENABLED
+    /* With FPM, zebra sends its full table itself when it connects. */
+    FlowTable::dumpTable(RTM_GETROUTE, FlowTable::updateRouteTable, NULL);
+#endif /* FPM_ENABLED */
+
+    size_t hosts;
+    {
+        boost::lock_guard<boost::mutex> lock(hostTableMutex);
+        hosts = FlowTable::hostTable.size();
+    }
+    FlowTable::syncRoutes = 0;
+    vector<RouteQueue*>::iterator it;
+    for (it = pendingRoutes.begin(); it != pendingRoutes.end(); it++) {
+        FlowTable::syncRoutes += (*it)->pushed();
+    }
+
+    RFLOG_INFO("Initial sync: dumped %zu neighbours and %zu routes", hosts,
+               FlowTable::syncRoutes);
+    if (FlowTable::syncRoutes == 0) {
+        // No route will finish the sync for the resolvers to report it.
+        FlowTable::syncing = false;
+        boost::posix_time::time_duration elapsed;
+        elapsed = boost::get_system_time() - FlowTable::syncStart;
+        RFLOG_INFO("Initial sync: 0 routes synced in %ldms",
+                   (long) elapsed.total_milliseconds());
+    }
+    FlowTable::finishRoutes(1);
+}
+
+/**
+ * Catch up with link and neighbour changes lost when the neighbour socket
+ * overran.
+ */
+void FlowTable::resyncNeighbours() {
+    FlowTable::dumpTable(RTM_GETLINK, FlowTable::updateLinkTable, NULL);
+    FlowTable::dumpTable(RTM_GETNEIGH, FlowTable::updateHostTable, NULL);
 }
 
 void FlowTable::clear() {
-    FlowTable::routeTable.clear();
+    {
+        boost::lock_guard<boost::mutex> lock(ndMutex);
+        FlowTable::pendingNeighbours.clear();
+        // Neighbour probes and route retries are both for the old tables,
+        // as are the RouteMods awaiting acknowledgement.
+        FlowTable::timers.clear();
+        FlowTable::routeMods.clear();
+    }
+    vector<RouteShard*>::iterator it;
+    for (it = shards.begin(); it != shards.end(); it++) {
+        RouteShard* shard = *it;
+        {
+            boost::lock_guard<boost::mutex> lock(shard->mutex);
+            shard->routeTable.clear();
+            shard->portRoutes.clear();
+            shard->gatewayRoutes.clear();
+            shard->parkedRoutes.clear();
+            shard->parkedIndex.clear();
+            shard->hosts.clear();
+        }
+        boost::lock_guard<boost::mutex> lock(shard->nextHopMutex);
+        shard->nextHops.clear();
+    }
     boost::lock_guard<boost::mutex> lock(hostTableMutex);
     FlowTable::hostTable.clear();
+    FlowTable::portHosts.clear();
 }
 
 void FlowTable::interrupt() {
     HTPolling.interrupt();
-    GWResolver.interrupt();
+    TimerPolling.interrupt();
+    NDProbing.interrupt();
+    resolvers.interrupt_all();
+    vector<RouteShard*>::iterator it;
+    for (it = shards.begin(); it != shards.end(); it++) {
+        (*it)->batcher.interrupt();
+    }
 #ifdef FPM_ENABLED
     FPMClient.interrupt();
 #else
@@ -110,208 +330,467 @@ void FlowTable::interrupt() {
 #endif /* FPM_ENABLED */
 }
 
-void FlowTable::GWResolverCb() {
+/**
+ * Queue a route update for the resolver. Updates are sharded across the
+ * resolver threads by prefix, so that updates to one prefix are handled by
+ * one thread, which takes them in the order they were queued within each
+ * priority class. If the class is full, the update waits for room, displaces
+ * the oldest update, or is coalesced with earlier updates to its prefix,
+ * depending on the queue policy.
+ *
+ * Only the route readers may 'wait' for room, so that the kernel or zebra is
+ * slowed to what the resolvers can take. The timer and IPC threads also queue
+ * updates, for retries and port changes, but they deliver the timeouts and
+ * acknowledgements that free resolvers waiting on the RouteMod window, so if
+ * they waited for resolvers to make room, neither could go on. Their updates
+ * are coalesced instead when the queue is full, and once as many are held
+ * aside as the queue holds, take the place of the oldest held (see
+ * MPSCRing).
+ */
+void FlowTable::queueRoute(const PendingRoute& pr, bool wait) {
+    uint32_t hash = pr.key().hash();
+    PendingRoute stamped(pr);
+    stamped.queued = Metrics::now();
+    if (!pr.requeued() && pr.received != 0) {
+        parseLatency.record(stamped.queued - pr.received);
+    }
+    routesQueued.add();
+
+    __sync_add_and_fetch(&FlowTable::queuedRoutes, 1);
+    RouteQueue* queue;
+    queue = FlowTable::pendingRoutes[hash % FlowTable::pendingRoutes.size()];
+
+    // Updates displaced by this one are done with, whether they were
+    // absorbed by a later update or dropped to make room.
+    size_t dropped = 0;
+    size_t displaced = queue->push(stamped, wait, &dropped);
+    if (dropped > 0) {
+        RFLOG_WARN("Route queue full: dropped %zu updates", dropped);
+    }
+    if (displaced > dropped) {
+        __sync_add_and_fetch(&FlowTable::suppressedRoutes,
+                             displaced - dropped);
+    }
+    if (displaced > 0) {
+        FlowTable::finishRoutes(displaced);
+    }
+}
+
+/**
+ * The shard holding the state for 'prefix'. Shards are picked the same way
+ * as queues, so the resolver for a prefix only uses the shard of the same
+ * index.
+ */
+RouteShard& FlowTable::shardFor(const AddressKey& prefix) {
+    return *FlowTable::shards[prefix.hash() % FlowTable::shards.size()];
+}
+
+/**
+ * Queue a route update that failed to install again, once it has waited
+ * for retryDelay().
+ */
+void FlowTable::retryRoute(const PendingRoute& pr) {
+    PendingRoute retry(pr);
+    retry.retries++;
+    retry.coalesced = false;
+    FlowTable::timers.schedule(FlowTable::retryDelay(pr.retries),
+                               boost::bind(&FlowTable::queueRoute, retry,
+                                           false));
+}
+
+/**
+ * Time to wait before trying again after 'retries' earlier retries:
+ * ROUTE_RETRY_DELAY ms, doubled for each earlier retry up to
+ * ROUTE_RETRY_MAX_DELAY ms.
+ */
+unsigned FlowTable::retryDelay(unsigned retries) {
+    unsigned delay = ROUTE_RETRY_DELAY;
+    for (unsigned i = 0; i < retries && delay < ROUTE_RETRY_MAX_DELAY; i++) {
+        delay *= 2;
+    }
+    return std::min(delay, (unsigned) ROUTE_RETRY_MAX_DELAY);
+}
+
+void FlowTable::GWResolverCb(unsigned shard) {
+    RouteQueue* queue = FlowTable::pendingRoutes[shard];
+    vector<PendingRoute> batch;
+    resolving = true;
+    batch.reserve(ROUTE_QUEUE_BATCH);
+
     while (true) {
         boost::this_thread::interruption_point();
 
-        PendingRoute pr;
-        FlowTable::pendingRoutes.wait_and_pop(pr);
+        batch.clear();
+        size_t dropped;
+        queue->take(batch, dropped);
+        if (dropped > 0) {
+            __sync_add_and_fetch(&FlowTable::suppressedRoutes, dropped);
+            FlowTable::finishRoutes(dropped);
+        }
 
-        bool existingEntry = false;
-        std::list<RouteEntry>::iterator iter = FlowTable::routeTable.begin();
-        for (; iter != FlowTable::routeTable.end(); iter++) {
-            if (pr.second == *iter) {
-                existingEntry = true;
-                break;
+        uint64_t dequeued = Metrics::now();
+        vector<PendingRoute>::iterator it;
+        for (it = batch.begin(); it != batch.end(); it++) {
+            queueLatency.record(dequeued - std::min(dequeued, it->queued));
+            uint64_t start = Metrics::now();
+            FlowTable::resolveRoute(*it);
+            resolveLatency.since(start);
+            if (it->received != 0 && !it->requeued()) {
+                routeLatency.since(it->received);
             }
+            routesResolved.add();
+            FlowTable::finishRoutes(1);
         }
+    }
+}
 
-        if (existingEntry && pr.first == RMT_ADD) {
-            fprintf(stdout, "Received duplicate route addition for route %s\n",
-                    pr.second.address.toString().c_str());
-            continue;
+/**
+ * Account for route updates that the resolver is done with. Once every
+ * update from the initial sync has been handled, the time taken is reported.
+ */
+void FlowTable::finishRoutes(long count) {
+    if (__sync_sub_and_fetch(&FlowTable::queuedRoutes, count) == 0 &&
+            __sync_bool_compare_and_swap(&FlowTable::syncing, true, false)) {
+        // Send the tail of the initial sync without waiting.
+        FlowTable::flushRouteMods();
+
+        boost::posix_time::time_duration elapsed;
+        elapsed = boost::get_system_time() - FlowTable::syncStart;
+        RFLOG_INFO("Initial sync: %zu routes synced in %ldms (%ld superseded "
+                   "updates suppressed)", FlowTable::syncRoutes,
+                   (long) elapsed.total_milliseconds(),
+                   FlowTable::suppressedRoutes);
+
+        // Totals for each class over every queue, with the highest mark
+        for (unsigned c = 0; c < ROUTE_CLASSES; c++) {
+            RouteClass priority = (RouteClass) c;
+            RingStats total = { 0, 0, 0, 0, 0, 0 };
+            vector<RouteQueue*>::iterator it;
+            for (it = pendingRoutes.begin(); it != pendingRoutes.end(); it++) {
+                RingStats stats = (*it)->stats(priority);
+                total.highWater = std::max(total.highWater, stats.highWater);
+                total.pushed += stats.pushed;
+                total.dropped += stats.dropped;
+                total.coalesced += stats.coalesced;
+                total.blocked += stats.blocked;
+            }
+            if (total.pushed == 0) {
+                continue;
+            }
+            RFLOG_INFO("Route class %s: %lu queued, high water %zu, "
+                       "%lu dropped, %lu coalesced, %lu blocked",
+                       route_class_name(priority), total.pushed,
+                       total.highWater, total.dropped, total.coalesced,
+                       total.blocked);
         }
 
-        if (!existingEntry && pr.first == RMT_DELETE) {
-            fprintf(stdout, "Received route removal for %s but route %s.\n",
-                    pr.second.address.toString().c_str(), "cannot be found");
-            continue;
+        if (FlowTable::routeMods.getSize() > 0) {
+            FlowTable::installing = true;
         }
+    }
+}
 
-        const RouteEntry& re = pr.second;
-        if (pr.first != RMT_DELETE &&
-                findHost(re.address) == FlowTable::MAC_ADDR_NONE) {
-            /* Host is unresolved. Attempt to resolve it. */
-            if (resolveGateway(re.gateway, re.interface) < 0) {
-                /* If we can't resolve the gateway, put it to the end of the
-                 * queue. Routes with unresolvable gateways will constantly
-                 * loop through this code, popping and re-pushing. */
-                fprintf(stderr, "An error occurred while %s %s/%s.\n",
-                        "attempting to resolve", re.address.toString().c_str(),
-                        re.netmask.toString().c_str());
-                FlowTable::pendingRoutes.push(pr);
-                continue;
-            }
+/**
+ * Resolve and install a single route update.
+ *
+ * Other updates to the same prefix are only handled by the calling resolver
+ * thread, so the route table entry for the prefix can't change between
+ * reading it here and updating it afterwards. Only the shard of the prefix
+ * is locked, which other resolvers never use.
+ */
+void FlowTable::resolveRoute(const PendingRoute& pr) {
+    const RouteEntry& re = pr.entry;
+    AddressKey prefix(re.address, re.netmask.toPrefixLen());
+    RouteShard& shard = FlowTable::shardFor(prefix);
+
+    if (pr.refresh || pr.retries > 0) {
+        // Only wanted if no newer update for the prefix has been handled.
+        boost::lock_guard<boost::mutex> lock(shard.mutex);
+        const RouteEntry* current = shard.portRoutes.find(prefix);
+        if (pr.mod == RMT_DELETE ? current != NULL
+                                 : current == NULL || !(*current == re)) {
+            return;
         }
+    }
 
-        if (FlowTable::sendToHw(pr.first, pr.second) < 0) {
-            fprintf(stderr, "An error occurred while pushing route %s/%s.\n",
-                    re.address.toString().c_str(),
-                    re.netmask.toString().c_str());
-            FlowTable::pendingRoutes.push(pr);
-            continue;
+    /* Any update for a prefix supersedes a route parked for it. A replay
+     * is only still wanted if it is the route that was parked. */
+    bool parked = FlowTable::unparkRoute(shard, re);
+    if (pr.replay && !parked) {
+        return;
+    }
+
+    vector<uint32_t> ports;
+    vector<AddressKey> gateways;
+    if (pr.mod != RMT_DELETE) {
+        vector<RoutePath> paths = re.paths();
+        vector<RoutePath>::iterator it;
+        for (it = paths.begin(); it != paths.end(); it++) {
+            ports.push_back(it->interface.port);
+            gateways.push_back(AddressKey(it->gateway));
         }
+    }
 
-        if (pr.first == RMT_ADD) {
-            FlowTable::routeTable.push_back(pr.second);
-        } else if (pr.first == RMT_DELETE) {
-            FlowTable::routeTable.remove(pr.second);
+    RouteEntry existing;
+    bool existingEntry = false;
+    {
+        boost::lock_guard<boost::mutex> lock(shard.mutex);
+        if (pr.mod == RMT_DELETE) {
+            shard.portRoutes.remove(prefix);
+            shard.gatewayRoutes.remove(prefix);
         } else {
-            fprintf(stderr, "Received unexpected RouteModType (%d)\n", pr.first);
+            shard.portRoutes.set(prefix, ports, re);
+            shard.gatewayRoutes.set(prefix, gateways);
+        }
+
+        const RouteEntry* found = shard.routeTable.find(re);
+        if (found != NULL) {
+            existing = *found;
+            existingEntry = true;
+        }
+    }
+
+    if (!existingEntry && pr.mod == RMT_DELETE) {
+        if (pr.coalesced) {
+            // The route was added and removed again within the flap window.
+            long suppressed = __sync_add_and_fetch(
+                &FlowTable::suppressedRoutes, 1);
+            RFLOG_INFO("Suppressed flapping route %s (%ld updates "
+                       "suppressed)", re.address, suppressed);
+            return;
+        }
+        RFLOG_INFO("Received route removal for %s but route %s.", re.address,
+                   "cannot be found");
+        return;
+    }
+
+    /* Only paths with a resolved gateway are installed. The route waits
+     * for its other gateways parked, and is installed again once they
+     * resolve. */
+    RouteEntry installed(re);
+    if (pr.mod != RMT_DELETE &&
+            !FlowTable::resolveRoute(shard, re, installed)) {
+        /* Withdraw the installed route if it can no longer carry traffic,
+         * until one of its ports comes back up or its gateways resolve. */
+        if (existingEntry && FlowTable::is_route_dead(shard, existing) &&
+                FlowTable::sendToHw(RMT_DELETE, existing) == 0) {
+            FlowTable::releaseNextHops(shard, existing);
+            boost::lock_guard<boost::mutex> lock(shard.mutex);
+            shard.routeTable.remove(re);
+        }
+        return;
+    }
+
+    if (existingEntry && pr.mod == RMT_ADD && existing == installed) {
+        RFLOG_INFO("Received duplicate route addition for route %s",
+                   re.address);
+        return;
+    }
+
+    /* A new next hop for an installed prefix replaces the flow in place,
+     * rather than removing it and leaving a gap before the new one. */
+    RouteModType mod = pr.mod;
+    if (existingEntry && mod == RMT_ADD) {
+        mod = RMT_MODIFY;
+    }
+
+    if (FlowTable::sendToHw(mod, installed) < 0) {
+        RFLOG_ERROR("An error occurred while pushing route %s/%s (retry %u).",
+                    re.address, re.netmask, pr.retries + 1);
+        FlowTable::retryRoute(pr);
+        return;
+    }
+
+    if (pr.mod == RMT_ADD) {
+        if (existingEntry) {
+            FlowTable::releaseNextHops(shard, existing);
         }
+        boost::lock_guard<boost::mutex> lock(shard.mutex);
+        shard.routeTable.insert(installed);
+    } else if (pr.mod == RMT_DELETE) {
+        FlowTable::releaseNextHops(shard, existing);
+        boost::lock_guard<boost::mutex> lock(shard.mutex);
+        shard.routeTable.remove(re);
+    } else {
+        RFLOG_ERROR("Received unexpected RouteModType (%d)", pr.mod);
     }
 }
 
 /**
- * Get the local interface corresponding to the given interface number.
+ * Get the managed interface with the given interface index.
  *
- * On success, overwrites given interface pointer with the active interface
- * and returns 0;
- * On error, prints to stderr with appropriate message and returns -1.
+ * On success, returns the current record for the interface, without copying
+ * it. On error, logs an appropriate message and returns NULL.
  */
-int FlowTable::getInterface(const char *intf, const char *type,
-                            Interface& iface) {
-    map<string, Interface>::iterator it = interfaces.find(intf);
+const Interface* FlowTable::getInterface(int ifindex, const char *type) {
+    const Interface* iface = FlowTable::interfaces.find(ifindex);
 
-    if (it == interfaces.end()) {
-        fprintf(stderr, "Interface %s not found, dropping %s entry\n",
-                intf, type);
-        return -1;
+    if (iface == NULL) {
+        RFLOG_WARN("Interface %d not found, dropping %s entry", ifindex,
+                   type);
+        return NULL;
     }
 
-    if (not it->second.active) {
-        fprintf(stderr, "Interface %s inactive, dropping %s entry\n",
-                intf, type);
-        return -1;
+    if (not iface->active) {
+        RFLOG_WARN("Interface %s inactive, dropping %s entry", iface->name,
+                   type);
+        return NULL;
     }
 
-    iface = it->second;
-    return 0;
+    return iface;
 }
 
-int rta_to_ip(unsigned char family, const void *ip, IPAddress& result) {
-    if (family == AF_INET) {
-        result = IPAddress(reinterpret_cast<const struct in_addr *>(ip));
-    } else if (family == AF_INET6) {
-        result = IPAddress(reinterpret_cast<const struct in6_addr *>(ip));
-    } else {
-        fprintf(stderr, "Unrecognised nlmsg family");
-        return -1;
+int FlowTable::updateLinkOrHostTable(const struct sockaddr_nl *who,
+                                     struct nlmsghdr *n, void *arg) {
+    if (n->nlmsg_type == RTM_NEWLINK || n->nlmsg_type == RTM_DELLINK) {
+        return FlowTable::updateLinkTable(who, n, arg);
     }
+    return FlowTable::updateHostTable(who, n, arg);
+}
 
-    if (result.toString() == "") {
-        fprintf(stderr, "Blank IP address. Dropping Route\n");
-        return -1;
+/**
+ * Keep the interface cache in step with the kernel's links, so that
+ * interfaces can be found by index without asking the kernel.
+ */
+int FlowTable::updateLinkTable(const struct sockaddr_nl *, struct nlmsghdr *n,
+                               void *) {
+    struct ifinfomsg *ifi = (struct ifinfomsg *) NLMSG_DATA(n);
+
+    boost::this_thread::interruption_point();
+
+    if (n->nlmsg_type == RTM_DELLINK) {
+        FlowTable::interfaces.remove(ifi->ifi_index);
+        return 0;
+    }
+    if (n->nlmsg_type != RTM_NEWLINK) {
+        return 0;
+    }
+
+    struct rtattr *rtattr_ptr = IFLA_RTA(ifi);
+    int len = IFLA_PAYLOAD(n);
+    for (; RTA_OK(rtattr_ptr, len); rtattr_ptr = RTA_NEXT(rtattr_ptr, len)) {
+        if (rtattr_ptr->rta_type == IFLA_IFNAME) {
+            const Interface* iface = FlowTable::interfaces.update(
+                ifi->ifi_index, (const char *) RTA_DATA(rtattr_ptr));
+            if (iface != NULL) {
+                RFLOG_INFO("netlink->RTM_NEWLINK: index=%d, name=%s",
+                           ifi->ifi_index, iface->name);
+            }
+            break;
+        }
     }
 
     return 0;
 }
 
-int FlowTable::updateHostTable(const struct sockaddr_nl *, struct nlmsghdr *n, void *) {
-    struct ndmsg *ndmsg_ptr = (struct ndmsg *) NLMSG_DATA(n);
-    struct rtattr *rtattr_ptr;
+/* The IPAddress version for an address family decoded by NetlinkEvent */
+static int event_version(uint8_t family) {
+    return (family == AF_INET6) ? IPV6 : IPV4;
+}
 
-    char intf[IF_NAMESIZE + 1];
-    memset(intf, 0, IF_NAMESIZE + 1);
+/* The priority class of a route the kernel has from 'protocol', for routes
+ * whose prefix doesn't already say. Routes from zebra without a more specific
+ * protocol are bulk. */
+static RouteClass protocol_class(uint8_t protocol) {
+    switch (protocol) {
+    case RTPROT_BOOT:
+    case RTPROT_STATIC:
+    case RTPROT_ISIS:
+    case RTPROT_OSPF:
+    case RTPROT_RIP:
+        return ROUTE_CLASS_IGP;
+    default:
+        return ROUTE_CLASS_BULK;
+    }
+}
+
+int FlowTable::updateHostTable(const struct sockaddr_nl *, struct nlmsghdr *n, void *) {
+    NeighEvent ev;
 
     boost::this_thread::interruption_point();
 
-    if (if_indextoname((unsigned int) ndmsg_ptr->ndm_ifindex, (char *) intf) == NULL) {
-        perror("HostTable");
+    // Neighbours we won't use are dropped before anything is allocated.
+    if (parseNeighEvent(n, ev) < 0 || not ev.has_addr) {
         return 0;
     }
 
     /*
-    if (ndmsg_ptr->ndm_state != NUD_REACHABLE) {
-        cout << "ndm_state: " << (uint16_t) ndmsg_ptr->ndm_state << endl;
+    if (ev.state != NUD_REACHABLE) {
+        RFLOG_DEBUG("ndm_state: %u", ev.state);
         return 0;
     }
     */
 
-    boost::scoped_ptr<HostEntry> hentry(new HostEntry());
-
-    char mac[2 * IFHWADDRLEN + 5 + 1];
-    memset(mac, 0, 2 * IFHWADDRLEN + 5 + 1);
-
-    rtattr_ptr = (struct rtattr *) RTM_RTA(ndmsg_ptr);
-    int rtmsg_len = RTM_PAYLOAD(n);
-
-    for (; RTA_OK(rtattr_ptr, rtmsg_len); rtattr_ptr = RTA_NEXT(rtattr_ptr, rtmsg_len)) {
-        switch (rtattr_ptr->rta_type) {
-        case RTA_DST: {
-            if (rta_to_ip(ndmsg_ptr->ndm_family, RTA_DATA(rtattr_ptr),
-                          hentry->address) < 0) {
-                return 0;
-            }
-            break;
-        }
-        case NDA_LLADDR:
-            if (strncpy(mac, ether_ntoa(((ether_addr *) RTA_DATA(rtattr_ptr))), sizeof(mac)) == NULL) {
-                perror("HostTable");
-                return 0;
-            }
-            break;
-        default:
-            break;
-        }
+    const Interface* iface = getInterface(ev.ifindex, "host");
+    if (iface == NULL) {
+        return 0;
     }
 
-    hentry->hwaddress = MACAddress(mac);
-    if (getInterface(intf, "host", hentry->interface) != 0) {
+    HostEntry hentry;
+    hentry.address = IPAddress(event_version(ev.family), ev.addr);
+    hentry.interface = *iface;
+
+    // A neighbour that is deleted, or fails to resolve again, is lost.
+    if (n->nlmsg_type == RTM_DELNEIGH || (ev.state & NUD_FAILED)) {
+        RFLOG_INFO("netlink->%s: ip=%s, state=%u",
+                   n->nlmsg_type == RTM_DELNEIGH ? "RTM_DELNEIGH"
+                                                 : "RTM_NEWNEIGH",
+                   hentry.address, ev.state);
+        FlowTable::removeHost(hentry);
         return 0;
     }
 
-    if (strlen(mac) == 0) {
-        fprintf(stderr, "Received host entry with blank mac. Ignoring\n");
+    // Neighbours still being resolved, such as those we probe, have no MAC.
+    if (not ev.has_lladdr) {
+        RFLOG_DEBUG("Ignoring host entry %s with blank mac (state %u)",
+                    hentry.address, ev.state);
         return 0;
     }
+    hentry.hwaddress = MACAddress(ev.lladdr);
 
     switch (n->nlmsg_type) {
         case RTM_NEWNEIGH: {
-            FlowTable::sendToHw(RMT_ADD, *hentry);
-
-            string host = hentry->address.toString();
+            AddressKey host(hentry.address);
+            RouteModType mod = RMT_ADD;
+            bool changed = true;
             {
                 // Add to host table
                 boost::lock_guard<boost::mutex> lock(hostTableMutex);
-                FlowTable::hostTable[host] = *hentry;
+                const HostEntry* known = FlowTable::hostTable.find(host);
+                if (known != NULL) {
+                    mod = RMT_MODIFY;
+                    changed = !(known->hwaddress == hentry.hwaddress) ||
+                              known->interface.port != hentry.interface.port;
+                }
+                FlowTable::hostTable[host] = hentry;
+                FlowTable::portHosts.set(host, vector<uint32_t>(1,
+                        hentry.interface.port), hentry);
+            }
+            FlowTable::shareHost(host, hentry.hwaddress);
+
+            // The kernel reports a neighbour again each time it confirms
+            // it, which needs nothing installed unless it has moved.
+            if (changed) {
+                // Hosts on a down port are installed once it comes up.
+                if (!is_port_down(hentry.interface.port)) {
+                    FlowTable::sendToHw(mod, hentry);
+                }
+                FlowTable::updateNextHops(hentry);
             }
             {
-                // If we have been attempting neighbour discovery for this
-                // host, then we can close the associated socket.
+                // Neighbour discovery for this host, if any, is done.
                 boost::lock_guard<boost::mutex> lock(ndMutex);
-                map<string, int>::iterator iter = pendingNeighbours.find(host);
-                if (iter != pendingNeighbours.end()) {
-                    if (close(iter->second) == -1) {
-                        perror("pendingNeighbours");
-                    }
+                PendingNeighbour* pn = pendingNeighbours.find(host);
+                if (pn != NULL) {
+                    FlowTable::timers.cancel(pn->timer);
                     pendingNeighbours.erase(host);
                 }
             }
 
-            std::cout << "netlink->RTM_NEWNEIGH: ip=" << host << ", mac=" << mac
-                      << std::endl;
+            RFLOG_INFO("netlink->RTM_NEWNEIGH: ip=%s, mac=%s", hentry.address,
+                       hentry.hwaddress);
             break;
         }
-        /* TODO: enable this? It is causing serious problems. Why?
-        case RTM_DELNEIGH: {
-            std::cout << "netlink->RTM_DELNEIGH: ip=" << ip << ", mac=" << mac << std::endl;
-            FlowTable::sendToHw(RMT_DELETE, *hentry);
-            // TODO: delete from hostTable
-            boost::lock_guard<boost::mutex> lock(hostTableMutex);
-            break;
-        }
-        */
     }
 
     return 0;
@@ -325,149 +804,161 @@ int FlowTable::updateRouteTable(const struct sockaddr_nl *, struct nlmsghdr *n,
 #endif /* FPM_ENABLED */
 
 int FlowTable::updateRouteTable(struct nlmsghdr *n) {
-    struct rtmsg *rtmsg_ptr = (struct rtmsg *) NLMSG_DATA(n);
+    uint64_t received = Metrics::now();
+    RouteEvent ev;
 
     boost::this_thread::interruption_point();
 
-    if (!((n->nlmsg_type == RTM_NEWROUTE || n->nlmsg_type == RTM_DELROUTE) &&
-          rtmsg_ptr->rtm_table == RT_TABLE_MAIN)) {
+    if (parseRouteEvent(n, ev) < 0) {
+        return 0;
+    }
+    if (!((ev.type == RTM_NEWROUTE || ev.type == RTM_DELROUTE) &&
+          ev.table == RT_TABLE_MAIN)) {
         return 0;
     }
 
-    boost::scoped_ptr<RouteEntry> rentry(new RouteEntry());
-
-    char intf[IF_NAMESIZE + 1];
-    memset(intf, 0, IF_NAMESIZE + 1);
-
-    struct rtattr *rtattr_ptr;
-    rtattr_ptr = (struct rtattr *) RTM_RTA(rtmsg_ptr);
-    int rtmsg_len = RTM_PAYLOAD(n);
-
-    for (; RTA_OK(rtattr_ptr, rtmsg_len); rtattr_ptr = RTA_NEXT(rtattr_ptr, rtmsg_len)) {
-        switch (rtattr_ptr->rta_type) {
-        case RTA_DST:
-            if (rta_to_ip(rtmsg_ptr->rtm_family, RTA_DATA(rtattr_ptr),
-                          rentry->address) < 0) {
-                return 0;
-            }
-            break;
-        case RTA_GATEWAY:
-            if (rta_to_ip(rtmsg_ptr->rtm_family, RTA_DATA(rtattr_ptr),
-                          rentry->gateway) < 0) {
-                return 0;
-            }
-            break;
-        case RTA_OIF:
-            if_indextoname(*((int *) RTA_DATA(rtattr_ptr)), (char *) intf);
-            break;
-        case RTA_MULTIPATH: {
-            struct rtnexthop *rtnhp_ptr = (struct rtnexthop *) RTA_DATA(
-                    rtattr_ptr);
-            int rtnhp_len = RTA_PAYLOAD(rtattr_ptr);
-
-            if (rtnhp_len < (int) sizeof(*rtnhp_ptr)) {
-                break;
-            }
-
-            if (rtnhp_ptr->rtnh_len > rtnhp_len) {
-                break;
+    // Routes we don't manage are dropped before anything is allocated.
+    // Paths via interfaces we don't manage are left out, as are paths
+    // without a gateway, such as connected routes: there is no next hop to
+    // resolve, and the hosts on a connected subnet are installed one by one
+    // as their neighbour entries appear.
+    const Interface* ifaces[ROUTE_EVENT_MAX_PATHS];
+    const RouteEventPath* paths[ROUTE_EVENT_MAX_PATHS];
+    unsigned npaths = 0;
+    if (ev.multipath) {
+        for (unsigned i = 0; i < ev.npaths; i++) {
+            if (!ev.paths[i].has_gateway) {
+                continue;
             }
-
-            if_indextoname(rtnhp_ptr->rtnh_ifindex, (char *) intf);
-
-            int attrlen = rtnhp_len - sizeof(struct rtnexthop);
-
-            if (attrlen) {
-                struct rtattr *attr = RTNH_DATA(rtnhp_ptr);
-
-                for (; RTA_OK(attr, attrlen); attr = RTA_NEXT(attr, attrlen))
-                    if ((attr->rta_type == RTA_GATEWAY)) {
-                        if (rta_to_ip(rtmsg_ptr->rtm_family, RTA_DATA(attr),
-                                      rentry->gateway) < 0) {
-                            return 0;
-                        }
-                        break;
-                    }
+            const Interface* iface = getInterface(ev.paths[i].ifindex, "path");
+            if (iface != NULL) {
+                ifaces[npaths] = iface;
+                paths[npaths++] = &ev.paths[i];
             }
         }
-            break;
-        default:
-            break;
+    }
+    if (npaths == 0) {
+        if (!ev.paths[0].has_gateway) {
+            RFLOG_DEBUG("Ignoring route %s/%u without a gateway",
+                        IPAddress(event_version(ev.family), ev.dst),
+                        (unsigned) ev.dst_len);
+            return 0;
+        }
+        const Interface* iface = getInterface(ev.oif, "route");
+        if (iface == NULL) {
+            return 0;
         }
+        ifaces[0] = iface;
+        paths[npaths++] = &ev.paths[0];
     }
 
-    rentry->netmask = IPAddress(IPV4, rtmsg_ptr->rtm_dst_len);
-
-    if (getInterface(intf, "route", rentry->interface) != 0) {
-        return 0;
+    // Routes without RTA_DST (such as the default route) cover everything,
+    // which the zeroed destination of the event already gives us.
+    int version = event_version(ev.family);
+    RouteEntry rentry;
+    rentry.address = IPAddress(version, ev.dst);
+    rentry.netmask = IPAddress(version, (int) ev.dst_len);
+
+    // The first path stands in wherever a single path is expected.
+    rentry.gateway = IPAddress(version, paths[0]->gateway);
+    rentry.interface = *ifaces[0];
+    if (npaths > 1) {
+        rentry.multipath.reserve(npaths);
+        for (unsigned i = 0; i < npaths; i++) {
+            RoutePath path;
+            path.gateway = IPAddress(version, paths[i]->gateway);
+            path.interface = *ifaces[i];
+            path.weight = paths[i]->weight;
+            rentry.multipath.push_back(path);
+        }
     }
 
-    string net = rentry->address.toString();
-    string mask = rentry->netmask.toString();
-    string gw = rentry->gateway.toString();
+    const char* op = (ev.type == RTM_NEWROUTE) ? "RTM_NEWROUTE"
+                                               : "RTM_DELROUTE";
+    if (rentry.multipath.empty()) {
+        RFLOG_INFO("netlink->%s: net=%s, mask=%s, gw=%s", op, rentry.address,
+                   rentry.netmask, rentry.gateway);
+    } else {
+        RFLOG_INFO("netlink->%s: net=%s, mask=%s, gw=%s (+%zu paths)", op,
+                   rentry.address, rentry.netmask, rentry.gateway,
+                   rentry.multipath.size() - 1);
+    }
 
-    switch (n->nlmsg_type) {
-        case RTM_NEWROUTE:
-            std::cout << "netlink->RTM_NEWROUTE: net=" << net << ", mask="
-                      << mask << ", gw=" << gw << std::endl;
-            FlowTable::pendingRoutes.push(PendingRoute(RMT_ADD, *rentry));
-            break;
-        case RTM_DELROUTE:
-            std::cout << "netlink->RTM_DELROUTE: net=" << net << ", mask="
-                      << mask << ", gw=" << gw << std::endl;
-            FlowTable::pendingRoutes.push(PendingRoute(RMT_DELETE, *rentry));
-            break;
+    RouteModType mod = (ev.type == RTM_NEWROUTE) ? RMT_ADD : RMT_DELETE;
+    PendingRoute pr(mod, rentry);
+    pr.received = received;
+    routesReceived.add();
+    if (pr.priority == ROUTE_CLASS_BULK) {
+        pr.priority = protocol_class(ev.protocol);
     }
+    FlowTable::queueRoute(pr, true);
 
     return 0;
 }
 
+#ifndef FPM_ENABLED
 /**
- * Begins the neighbour discovery process to the specified host.
- *
- * Returns an open socket on success, or -1 on error.
+ * Catch up with route changes lost when the route socket overran. Every
+ * route is dumped again, and any installed route that the kernel no longer
+ * has is removed.
  */
-int FlowTable::initiateND(const char *hostAddr) {
-    int s, flags;
-    struct sockaddr_storage store;
-    struct sockaddr_in *sin = (struct sockaddr_in*)&store;
-    struct sockaddr_in6 *sin6 = (struct sockaddr_in6*)&store;
-
-    memset(&store, 0, sizeof(store));
+void FlowTable::resyncRoutes() {
+    AddressMap<bool> seen;
+    if (FlowTable::dumpTable(RTM_GETROUTE, FlowTable::resyncRouteTable,
+                             &seen) < 0) {
+        return;
+    }
 
-    if (inet_pton(AF_INET, hostAddr, &sin->sin_addr) == 1) {
-        store.ss_family = AF_INET;
-    } else if (inet_pton(AF_INET6, hostAddr, &sin6->sin6_addr) == 1) {
-        store.ss_family = AF_INET6;
-    } else {
-        fprintf(stderr, "Invalid IP address \"%s\" for resolution. Dropping\n",
-                hostAddr);
-        return -1;
+    vector<RouteEntry> installed;
+    vector<RouteShard*>::iterator shard;
+    for (shard = shards.begin(); shard != shards.end(); shard++) {
+        boost::lock_guard<boost::mutex> lock((*shard)->mutex);
+        vector<RouteEntry> entries = (*shard)->routeTable.entries();
+        installed.insert(installed.end(), entries.begin(), entries.end());
     }
 
-    if ((s = socket(store.ss_family, SOCK_STREAM, 0)) < 0) {
-        perror("socket() failed");
-        return -1;
+    size_t removed = 0;
+    vector<RouteEntry>::iterator it;
+    for (it = installed.begin(); it != installed.end(); it++) {
+        AddressKey prefix(it->address, it->netmask.toPrefixLen());
+        if (seen.find(prefix) == NULL) {
+            FlowTable::queueRoute(PendingRoute(RMT_DELETE, *it), true);
+            removed++;
+        }
     }
 
-    // Prevent the connect() call from blocking
-    flags = fcntl(s, F_GETFL, 0);
-    if (fcntl(s, F_SETFL, flags | O_NONBLOCK) == -1) {
-        perror("fcntl() failed");
-        close(s);
-        return -1;
+    RFLOG_INFO("Resynced routes: %zu dumped, %zu stale routes removed",
+               seen.size(), removed);
+}
+
+/**
+ * Handle a route from a resync dump, recording its prefix in the
+ * AddressMap<bool> given as 'arg'.
+ */
+int FlowTable::resyncRouteTable(const struct sockaddr_nl *,
+                                struct nlmsghdr *n, void *arg) {
+    AddressMap<bool>* seen = (AddressMap<bool> *) arg;
+    RouteEvent ev;
+
+    if (parseRouteEvent(n, ev) == 0 && ev.type == RTM_NEWROUTE &&
+            ev.table == RT_TABLE_MAIN) {
+        IPAddress dst(event_version(ev.family), ev.dst);
+        (*seen)[AddressKey(dst, ev.dst_len)] = true;
     }
 
-    connect(s, (struct sockaddr *)&store, sizeof(store));
-    return s;
+    return FlowTable::updateRouteTable(n);
 }
+#endif /* FPM_ENABLED */
 
 /**
- * Initiates the gateway resolution process for the given host.
+ * Initiates the gateway resolution process for the given host, by asking the
+ * kernel to probe for it. A gateway still unresolved is probed again after
+ * NEIGHBOUR_PROBE_INTERVAL ms, then after twice as long each time, until it
+ * has been probed NEIGHBOUR_PROBE_ATTEMPTS times.
  *
  * Returns:
  *  0 if address resolution is currently being performed
- * -1 on error (usually an issue with the socket)
+ * -1 on error (the interface is down or unknown)
  */
 int FlowTable::resolveGateway(const IPAddress& gateway,
                               const Interface& iface) {
@@ -475,24 +966,222 @@ int FlowTable::resolveGateway(const IPAddress& gateway,
         return -1;
     }
 
-    string gateway_str = gateway.toString();
+    int ifindex = iface.ifindex;
+    if (ifindex == 0) {
+        ifindex = if_nametoindex(iface.name.c_str());
+        if (ifindex == 0) {
+            return -1;
+        }
+    }
+
+    AddressKey key(gateway);
 
-    // If we already initiated neighbour discovery for this gateway, return.
+    // If this gateway is already being resolved, wait for the result.
     boost::lock_guard<boost::mutex> lock(ndMutex);
-    if (pendingNeighbours.find(gateway_str) != pendingNeighbours.end()) {
+    if (pendingNeighbours.find(key) != NULL) {
         return 0;
     }
 
-    // Otherwise, we should go ahead and begin the process.
-    int sock = initiateND(gateway_str.c_str());
-    if (sock == -1) {
-        return -1;
-    }
-    FlowTable::pendingNeighbours[gateway_str] = sock;
+    PendingNeighbour& pn = FlowTable::pendingNeighbours[key];
+    pn.address = gateway;
+    pn.ifindex = ifindex;
+    pn.probes = 1;
+    pn.serial = ++FlowTable::neighbourSerial;
+    pn.timer = FlowTable::timers.schedule(NEIGHBOUR_PROBE_INTERVAL,
+        boost::bind(&FlowTable::retryNeighbour, gateway, pn.serial));
+    FlowTable::prober.probe(gateway, ifindex);
 
     return 0;
 }
 
+/**
+ * Probe for a gateway that is still unresolved, or give up on it once it has
+ * been probed NEIGHBOUR_PROBE_ATTEMPTS times. Routes parked on a gateway that
+ * was given up on stay parked, in case it resolves later, and the next route
+ * through it starts resolving it again.
+ */
+void FlowTable::retryNeighbour(const IPAddress& gateway, unsigned serial) {
+    AddressKey key(gateway);
+
+    boost::lock_guard<boost::mutex> lock(ndMutex);
+    PendingNeighbour* pn = FlowTable::pendingNeighbours.find(key);
+    if (pn == NULL || pn->serial != serial) {
+        return;
+    }
+
+    if (pn->probes >= NEIGHBOUR_PROBE_ATTEMPTS) {
+        size_t waiting = 0;
+        vector<RouteShard*>::iterator it;
+        for (it = shards.begin(); it != shards.end(); it++) {
+            boost::lock_guard<boost::mutex> shardLock((*it)->mutex);
+            const list<RouteEntry>* parked = (*it)->parkedRoutes.find(key);
+            if (parked != NULL) {
+                waiting += parked->size();
+            }
+        }
+        RFLOG_WARN("Gateway %s unresolved after %u probes (%zu routes "
+                   "waiting)", gateway, pn->probes, waiting);
+        FlowTable::pendingNeighbours.erase(key);
+        return;
+    }
+
+    pn->timer = FlowTable::timers.schedule(
+        NEIGHBOUR_PROBE_INTERVAL << pn->probes,
+        boost::bind(&FlowTable::retryNeighbour, gateway, serial));
+    pn->probes++;
+    FlowTable::prober.probe(gateway, pn->ifindex);
+}
+
+/**
+ * Work out which paths of a route can be installed, starting resolution of
+ * any unresolved gateways. 'installed' is set to the route restricted to the
+ * paths with a resolved gateway through a port that is up. If a gateway is
+ * unresolved, the route is parked on it, to be replayed once the gateway
+ * resolves. Paths through down ports come back when the port does.
+ *
+ * Returns false if no path of the route can be installed yet.
+ */
+bool FlowTable::resolveRoute(RouteShard& shard, const RouteEntry& re,
+                             RouteEntry& installed) {
+    vector<RoutePath> paths = re.paths();
+    vector<RoutePath> resolved;
+    bool parked = false;
+
+    vector<RoutePath>::iterator it;
+    for (it = paths.begin(); it != paths.end(); it++) {
+        if (is_port_down(it->interface.port)) {
+            continue;
+        }
+        if (findHost(shard, it->gateway) == FlowTable::MAC_ADDR_NONE) {
+            if (resolveGateway(it->gateway, it->interface) < 0) {
+                RFLOG_ERROR("An error occurred while %s %s via %s.",
+                            "attempting to resolve", re.address, it->gateway);
+            }
+            // One parking is enough to bring the route back.
+            if (parked) {
+                continue;
+            }
+            if (FlowTable::parkRoute(shard, re, it->gateway)) {
+                parked = true;
+                continue;
+            }
+        }
+        resolved.push_back(*it);
+    }
+
+    if (resolved.empty()) {
+        return false;
+    }
+
+    installed = re;
+    installed.gateway = resolved[0].gateway;
+    installed.interface = resolved[0].interface;
+    installed.multipath.clear();
+    if (resolved.size() > 1) {
+        installed.multipath = resolved;
+    }
+    return true;
+}
+
+/**
+ * Park a route until the given gateway resolves, so that the resolver does
+ * not spin on it in the meantime.
+ *
+ * Returns true if the route was parked, or false if the gateway has been
+ * resolved since the caller last checked.
+ */
+bool FlowTable::parkRoute(RouteShard& shard, const RouteEntry& re,
+                          const IPAddress& gateway) {
+    boost::lock_guard<boost::mutex> lock(shard.mutex);
+
+    // The shard's copy of the host is made in the same step as parked routes
+    // are released, so this check cannot miss a neighbour that appears while
+    // we park the route.
+    AddressKey key(gateway);
+    if (shard.hosts.find(key) == NULL) {
+        shard.parkedRoutes[key].push_back(re);
+        shard.parkedIndex.insert(re);
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Forget any route parked for the same prefix as the given route.
+ *
+ * Returns true if the parked route was identical to the given route.
+ */
+bool FlowTable::unparkRoute(RouteShard& shard, const RouteEntry& re) {
+    boost::lock_guard<boost::mutex> lock(shard.mutex);
+
+    const RouteEntry* parked = shard.parkedIndex.find(re);
+    if (parked == NULL) {
+        return false;
+    }
+    bool same = (*parked == re);
+
+    // The route is listed under whichever of its gateways it waits for, or
+    // under none if it has already been released.
+    vector<RoutePath> paths = parked->paths();
+    vector<RoutePath>::iterator path;
+    for (path = paths.begin(); path != paths.end(); path++) {
+        AddressKey gateway(path->gateway);
+        list<RouteEntry>* waiting = shard.parkedRoutes.find(gateway);
+        if (waiting == NULL) {
+            continue;
+        }
+
+        list<RouteEntry>::iterator it;
+        for (it = waiting->begin(); it != waiting->end(); it++) {
+            if (it->address == re.address && it->netmask == re.netmask) {
+                waiting->erase(it);
+                break;
+            }
+        }
+        if (waiting->empty()) {
+            shard.parkedRoutes.erase(gateway);
+        }
+    }
+
+    shard.parkedIndex.remove(re);
+    return same;
+}
+
+/**
+ * Copy the MAC address of a host that resolved into every shard, and queue
+ * all routes parked on it for another attempt. The routes stay in parkedIndex
+ * until the resolver replays them, so that updates queued ahead of the
+ * replays still supersede them.
+ */
+void FlowTable::shareHost(const AddressKey& host,
+                          const MACAddress& hwaddress) {
+    vector<RouteShard*>::iterator shard;
+    for (shard = shards.begin(); shard != shards.end(); shard++) {
+        boost::lock_guard<boost::mutex> lock((*shard)->mutex);
+        (*shard)->hosts[host] = hwaddress;
+
+        list<RouteEntry>* waiting = (*shard)->parkedRoutes.find(host);
+        if (waiting == NULL) {
+            continue;
+        }
+        list<RouteEntry>::iterator it;
+        for (it = waiting->begin(); it != waiting->end(); it++) {
+            FlowTable::queueRoute(PendingRoute(RMT_ADD, *it, true));
+        }
+        (*shard)->parkedRoutes.erase(host);
+    }
+}
+
+/* Remove the copies of a lost host from every shard. */
+void FlowTable::unshareHost(const AddressKey& host) {
+    vector<RouteShard*>::iterator shard;
+    for (shard = shards.begin(); shard != shards.end(); shard++) {
+        boost::lock_guard<boost::mutex> lock((*shard)->mutex);
+        (*shard)->hosts.erase(host);
+    }
+}
+
 /**
  * Find the MAC Address for the given host in a thread-safe manner.
  *
@@ -501,23 +1190,356 @@ int FlowTable::resolveGateway(const IPAddress& gateway,
  * FlowTable::MAC_ADDR_NONE. Neighbour Discovery is not performed by this
  * function.
  */
-const MACAddress& FlowTable::findHost(const IPAddress& host) {
+MACAddress FlowTable::findHost(const IPAddress& host) {
     boost::lock_guard<boost::mutex> lock(hostTableMutex);
-    map<string, HostEntry>::iterator iter;
-    iter = FlowTable::hostTable.find(host.toString());
-    if (iter != FlowTable::hostTable.end()) {
-        return iter->second.hwaddress;
+    const HostEntry* entry = FlowTable::hostTable.find(AddressKey(host));
+    if (entry != NULL) {
+        return entry->hwaddress;
+    }
+
+    return FlowTable::MAC_ADDR_NONE;
+}
+
+/**
+ * Find the MAC Address for the given host in the copy of the host table kept
+ * by a shard, which only the resolver of the shard and neighbour updates use.
+ */
+MACAddress FlowTable::findHost(RouteShard& shard, const IPAddress& host) {
+    boost::lock_guard<boost::mutex> lock(shard.mutex);
+    const MACAddress* hwaddress = shard.hosts.find(AddressKey(host));
+    if (hwaddress != NULL) {
+        return *hwaddress;
     }
 
     return FlowTable::MAC_ADDR_NONE;
 }
 
+/**
+ * Take a reference on the next hop for the given path in a shard, telling
+ * RFServer about the next hop if it is new.
+ */
+NextHop FlowTable::acquireNextHop(RouteShard& shard, const RoutePath& path,
+                                  const MACAddress& hwaddress) {
+    boost::lock_guard<boost::mutex> lock(shard.nextHopMutex);
+    bool created;
+    NextHop nh = shard.nextHops.acquire(path.interface, path.gateway,
+                                        hwaddress, created);
+    if (created) {
+        FlowTable::sendNextHop(shard, RMT_ADD, nh);
+    }
+    return nh;
+}
+
+/**
+ * Drop the reference held by each of the given paths on its next hop,
+ * removing next hops from RFServer once no route uses them.
+ */
+void FlowTable::releaseNextHops(RouteShard& shard,
+                                const vector<RoutePath>& paths) {
+    boost::lock_guard<boost::mutex> lock(shard.nextHopMutex);
+    vector<RoutePath>::const_iterator it;
+    for (it = paths.begin(); it != paths.end(); it++) {
+        NextHop removed;
+        if (shard.nextHops.release(it->interface, it->gateway, removed)) {
+            FlowTable::sendNextHop(shard, RMT_DELETE, removed);
+        }
+    }
+}
+
+void FlowTable::releaseNextHops(RouteShard& shard, const RouteEntry& re) {
+    FlowTable::releaseNextHops(shard, re.paths());
+}
+
+/**
+ * Re-point every next hop through the given host at its current MAC address.
+ * This costs one message per next hop in each shard, however many routes use
+ * it.
+ */
+void FlowTable::updateNextHops(const HostEntry& he) {
+    vector<RouteShard*>::iterator shard;
+    for (shard = shards.begin(); shard != shards.end(); shard++) {
+        boost::lock_guard<boost::mutex> lock((*shard)->nextHopMutex);
+        vector<NextHop> changed = (*shard)->nextHops.update(he.interface,
+                                                            he.address,
+                                                            he.hwaddress);
+        vector<NextHop>::iterator it;
+        for (it = changed.begin(); it != changed.end(); it++) {
+            FlowTable::sendNextHop(**shard, RMT_ADD, *it);
+        }
+    }
+}
+
+/**
+ * Create, update (RMT_ADD) or remove (RMT_DELETE) a next hop of a shard in
+ * RFServer.
+ */
+int FlowTable::sendNextHop(RouteShard& shard, RouteModType mod,
+                           const NextHop& nh) {
+    NextHopMod msg;
+
+    msg.set_mod(mod);
+    msg.set_id(FlowTable::vm_id);
+    msg.set_nexthop_id(nh.id);
+
+    if (mod != RMT_DELETE) {
+        msg.add_action(Action(RFAT_SET_ETH_SRC, nh.interface.hwaddress));
+        msg.add_action(Action(RFAT_SET_ETH_DST, nh.hwaddress));
+    }
+    msg.add_action(Action(RFAT_OUTPUT, nh.interface.port));
+
+    /* Keep RouteMods and NextHopMods in order: routes queued before a next
+     * hop changes must not see it early, or late if it is removed. Only the
+     * routes of the shard use its next hops. */
+    shard.batcher.flush();
+    FlowTable::ipc->send(RFCLIENT_RFSERVER_CHANNEL, RFSERVER_ID, msg);
+    return 0;
+}
+
+/* Send the RouteMods waiting in the batcher of every shard. */
+void FlowTable::flushRouteMods() {
+    vector<RouteShard*>::iterator it;
+    for (it = shards.begin(); it != shards.end(); it++) {
+        (*it)->batcher.flush();
+    }
+}
+
+/**
+ * Send a RouteMod to RFServer, and if acknowledgements are enabled, await
+ * one for it. 'prefix' is the prefix the RouteMod is for, if any, so that it
+ * is only sent again on failure while it is the latest for its prefix.
+ * RouteMods are batched with the others of the shard of their prefix, and
+ * those without one with the first shard.
+ */
+int FlowTable::sendRouteMod(const RouteMod& rm, const AddressKey* prefix) {
+    SentRouteMod sent;
+    sent.rm = rm;
+    if (prefix != NULL) {
+        sent.keyed = true;
+        sent.prefix = *prefix;
+    }
+    FlowTable::sendRouteMod(sent);
+    return 0;
+}
+
+void FlowTable::sendRouteMod(SentRouteMod& sent) {
+    routeModsSent.add();
+    RouteModBatcher& batcher = sent.keyed
+        ? FlowTable::shardFor(sent.prefix).batcher
+        : FlowTable::shards[0]->batcher;
+    if (FlowTable::routeMods.getSize() == 0) {
+        batcher.add(sent.rm);
+        return;
+    }
+
+    // RouteMods still in the batches can't be acknowledged, so send them
+    // before waiting for room.
+    if (resolving && FlowTable::routeMods.full()) {
+        FlowTable::flushRouteMods();
+    }
+    uint64_t seq = FlowTable::routeMods.open(sent, resolving);
+    TimerId timer = FlowTable::timers.schedule(ROUTE_MOD_ACK_TIMEOUT,
+        boost::bind(&FlowTable::ackTimeout, seq));
+    FlowTable::routeMods.setTimer(seq, timer);
+    batcher.add(sent.rm);
+}
+
+/**
+ * Handle the acknowledgement of RouteMod 'seq' from RFServer. RouteMods that
+ * failed to install are sent again, unless RFServer dropped them as it had no
+ * datapath for them.
+ */
+void FlowTable::ackRouteMod(uint64_t seq, RouteModStatus status) {
+    SentRouteMod sent;
+    if (!FlowTable::routeMods.close(seq, status, false, sent)) {
+        RFLOG_DEBUG("Ignoring acknowledgement for RouteMod %lu", seq);
+        return;
+    }
+    FlowTable::timers.cancel(sent.timer);
+
+    if (status == RMS_SUCCESS) {
+        boost::posix_time::time_duration latency;
+        latency = boost::get_system_time() - sent.sent;
+        ackLatency.record(latency.total_nanoseconds());
+        RFLOG_DEBUG("RouteMod %lu installed in %ldus", seq,
+                    (long) latency.total_microseconds());
+    } else if (status == RMS_DROPPED) {
+        RFLOG_WARN("RouteMod %lu dropped by RFServer", seq);
+        FlowTable::routeMods.forget(sent);
+    } else {
+        FlowTable::retryRouteMod(sent, "failed to install");
+    }
+
+    if (FlowTable::routeMods.pending() == 0 &&
+            __sync_bool_compare_and_swap(&FlowTable::installing, true,
+                                         false)) {
+        RouteModWindowStats stats = FlowTable::routeMods.stats();
+        boost::posix_time::time_duration elapsed;
+        elapsed = boost::get_system_time() - FlowTable::syncStart;
+        RFLOG_INFO("Initial sync: %zu routes installed in %ldms (%lu "
+                   "RouteMods acknowledged, mean latency %luus, max %luus, "
+                   "%lu failed)", FlowTable::syncRoutes,
+                   (long) elapsed.total_milliseconds(), stats.acked,
+                   stats.acked > 0 ? stats.latencySum / stats.acked : 0,
+                   stats.latencyMax, stats.failed + stats.timedOut);
+    }
+}
+
+void FlowTable::ackTimeout(uint64_t seq) {
+    SentRouteMod sent;
+    if (FlowTable::routeMods.close(seq, RMS_FAILED, true, sent)) {
+        FlowTable::retryRouteMod(sent, "was not acknowledged");
+    }
+}
+
+/**
+ * Send a RouteMod that failed again once it has waited for retryDelay(),
+ * unless it has failed ROUTE_MOD_ATTEMPTS times.
+ */
+void FlowTable::retryRouteMod(const SentRouteMod& sent, const char* reason) {
+    uint64_t seq = sent.seq;
+    if (sent.attempts + 1 >= ROUTE_MOD_ATTEMPTS) {
+        RFLOG_ERROR("RouteMod %lu %s, giving up after %u attempts", seq,
+                    reason, ROUTE_MOD_ATTEMPTS);
+        FlowTable::routeMods.forget(sent);
+        return;
+    }
+    if (!FlowTable::routeMods.isLatest(sent)) {
+        return;
+    }
+
+    RFLOG_WARN("RouteMod %lu %s (retry %u)", seq, reason, sent.attempts + 1);
+    SentRouteMod retry(sent);
+    retry.attempts++;
+    FlowTable::timers.schedule(FlowTable::retryDelay(sent.attempts),
+        boost::bind(&FlowTable::resendRouteMod, retry));
+}
+
+/* A later RouteMod for the prefix makes the retry unnecessary. */
+void FlowTable::resendRouteMod(const SentRouteMod& sent) {
+    if (FlowTable::routeMods.isLatest(sent)) {
+        SentRouteMod retry(sent);
+        FlowTable::sendRouteMod(retry);
+    }
+}
+
 bool FlowTable::is_port_down(uint32_t port) {
-    vector<uint32_t>::iterator it;
-    for (it=down_ports->begin() ; it < down_ports->end(); it++)
-        if (*it == port)
-            return true;
-    return false;
+    return FlowTable::ports->isDown(port);
+}
+
+/**
+ * Whether no path of a route can carry traffic, because each goes through a
+ * port that is down or a gateway that is not resolved.
+ */
+bool FlowTable::is_route_dead(RouteShard& shard, const RouteEntry& re) {
+    vector<RoutePath> paths = re.paths();
+    vector<RoutePath>::iterator it;
+    for (it = paths.begin(); it != paths.end(); it++) {
+        if (!is_port_down(it->interface.port) &&
+                !(findHost(shard, it->gateway) == FlowTable::MAC_ADDR_NONE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Called by PortState whenever a VM port goes down or comes back up. Ports
+ * are down until RFServer associates them with a datapath port, so nothing is
+ * sent for them that RFServer would drop. Until then, the hosts and routes
+ * using them are only kept in portHosts and the portRoutes of each shard,
+ * with each prefix holding just its latest route.
+ *
+ * Hosts on the port are withdrawn or reinstalled straight away. Routes using
+ * the port are queued for the resolver, which installs them again with only
+ * the paths through ports that are up, or withdraws them if there are none.
+ */
+void FlowTable::updatePortState(uint32_t port, bool down) {
+    vector<RouteEntry> routes;
+    vector<RouteShard*>::iterator shard;
+    for (shard = shards.begin(); shard != shards.end(); shard++) {
+        boost::lock_guard<boost::mutex> lock((*shard)->mutex);
+        vector<RouteEntry> using_port = (*shard)->portRoutes.get(port);
+        routes.insert(routes.end(), using_port.begin(), using_port.end());
+    }
+    vector<HostEntry> hosts;
+    {
+        boost::lock_guard<boost::mutex> lock(hostTableMutex);
+        hosts = FlowTable::portHosts.get(port);
+    }
+
+    RFLOG_INFO("Port %u is %s: updating %zu routes and %zu hosts", port,
+               down ? "down" : "up", routes.size(), hosts.size());
+
+    vector<HostEntry>::iterator host;
+    for (host = hosts.begin(); host != hosts.end(); host++) {
+        FlowTable::sendToHw(down ? RMT_DELETE : RMT_ADD, *host);
+    }
+    FlowTable::flushRouteMods();
+
+    FlowTable::refreshRoutes(routes, down);
+}
+
+/**
+ * Called when a neighbour is deleted or fails to resolve. The host is
+ * withdrawn, and the routes through it as a gateway are queued for the
+ * resolver, which installs them again with their other paths, or withdraws
+ * them, parking them until the gateway resolves again. Only the routes
+ * through the gateway are looked at.
+ */
+void FlowTable::removeHost(const HostEntry& he) {
+    AddressKey host(he.address);
+    HostEntry removed;
+    {
+        boost::lock_guard<boost::mutex> lock(hostTableMutex);
+        const HostEntry* found = FlowTable::hostTable.find(host);
+        if (found == NULL) {
+            return;
+        }
+        removed = *found;
+        FlowTable::hostTable.erase(host);
+        FlowTable::portHosts.remove(host);
+    }
+    FlowTable::unshareHost(host);
+    FlowTable::sendToHw(RMT_DELETE, removed);
+
+    vector<RouteEntry> routes;
+    vector<RouteShard*>::iterator shard;
+    for (shard = shards.begin(); shard != shards.end(); shard++) {
+        boost::lock_guard<boost::mutex> lock((*shard)->mutex);
+        vector<AddressKey> prefixes = (*shard)->gatewayRoutes.get(host);
+        vector<AddressKey>::iterator it;
+        for (it = prefixes.begin(); it != prefixes.end(); it++) {
+            // Skip any prefix the two indexes don't agree on, rather than
+            // trust that they never drift apart.
+            const RouteEntry* route = (*shard)->portRoutes.find(*it);
+            if (route != NULL) {
+                routes.push_back(*route);
+            }
+        }
+    }
+
+    RFLOG_INFO("Neighbour %s lost: updating %zu routes", removed.address,
+               routes.size());
+    FlowTable::flushRouteMods();
+
+    FlowTable::refreshRoutes(routes, true);
+}
+
+/**
+ * Queue routes for the resolver to install again as they are now, unless
+ * newer updates for them arrive first. Routes that 'failed' a path go with
+ * the withdrawals, as traffic on that path is being lost.
+ */
+void FlowTable::refreshRoutes(const vector<RouteEntry>& routes, bool failed) {
+    vector<RouteEntry>::const_iterator it;
+    for (it = routes.begin(); it != routes.end(); it++) {
+        PendingRoute pr(RMT_ADD, *it);
+        pr.refresh = true;
+        if (failed) {
+            pr.priority = ROUTE_CLASS_WITHDRAW;
+        }
+        FlowTable::queueRoute(pr);
+    }
 }
 
 int FlowTable::setEthernet(RouteMod& rm, const Interface& local_iface,
@@ -540,7 +1562,7 @@ int FlowTable::setIP(RouteMod& rm, const IPAddress& addr,
     } else if (addr.getVersion() == IPV6) {
         rm.add_match(Match(RFMT_IPV6, addr, mask));
     } else {
-        fprintf(stderr, "Cannot send route with unsupported IP version\n");
+        RFLOG_ERROR("Cannot send route with unsupported IP version");
         return -1;
     }
 
@@ -552,21 +1574,43 @@ int FlowTable::setIP(RouteMod& rm, const IPAddress& addr,
 }
 
 int FlowTable::sendToHw(RouteModType mod, const RouteEntry& re) {
-    const string gateway_str = re.gateway.toString();
     if (mod == RMT_DELETE) {
         return sendToHw(mod, re.address, re.netmask, re.interface,
                         FlowTable::MAC_ADDR_NONE);
-    } else if (mod == RMT_ADD) {
-        const MACAddress& remoteMac = findHost(re.gateway);
-        if (remoteMac == FlowTable::MAC_ADDR_NONE) {
-            fprintf(stderr, "Cannot Resolve %s\n", gateway_str.c_str());
-            return -1;
+    } else if (mod == RMT_ADD || mod == RMT_MODIFY) {
+        RouteShard& shard = FlowTable::shardFor(
+            AddressKey(re.address, re.netmask.toPrefixLen()));
+        vector<RoutePath> paths = re.paths();
+        vector<RoutePath> acquired;
+        vector<NextHop> nexthops;
+
+        vector<RoutePath>::iterator it;
+        for (it = paths.begin(); it != paths.end(); it++) {
+            MACAddress remoteMac = findHost(shard, it->gateway);
+            if (remoteMac == FlowTable::MAC_ADDR_NONE) {
+                RFLOG_WARN("Cannot Resolve %s", it->gateway);
+                releaseNextHops(shard, acquired);
+                return -1;
+            }
+
+            if (is_port_down(it->interface.port)) {
+                RFLOG_WARN("Cannot send RouteMod for down port");
+                releaseNextHops(shard, acquired);
+                return -1;
+            }
+
+            nexthops.push_back(acquireNextHop(shard, *it, remoteMac));
+            acquired.push_back(*it);
         }
 
-        return sendToHw(mod, re.address, re.netmask, re.interface, remoteMac);
+        if (sendToHw(mod, re.address, re.netmask, paths, nexthops) < 0) {
+            releaseNextHops(shard, acquired);
+            return -1;
+        }
+        return 0;
     }
 
-    fprintf(stderr, "Unhandled RouteModType (%d)\n", mod);
+    RFLOG_ERROR("Unhandled RouteModType (%d)", mod);
     return -1;
 }
 
@@ -578,7 +1622,7 @@ int FlowTable::sendToHw(RouteModType mod, const HostEntry& he) {
     } else if (he.address.getVersion() == IPV4) {
         mask.reset(new IPAddress(IPV4, FULL_IPV4_PREFIX));
     } else {
-        fprintf(stderr, "Received HostEntry with unsupported IP version\n");
+        RFLOG_ERROR("Received HostEntry with unsupported IP version");
         return -1;
     }
 
@@ -588,8 +1632,9 @@ int FlowTable::sendToHw(RouteModType mod, const HostEntry& he) {
 int FlowTable::sendToHw(RouteModType mod, const IPAddress& addr,
                          const IPAddress& mask, const Interface& local_iface,
                          const MACAddress& gateway) {
-    if (is_port_down(local_iface.port)) {
-        fprintf(stderr, "Cannot send RouteMod for down port\n");
+    // Flows through a down port can still be removed.
+    if (mod != RMT_DELETE && is_port_down(local_iface.port)) {
+        RFLOG_WARN("Cannot send RouteMod for down port");
         return -1;
     }
 
@@ -609,8 +1654,39 @@ int FlowTable::sendToHw(RouteModType mod, const IPAddress& addr,
      * the port to determine which datapath to send to. */
     rm.add_action(Action(RFAT_OUTPUT, local_iface.port));
 
-    FlowTable::ipc->send(RFCLIENT_RFSERVER_CHANNEL, RFSERVER_ID, rm);
-    return 0;
+    AddressKey prefix(addr, mask.toPrefixLen());
+    return FlowTable::sendRouteMod(rm, &prefix);
+}
+
+/**
+ * Send a route forwarding via the given next hops, one for each of 'paths'.
+ * A multipath route becomes a select group: each next hop is followed by the
+ * weight of its path.
+ */
+int FlowTable::sendToHw(RouteModType mod, const IPAddress& addr,
+                        const IPAddress& mask, const vector<RoutePath>& paths,
+                        const vector<NextHop>& nexthops) {
+    RouteMod rm;
+
+    rm.set_mod(mod);
+    rm.set_id(FlowTable::vm_id);
+
+    /* The next hops supply the Ethernet rewrite for the route. */
+    for (size_t i = 0; i < nexthops.size(); i++) {
+        rm.add_action(Action(RFAT_GROUP, nexthops[i].id));
+        if (nexthops.size() > 1) {
+            rm.add_action(Action(RFAT_WEIGHT, paths[i].weight));
+        }
+    }
+    if (setIP(rm, addr, mask) != 0) {
+        return -1;
+    }
+
+    /* RFServer finds the datapath from the first output port. */
+    rm.add_action(Action(RFAT_OUTPUT, nexthops[0].interface.port));
+
+    AddressKey prefix(addr, mask.toPrefixLen());
+    return FlowTable::sendRouteMod(rm, &prefix);
 }
 
 #ifdef FPM_ENABLED
@@ -628,7 +1704,7 @@ void FlowTable::updateNHLFE(nhlfe_msg_t *nhlfe_msg) {
     } else if (nhlfe_msg->table_operation == REMOVE_LSP) {
         msg.set_mod(RMT_DELETE);
     } else {
-        std::cerr << "Unrecognised NHLFE table operation" << std::endl;
+        RFLOG_ERROR("Unrecognised NHLFE table operation");
         return;
     }
     msg.set_id(FlowTable::vm_id);
@@ -640,24 +1716,25 @@ void FlowTable::updateNHLFE(nhlfe_msg_t *nhlfe_msg) {
 
     // Get our interface for packet egress.
     Interface iface;
-    map<string, HostEntry>::iterator iter;
-    iter = FlowTable::hostTable.find(gwIP.toString());
-    if (iter == FlowTable::hostTable.end()) {
-        std::cerr << "Failed to locate interface for LSP" << std::endl;
-        return;
-    } else {
-        iface = iter->second.interface;
+    {
+        boost::lock_guard<boost::mutex> lock(hostTableMutex);
+        const HostEntry* entry = FlowTable::hostTable.find(AddressKey(gwIP));
+        if (entry == NULL) {
+            RFLOG_ERROR("Failed to locate interface for LSP");
+            return;
+        }
+        iface = entry->interface;
     }
 
     if (is_port_down(iface.port)) {
-        std::cerr << "Cannot send route via inactive interface" << std::endl;
+        RFLOG_ERROR("Cannot send route via inactive interface");
         return;
     }
 
     // Get the MAC address corresponding to our gateway.
-    const MACAddress& gwMAC = findHost(gwIP);
+    MACAddress gwMAC = findHost(gwIP);
     if (gwMAC == FlowTable::MAC_ADDR_NONE) {
-        std::cerr << "Failed to resolve gwMAC IP for NHLFE" << std::endl;
+        RFLOG_ERROR("Failed to resolve gwMAC IP for NHLFE");
         return;
     }
 
@@ -675,13 +1752,13 @@ void FlowTable::updateNHLFE(nhlfe_msg_t *nhlfe_msg) {
     } else if (nhlfe_msg->nhlfe_operation == SWAP) {
         msg.add_action(Action(RFAT_SWAP_MPLS, ntohl(nhlfe_msg->out_label)));
     } else {
-        std::cerr << "Unknown lsp_operation" << std::endl;
+        RFLOG_ERROR("Unknown lsp_operation");
         return;
     }
 
     msg.add_action(Action(RFAT_OUTPUT, iface.port));
 
-    FlowTable::ipc->send(RFCLIENT_RFSERVER_CHANNEL, RFSERVER_ID, msg);
+    FlowTable::sendRouteMod(msg, NULL);
 
     return;
 }
@@ -6,7 +6,9 @@
 #include <stdint.h>
 #include <boost/thread.hpp>
 #include "libnetlink.hh"
-#include "SyncQueue.h"
+#include "NeighbourProber.hh"
+#include "NetlinkEvent.hh"
+#include "NetlinkReader.hh"
 
 #include "fpm.h"
 #include "fpm_lsp.h"
@@ -18,8 +20,22 @@
 #include "defs.h"
 
 #include "Interface.hh"
+#include "InterfaceCache.hh"
 #include "RouteEntry.hh"
+#include "PendingRoute.hh"
+#include "RouteQueue.hh"
+#include "RouteTable.hh"
+#include "AddressMap.hh"
+#include "NextHopTable.hh"
+#include "PendingNeighbour.hh"
 #include "HostEntry.hh"
+#include "PortState.hh"
+#include "PortIndex.hh"
+#include "GatewayIndex.hh"
+#include "RouteModBatcher.hh"
+#include "RouteModWindow.hh"
+#include "RouteShard.hh"
+#include "TimerWheel.hh"
 
 using namespace std;
 
@@ -28,13 +44,30 @@ using namespace std;
 class FlowTable {
     public:
         static void HTPollingCb();
-        static void GWResolverCb();
+        static void GWResolverCb(unsigned shard);
 
         static void clear();
         static void interrupt();
-        static void start(uint64_t vm_id, map<string, Interface> interfaces, IPCMessageService* ipc, vector<uint32_t>* down_ports);
+        static void start(uint64_t vm_id, map<string, Interface> interfaces, IPCMessageService* ipc, PortState* ports);
+        static void init(uint64_t vm_id,
+                         const map<string, Interface>& interfaces,
+                         IPCMessageService* ipc, PortState* ports);
+        static void setResolverThreads(unsigned threads);
+        static void setFlapWindow(unsigned window);
+        static void setNetlinkBuffer(int bytes);
+        static void setQueue(size_t capacity, RingPolicy policy);
+        static void setAckWindow(size_t size);
+        static void syncTables();
+        static int dumpTable(int type, rtnl_filter_t filter, void* arg);
+        static void resyncNeighbours();
         static void print_test();
 
+        static void ackRouteMod(uint64_t seq, RouteModStatus status);
+
+        static int updateLinkOrHostTable(const struct sockaddr_nl*,
+                                         struct nlmsghdr*, void*);
+        static int updateLinkTable(const struct sockaddr_nl*,
+                                   struct nlmsghdr*, void*);
         static int updateHostTable(const struct sockaddr_nl*,
                                    struct nlmsghdr*, void*);
         static int updateRouteTable(struct nlmsghdr *n);
@@ -43,6 +76,9 @@ class FlowTable {
         static void updateNHLFE(nhlfe_msg_t *nhlfe_msg);
 #else
         static void RTPollingCb();
+        static void resyncRoutes();
+        static int resyncRouteTable(const struct sockaddr_nl*,
+                                    struct nlmsghdr*, void*);
         static int updateRouteTable(const struct sockaddr_nl*,
                                     struct nlmsghdr*, void*);
 #endif /* FPM_ENABLED */
@@ -55,37 +91,119 @@ class FlowTable {
         static int lroute;
 
         static const MACAddress MAC_ADDR_NONE;
-        static map<string, Interface> interfaces;
-        static vector<uint32_t>* down_ports;
+        static InterfaceCache interfaces;
+        static PortState* ports;
         static IPCMessageService* ipc;
+
+        /* Progress of the initial sync, which the resolver reports once
+         * pendingRoutes first drains */
+        static boost::system_time syncStart;
+        static size_t syncRoutes;
+        static bool syncing;
         static uint64_t vm_id;
 
-        static boost::thread GWResolver;
+        /* RouteMods waiting to be acknowledged. Once the initial sync is
+         * done, the time taken to install it is reported when every RouteMod
+         * sent has been. */
+        static RouteModWindow routeMods;
+        static bool installing;
+
+        /* Route updates are resolved by 'resolverThreads' threads, each
+         * with its own queue in pendingRoutes and its own shard of the
+         * route state in shards. */
+        static boost::thread_group resolvers;
+        static unsigned resolverThreads;
         static boost::thread HTPolling;
-        static struct rtnl_handle rthNeigh;
+        static NetlinkReader neighReader;
+        static int netlinkBuffer;
 
 #ifdef FPM_ENABLED
         static boost::thread FPMClient;
 #else
         static boost::thread RTPolling;
-        static struct rtnl_handle rth;
+        static NetlinkReader routeReader;
 #endif /* FPM_ENABLED */
 
-        static SyncQueue< std::pair<RouteModType,RouteEntry> > pendingRoutes;
-        static list<RouteEntry> routeTable;
-        static map<string, HostEntry> hostTable;
-        static map<string, int> pendingNeighbours;
-
+        /* Each queue holds up to 'queueCapacity' updates in each priority
+         * class, and 'queuePolicy' decides what happens to updates beyond
+         * that. */
+        static vector<RouteQueue*> pendingRoutes;
+        static size_t queueCapacity;
+        static RingPolicy queuePolicy;
+        static long queuedRoutes;
+
+        /* Updates are held for 'flapWindow' ms before being resolved, and
+         * those superseded within the window are counted as suppressed. */
+        static unsigned flapWindow;
+        static long suppressedRoutes;
+        static vector<RouteShard*> shards;
+
+        /* Hosts, indexed by the ports they use so they can follow port state
+         * changes. Each shard has a copy of their MAC addresses. */
+        static AddressMap<HostEntry> hostTable;
+        static PortIndex<HostEntry> portHosts;
+
+        /* Timers for probing gateways again, for retrying routes that
+         * failed to install and for RouteMods awaiting acknowledgement */
+        static TimerWheel timers;
+        static boost::thread TimerPolling;
+
+        /* Gateways being resolved */
+        static NeighbourProber prober;
+        static boost::thread NDProbing;
+        static AddressMap<PendingNeighbour> pendingNeighbours;
+        static unsigned neighbourSerial;
+
+        static RouteShard& shardFor(const AddressKey& prefix);
         static bool is_port_down(uint32_t port);
-        static int getInterface(const char *intf, const char *type,
-                                Interface& iface);
+        static bool is_route_dead(RouteShard& shard, const RouteEntry& re);
+        static void updatePortState(uint32_t port, bool down);
+        static void removeHost(const HostEntry& he);
+        static void refreshRoutes(const vector<RouteEntry>& routes,
+                                  bool failed);
+        static const Interface* getInterface(int ifindex, const char *type);
 
-        static int initiateND(const char *hostAddr);
         static int resolveGateway(const IPAddress&, const Interface&);
-        static const MACAddress& findHost(const IPAddress& host);
+        static void retryNeighbour(const IPAddress& gateway, unsigned serial);
+        static void queueRoute(const PendingRoute& pr, bool wait = false);
+        static void retryRoute(const PendingRoute& pr);
+        static unsigned retryDelay(unsigned retries);
+        static void finishRoutes(long count);
+        static void resolveRoute(const PendingRoute& pr);
+        static bool resolveRoute(RouteShard& shard, const RouteEntry& re,
+                                 RouteEntry& installed);
+        static bool parkRoute(RouteShard& shard, const RouteEntry& re,
+                              const IPAddress& gateway);
+        static bool unparkRoute(RouteShard& shard, const RouteEntry& re);
+        static void shareHost(const AddressKey& host,
+                              const MACAddress& hwaddress);
+        static void unshareHost(const AddressKey& host);
+        static MACAddress findHost(const IPAddress& host);
+        static MACAddress findHost(RouteShard& shard, const IPAddress& host);
+
+        static NextHop acquireNextHop(RouteShard& shard, const RoutePath& path,
+                                      const MACAddress& hwaddress);
+        static void releaseNextHops(RouteShard& shard,
+                                    const vector<RoutePath>& paths);
+        static void releaseNextHops(RouteShard& shard, const RouteEntry& re);
+        static void updateNextHops(const HostEntry& he);
+        static int sendNextHop(RouteShard& shard, RouteModType,
+                               const NextHop& nh);
+
+        static void flushRouteMods();
+        static int sendRouteMod(const RouteMod& rm, const AddressKey* prefix);
+        static void sendRouteMod(SentRouteMod& sent);
+        static void ackTimeout(uint64_t seq);
+        static void retryRouteMod(const SentRouteMod& sent,
+                                  const char* reason);
+        static void resendRouteMod(const SentRouteMod& sent);
 
         static int setEthernet(RouteMod& rm, const Interface& local_iface,
                                const MACAddress& gateway);
+        static int sendToHw(RouteModType, const IPAddress& addr,
+                            const IPAddress& mask,
+                            const vector<RoutePath>& paths,
+                            const vector<NextHop>& nexthops);
         static int setIP(RouteMod& rm, const IPAddress& addr,
                          const IPAddress& mask);
         static int sendToHw(RouteModType, const RouteEntry&);
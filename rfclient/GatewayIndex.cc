@@ -0,0 +1,79 @@
+#include "GatewayIndex.hh"
+
+void GatewayIndex::set(const AddressKey& key,
+                       const std::vector<AddressKey>& gateways) {
+    this->remove(key);
+
+    std::vector<Use>& uses = this->routes[key];
+    std::vector<AddressKey>::const_iterator gateway;
+    for (gateway = gateways.begin(); gateway != gateways.end(); gateway++) {
+        // Paths may share a gateway through different interfaces.
+        bool listed = false;
+        for (size_t i = 0; i < uses.size(); i++) {
+            if (uses[i].gateway == *gateway) {
+                listed = true;
+                break;
+            }
+        }
+        if (listed) {
+            continue;
+        }
+
+        std::vector<AddressKey>& keys = this->gateways[*gateway];
+        Use use;
+        use.gateway = *gateway;
+        use.position = keys.size();
+        keys.push_back(key);
+        uses.push_back(use);
+    }
+}
+
+bool GatewayIndex::remove(const AddressKey& key) {
+    std::vector<Use>* uses = this->routes.find(key);
+    if (uses == NULL) {
+        return false;
+    }
+
+    std::vector<Use>::iterator use;
+    for (use = uses->begin(); use != uses->end(); use++) {
+        std::vector<AddressKey>* keys = this->gateways.find(use->gateway);
+
+        // Move the gateway's last route into the removed route's place.
+        const AddressKey last = keys->back();
+        keys->pop_back();
+        if (use->position < keys->size()) {
+            (*keys)[use->position] = last;
+            std::vector<Use>* moved = this->routes.find(last);
+            for (size_t i = 0; i < moved->size(); i++) {
+                if ((*moved)[i].gateway == use->gateway) {
+                    (*moved)[i].position = use->position;
+                    break;
+                }
+            }
+        }
+
+        if (keys->empty()) {
+            this->gateways.erase(use->gateway);
+        }
+    }
+
+    this->routes.erase(key);
+    return true;
+}
+
+std::vector<AddressKey> GatewayIndex::get(const AddressKey& gateway) const {
+    const std::vector<AddressKey>* keys = this->gateways.find(gateway);
+    if (keys == NULL) {
+        return std::vector<AddressKey>();
+    }
+    return *keys;
+}
+
+size_t GatewayIndex::size() const {
+    return this->routes.size();
+}
+
+void GatewayIndex::clear() {
+    this->routes.clear();
+    this->gateways.clear();
+}
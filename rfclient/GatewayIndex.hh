@@ -0,0 +1,45 @@
+#ifndef GATEWAYINDEX_HH
+#define GATEWAYINDEX_HH
+
+#include <vector>
+
+#include "AddressMap.hh"
+
+/**
+ * Index of the routes that use each gateway, so that the routes affected by
+ * a lost neighbour can be found without searching every route.
+ *
+ * Routes are identified by their prefix, and each may use several gateways.
+ * Setting a route again replaces the gateways it uses. Every operation takes
+ * time proportional to the number of gateways of the route, or to the number
+ * of routes returned. GatewayIndex does no locking of its own.
+ */
+class GatewayIndex {
+    public:
+        GatewayIndex() {}
+
+        void set(const AddressKey& key,
+                 const std::vector<AddressKey>& gateways);
+
+        /* Returns true if a route was removed */
+        bool remove(const AddressKey& key);
+
+        /* Keys of every route that uses 'gateway' */
+        std::vector<AddressKey> get(const AddressKey& gateway) const;
+
+        size_t size() const;
+        void clear();
+
+    private:
+        /* A gateway used by a route, and where the route is listed in the
+         * gateway's routes */
+        struct Use {
+            AddressKey gateway;
+            size_t position;
+        };
+
+        AddressMap< std::vector<Use> > routes;
+        AddressMap< std::vector<AddressKey> > gateways;
+};
+
+#endif /* GATEWAYINDEX_HH */
@@ -8,12 +8,14 @@ class Interface {
     public:
         uint32_t port;
         string name;
+        int ifindex;  /* Kernel interface index, or 0 if not yet known */
         IPAddress address;
         IPAddress netmask;
         MACAddress hwaddress;
         bool active;
 
         Interface() {
+            this->ifindex = 0;
             this->active = false;
         }
 
@@ -21,6 +23,7 @@ class Interface {
             if (this != &other) {
                 this->port = other.port;
                 this->name = other.name;
+                this->ifindex = other.ifindex;
                 this->address = other.address;
                 this->netmask = other.netmask;
                 this->hwaddress = other.hwaddress;
@@ -33,6 +36,7 @@ class Interface {
             return
                 (this->port == other.port) and
                 (this->name == other.name) and
+                (this->ifindex == other.ifindex) and
                 (this->address == other.address) and
                 (this->netmask == other.netmask) and
                 (this->hwaddress == other.hwaddress) and
@@ -0,0 +1,58 @@
+#include <string.h>
+
+#include "InterfaceCache.hh"
+
+InterfaceCache::InterfaceCache() {
+    memset(this->slots, 0, sizeof(this->slots));
+}
+
+InterfaceCache::~InterfaceCache() {
+    std::list<Interface*>::iterator it;
+    for (it = this->records.begin(); it != this->records.end(); it++) {
+        delete *it;
+    }
+}
+
+void InterfaceCache::setManaged(
+        const std::map<std::string, Interface>& managed) {
+    this->managed = managed;
+}
+
+const Interface* InterfaceCache::update(int ifindex, const char* name) {
+    std::map<std::string, Interface>::const_iterator it;
+    it = this->managed.find(name);
+    if (it == this->managed.end()) {
+        this->publish(ifindex, NULL);
+        return NULL;
+    }
+
+    // Keep the current record if the link is unchanged.
+    const Interface* current = this->find(ifindex);
+    if (current != NULL && current->name == it->second.name) {
+        return current;
+    }
+
+    Interface* iface = new Interface(it->second);
+    iface->ifindex = ifindex;
+    this->records.push_back(iface);
+    this->publish(ifindex, iface);
+    return iface;
+}
+
+void InterfaceCache::remove(int ifindex) {
+    this->publish(ifindex, NULL);
+}
+
+const Interface* InterfaceCache::find(int ifindex) const {
+    if (ifindex <= 0 || ifindex >= INTERFACE_CACHE_SIZE) {
+        return NULL;
+    }
+    return __atomic_load_n(&this->slots[ifindex], __ATOMIC_ACQUIRE);
+}
+
+void InterfaceCache::publish(int ifindex, const Interface* iface) {
+    if (ifindex <= 0 || ifindex >= INTERFACE_CACHE_SIZE) {
+        return;
+    }
+    __atomic_store_n(&this->slots[ifindex], iface, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,52 @@
+#ifndef INTERFACECACHE_HH
+#define INTERFACECACHE_HH
+
+#include <map>
+#include <list>
+#include <string>
+
+#include "Interface.hh"
+
+// Interfaces with an index at or above this are treated as unmanaged
+#define INTERFACE_CACHE_SIZE 4096
+
+/**
+ * The managed interfaces, indexed by kernel interface index (ifindex).
+ *
+ * Lookups are a single atomic load from a flat array, and return a pointer to
+ * the current record, so readers need no syscall, copy or lock. Records are
+ * replaced rather than modified, and replaced records are kept until the
+ * cache is destroyed, so a pointer stays valid even if the link changes after
+ * it was looked up.
+ *
+ * Updates come from link messages, and must all be made from one thread.
+ */
+class InterfaceCache {
+    public:
+        InterfaceCache();
+        ~InterfaceCache();
+
+        /* Set the interfaces to manage, by name */
+        void setManaged(const std::map<std::string, Interface>& managed);
+
+        /* Record that 'ifindex' is now called 'name'. Returns the managed
+         * interface it now refers to, or NULL if it isn't managed. */
+        const Interface* update(int ifindex, const char* name);
+
+        /* Record that 'ifindex' no longer exists */
+        void remove(int ifindex);
+
+        const Interface* find(int ifindex) const;
+
+    private:
+        const Interface* slots[INTERFACE_CACHE_SIZE];
+        std::map<std::string, Interface> managed;
+        std::list<Interface*> records;
+
+        void publish(int ifindex, const Interface* iface);
+
+        InterfaceCache(const InterfaceCache&);
+        InterfaceCache& operator=(const InterfaceCache&);
+};
+
+#endif /* INTERFACECACHE_HH */
@@ -0,0 +1,498 @@
+#ifndef MPSCRING_HH
+#define MPSCRING_HH
+
+#include <stdint.h>
+
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "AddressMap.hh"
+
+// Default number of items a ring holds
+#define MPSC_RING_CAPACITY 16384
+
+/* What push() does when the ring is full */
+enum RingPolicy {
+    RING_BLOCK,        /* Wait for the consumer to make room */
+    RING_DROP_OLDEST,  /* Drop the oldest item to make room */
+    RING_COALESCE      /* Hold items aside, keeping only the latest per key */
+};
+
+/* Counters of a ring, since it was created */
+struct RingStats {
+    size_t capacity;
+    size_t highWater;  /* The most items ever queued at once, including
+                        * those held aside (RING_COALESCE) */
+    uint64_t pushed;
+    uint64_t dropped;   /* Dropped to make room (RING_DROP_OLDEST) */
+    uint64_t coalesced; /* Absorbed by a later item (RING_COALESCE) */
+    uint64_t blocked;   /* Pushes that had to wait (RING_BLOCK) */
+};
+
+/**
+ * Wakes a consumer sleeping until one of the rings it takes items from has
+ * some. Rings share one when a consumer takes from several of them.
+ */
+class RingSignal {
+    public:
+        RingSignal() : waiting(0) {}
+
+        /* Wake the consumer if it is asleep. Called after pushing. */
+        void notify() {
+            __sync_synchronize();
+            if (__atomic_load_n(&this->waiting, __ATOMIC_SEQ_CST)) {
+                boost::lock_guard<boost::mutex> lock(this->mutex);
+                this->cond.notify_one();
+            }
+        }
+
+        /* Sleep until notified or until 'deadline', unless 'ready' returns
+         * true once the consumer is marked as waiting. The flag is set
+         * before checking and checked by notify() after pushing, so either
+         * the consumer sees the item or the producer sees the flag. Returns
+         * false if the deadline passed. */
+        template<typename Ready>
+        bool wait(Ready ready, const boost::system_time& deadline =
+                      boost::posix_time::pos_infin) {
+            boost::unique_lock<boost::mutex> lock(this->mutex);
+            __atomic_store_n(&this->waiting, 1, __ATOMIC_SEQ_CST);
+            bool woken = true;
+            if (!ready()) {
+                if (deadline.is_pos_infinity()) {
+                    this->cond.wait(lock);
+                } else {
+                    woken = this->cond.timed_wait(lock, deadline);
+                }
+            }
+            __atomic_store_n(&this->waiting, 0, __ATOMIC_SEQ_CST);
+            return woken;
+        }
+
+    private:
+        boost::mutex mutex;
+        boost::condition_variable cond;
+        int waiting;
+
+        RingSignal(const RingSignal&);
+        RingSignal& operator=(const RingSignal&);
+};
+
+/**
+ * Bounded queue with many producers and a single consumer, over a ring of
+ * preallocated cells, so queueing an item copies it but never allocates a
+ * node for it.
+ *
+ * Producers claim cells with a compare-and-swap on the enqueue position, and
+ * each cell has a sequence number saying whether it is ready to be written or
+ * read, so pushing and popping take no lock. Locks are only taken to sleep,
+ * by a consumer waiting for items or a producer waiting for room, and by a
+ * producer waking one of them.
+ *
+ * When the ring is full, the policy decides what push() does. RING_COALESCE
+ * and RING_BLOCK need T to provide 'AddressKey key() const' and
+ * 'void supersede(const T&)', which absorbs a later item with the same key,
+ * as RING_BLOCK coalesces for pushes that must not wait. Once the ring fills
+ * up, items are held in an overflow with one item per key until the consumer
+ * has emptied the ring, and are then popped before anything queued after
+ * them, so the items for a key still come out in the order they were pushed.
+ *
+ * The overflow holds at most as many items as the ring, so no more than
+ * twice its capacity is ever queued. Once the overflow is full, an item for a
+ * new key waits until the consumer has taken the overflow, as with
+ * RING_BLOCK, or if the push must not wait, takes the place of the oldest
+ * item held aside, which is dropped.
+ */
+template<typename T>
+class MPSCRing {
+    public:
+        /* The consumer is woken through 'signal' if one is given, so that
+         * it can wait on several rings at once. */
+        MPSCRing(size_t capacity = MPSC_RING_CAPACITY,
+                 RingPolicy policy = RING_BLOCK, RingSignal* signal = NULL)
+                : policy(policy), overflowing(0), inflight(0),
+                  overflowOldest(0), overflowNext(0), producersWaiting(0) {
+            this->signal = (signal != NULL) ? signal : &this->ownSignal;
+            size_t size = 2;
+            while (size < capacity) {
+                size *= 2;
+            }
+            this->cells = std::vector<Cell>(size);
+            for (size_t i = 0; i < size; i++) {
+                this->cells[i].seq = i;
+            }
+            this->mask = size - 1;
+            this->enqueuePos = 0;
+            this->dequeuePos = 0;
+
+            this->counters.capacity = size;
+            this->counters.highWater = 0;
+            this->counters.pushed = 0;
+            this->counters.dropped = 0;
+            this->counters.coalesced = 0;
+            this->counters.blocked = 0;
+        }
+
+        /* Queue 't'. Returns the number of queued items it displaced, by
+         * dropping or absorbing them, so that the caller can account for
+         * them, and adds the number it dropped to 'dropped' if given. If
+         * 'wait' is false, a full RING_BLOCK ring holds 't' aside as
+         * RING_COALESCE does, rather than waiting for room, and so does
+         * every push until the consumer has taken what was held aside. */
+        size_t push(const T& t, bool wait = true, size_t* dropped = NULL) {
+            __sync_add_and_fetch(&this->counters.pushed, 1);
+            size_t displaced = 0;
+            size_t lost = 0;
+            bool waited = false;
+
+            while (true) {
+                if (this->policy != RING_DROP_OLDEST) {
+                    // A producer that sees no overflow finishes its push
+                    // before one can start (see startOverflow()).
+                    __sync_add_and_fetch(&this->inflight, 1);
+                    if (__atomic_load_n(&this->overflowing,
+                                        __ATOMIC_SEQ_CST)) {
+                        __sync_sub_and_fetch(&this->inflight, 1);
+                        bool full = false;
+                        if (this->pushOverflow(t, wait, displaced, lost,
+                                               full)) {
+                            break;
+                        }
+                        if (full) {
+                            if (!waited) {
+                                __sync_add_and_fetch(&this->counters.blocked,
+                                                     1);
+                                waited = true;
+                            }
+                            this->waitForRoom(true);
+                        }
+                        continue;
+                    }
+                    bool pushed = this->tryPush(t);
+                    __sync_sub_and_fetch(&this->inflight, 1);
+                    if (pushed) {
+                        break;
+                    }
+                    if (this->policy == RING_COALESCE || !wait) {
+                        this->startOverflow();
+                        continue;
+                    }
+
+                    if (!waited) {
+                        __sync_add_and_fetch(&this->counters.blocked, 1);
+                        waited = true;
+                    }
+                    this->waitForRoom();
+                    continue;
+                }
+
+                if (this->tryPush(t)) {
+                    break;
+                }
+                T oldest;
+                if (this->tryPop(oldest)) {
+                    __sync_add_and_fetch(&this->counters.dropped, 1);
+                    displaced++;
+                    lost++;
+                }
+            }
+
+            this->signal->notify();
+            if (dropped != NULL) {
+                *dropped += lost;
+            }
+            return displaced;
+        }
+
+        /* Append up to 'max' items to 'out', without waiting. Returns the
+         * number popped. Only the consumer thread may call this. */
+        size_t pop_batch(std::vector<T>& out, size_t max) {
+            size_t count = 0;
+
+            // Items held aside come before anything in the ring now.
+            while (count < max && this->overflowNext < this->drained.size()) {
+                out.push_back(this->drained[this->overflowNext++]);
+                count++;
+            }
+            if (this->overflowNext == this->drained.size() &&
+                    !this->drained.empty()) {
+                this->drained.clear();
+                this->overflowNext = 0;
+            }
+
+            T t;
+            while (count < max && this->tryPop(t)) {
+                out.push_back(t);
+                count++;
+            }
+
+            if (count < max && this->drained.empty() &&
+                    __atomic_load_n(&this->overflowing, __ATOMIC_SEQ_CST) &&
+                    this->takeOverflow()) {
+                while (count < max &&
+                        this->overflowNext < this->drained.size()) {
+                    out.push_back(this->drained[this->overflowNext++]);
+                    count++;
+                }
+            }
+
+            if (count > 0) {
+                this->wakeProducers();
+            }
+            return count;
+        }
+
+        /* As pop_batch(), but waits for at least one item, until 'deadline'
+         * if one is given. Returns 0 if the deadline passed. */
+        size_t wait_pop_batch(std::vector<T>& out, size_t max,
+                              const boost::system_time& deadline =
+                                  boost::posix_time::pos_infin) {
+            while (true) {
+                size_t count = this->pop_batch(out, max);
+                if (count > 0) {
+                    return count;
+                }
+
+                if (!this->signal->wait(!boost::bind(&MPSCRing<T>::empty,
+                                                     this), deadline)) {
+                    return this->pop_batch(out, max);
+                }
+            }
+        }
+
+        /* Whether nothing is queued, as seen by the consumer */
+        bool empty() const {
+            return this->size() == 0 &&
+                this->overflowNext == this->drained.size() &&
+                !__atomic_load_n(&this->overflowing, __ATOMIC_SEQ_CST);
+        }
+
+        /* Number of items in the ring (not counting any held aside) */
+        size_t size() const {
+            size_t head = __atomic_load_n(&this->dequeuePos, __ATOMIC_SEQ_CST);
+            size_t tail = __atomic_load_n(&this->enqueuePos, __ATOMIC_SEQ_CST);
+            return (tail > head) ? tail - head : 0;
+        }
+
+        RingPolicy getPolicy() const {
+            return this->policy;
+        }
+
+        RingStats stats() const {
+            RingStats s;
+            s.capacity = this->counters.capacity;
+            s.highWater = __atomic_load_n(&this->counters.highWater,
+                                          __ATOMIC_RELAXED);
+            s.pushed = __atomic_load_n(&this->counters.pushed,
+                                       __ATOMIC_RELAXED);
+            s.dropped = __atomic_load_n(&this->counters.dropped,
+                                        __ATOMIC_RELAXED);
+            s.coalesced = __atomic_load_n(&this->counters.coalesced,
+                                          __ATOMIC_RELAXED);
+            s.blocked = __atomic_load_n(&this->counters.blocked,
+                                        __ATOMIC_RELAXED);
+            return s;
+        }
+
+    private:
+        struct Cell {
+            size_t seq;
+            T value;
+        };
+
+        std::vector<Cell> cells;
+        size_t mask;
+        RingPolicy policy;
+
+        /* Producers and consumer each update their own position, so keep
+         * them on separate cache lines. */
+        char pad0[64];
+        size_t enqueuePos;
+        char pad1[64];
+        size_t dequeuePos;
+        char pad2[64];
+
+        /* Items held aside while the ring is full, in the order their keys
+         * first arrived, but for those that took the place of one dropped,
+         * starting from 'overflowOldest', and those taken by the consumer
+         * but not popped yet */
+        int overflowing;
+        int inflight;
+        boost::mutex overflowMutex;
+        std::vector<T> overflow;
+        AddressMap<size_t> overflowIndex;
+        size_t overflowOldest;
+        std::vector<T> drained;
+        size_t overflowNext;
+
+        RingSignal ownSignal;
+        RingSignal* signal;
+        boost::mutex waitMutex;
+        boost::condition_variable notFull;
+        int producersWaiting;
+
+        RingStats counters;
+
+        bool tryPush(const T& t) {
+            size_t pos = __atomic_load_n(&this->enqueuePos, __ATOMIC_RELAXED);
+            Cell* cell;
+            while (true) {
+                cell = &this->cells[pos & this->mask];
+                size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+                intptr_t dif = (intptr_t) seq - (intptr_t) pos;
+                if (dif == 0) {
+                    if (__atomic_compare_exchange_n(&this->enqueuePos, &pos,
+                            pos + 1, true, __ATOMIC_RELAXED,
+                            __ATOMIC_RELAXED)) {
+                        break;
+                    }
+                } else if (dif < 0) {
+                    return false;
+                } else {
+                    pos = __atomic_load_n(&this->enqueuePos, __ATOMIC_RELAXED);
+                }
+            }
+
+            // The consumer can't pass this cell until it is published.
+            this->updateHighWater(pos + 1 - __atomic_load_n(&this->dequeuePos,
+                                  __ATOMIC_RELAXED));
+            cell->value = t;
+            __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+
+        /* Producers dropping the oldest item pop too, so popping claims the
+         * cell the same way pushing does. */
+        bool tryPop(T& t) {
+            size_t pos = __atomic_load_n(&this->dequeuePos, __ATOMIC_RELAXED);
+            Cell* cell;
+            while (true) {
+                cell = &this->cells[pos & this->mask];
+                size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+                intptr_t dif = (intptr_t) seq - (intptr_t) (pos + 1);
+                if (dif == 0) {
+                    if (__atomic_compare_exchange_n(&this->dequeuePos, &pos,
+                            pos + 1, true, __ATOMIC_RELAXED,
+                            __ATOMIC_RELAXED)) {
+                        break;
+                    }
+                } else if (dif < 0) {
+                    return false;
+                } else {
+                    pos = __atomic_load_n(&this->dequeuePos, __ATOMIC_RELAXED);
+                }
+            }
+
+            t = cell->value;
+            __atomic_store_n(&cell->seq, pos + this->mask + 1,
+                             __ATOMIC_RELEASE);
+            return true;
+        }
+
+        void updateHighWater(size_t queued) {
+            size_t high = __atomic_load_n(&this->counters.highWater,
+                                          __ATOMIC_RELAXED);
+            while (queued > high &&
+                    !__atomic_compare_exchange_n(&this->counters.highWater,
+                        &high, queued, true, __ATOMIC_RELAXED,
+                        __ATOMIC_RELAXED)) {
+            }
+        }
+
+        /* Send pushes to the overflow from now on, once every push that
+         * may still go into the ring has finished. */
+        void startOverflow() {
+            boost::lock_guard<boost::mutex> lock(this->overflowMutex);
+            __atomic_store_n(&this->overflowing, 1, __ATOMIC_SEQ_CST);
+            while (__atomic_load_n(&this->inflight, __ATOMIC_SEQ_CST) > 0) {
+                boost::this_thread::yield();
+            }
+        }
+
+        /* Returns false if the consumer has taken the overflow since the
+         * caller checked, so the item should go in the ring after all, or
+         * if the overflow is full and the caller may 'wait', in which case
+         * 'full' is set and the caller should wait for the consumer to take
+         * the overflow. An item taking the place of one dropped is counted
+         * in 'dropped'. */
+        bool pushOverflow(const T& t, bool wait, size_t& displaced,
+                          size_t& dropped, bool& full) {
+            boost::lock_guard<boost::mutex> lock(this->overflowMutex);
+            if (!__atomic_load_n(&this->overflowing, __ATOMIC_SEQ_CST)) {
+                return false;
+            }
+
+            AddressKey key = t.key();
+            size_t* index = this->overflowIndex.find(key);
+            if (index != NULL) {
+                this->overflow[*index].supersede(t);
+                __sync_add_and_fetch(&this->counters.coalesced, 1);
+                displaced++;
+            } else if (this->overflow.size() > this->mask) {
+                if (wait) {
+                    full = true;
+                    return false;
+                }
+                // The consumer has taken every item for this key already,
+                // so it can come out ahead of those still held.
+                T& oldest = this->overflow[this->overflowOldest];
+                this->overflowIndex.erase(oldest.key());
+                oldest = t;
+                this->overflowIndex[key] = this->overflowOldest;
+                this->overflowOldest = (this->overflowOldest + 1) %
+                                       this->overflow.size();
+                __sync_add_and_fetch(&this->counters.dropped, 1);
+                displaced++;
+                dropped++;
+            } else {
+                this->overflowIndex[key] = this->overflow.size();
+                this->overflow.push_back(t);
+                this->updateHighWater(this->counters.capacity +
+                                      this->overflow.size());
+            }
+            return true;
+        }
+
+        /* Take the items held aside once the ring is empty, as nothing more
+         * goes into it while they are held, so they are next. Returns false
+         * if pushes started before the overflow are still in the ring. */
+        bool takeOverflow() {
+            boost::lock_guard<boost::mutex> lock(this->overflowMutex);
+            if (this->size() > 0) {
+                return false;
+            }
+            this->drained.swap(this->overflow);
+            this->overflowNext = 0;
+            this->overflowIndex.clear();
+            this->overflowOldest = 0;
+            __atomic_store_n(&this->overflowing, 0, __ATOMIC_SEQ_CST);
+            return true;
+        }
+
+        /* Wait for the consumer to pop, while the ring is full, or while
+         * items are 'held' aside. */
+        void waitForRoom(bool held = false) {
+            boost::unique_lock<boost::mutex> lock(this->waitMutex);
+            __sync_add_and_fetch(&this->producersWaiting, 1);
+            if (held ? __atomic_load_n(&this->overflowing, __ATOMIC_SEQ_CST)
+                     : this->size() > this->mask) {
+                this->notFull.wait(lock);
+            }
+            __sync_sub_and_fetch(&this->producersWaiting, 1);
+        }
+
+        /* As with RingSignal, the waiting count is raised before checking
+         * the ring again under waitMutex, and checked after popping. */
+        void wakeProducers() {
+            __sync_synchronize();
+            if (__atomic_load_n(&this->producersWaiting, __ATOMIC_SEQ_CST)) {
+                boost::lock_guard<boost::mutex> lock(this->waitMutex);
+                this->notFull.notify_all();
+            }
+        }
+
+        MPSCRing(const MPSCRing&);
+        MPSCRing& operator=(const MPSCRing&);
+};
+
+#endif /* MPSCRING_HH */
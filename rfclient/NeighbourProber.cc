@@ -0,0 +1,188 @@
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "log/Log.h"
+#include "NeighbourProber.hh"
+
+/* Space taken by one probe request */
+#define PROBE_LEN NLMSG_ALIGN(NLMSG_LENGTH(sizeof(struct ndmsg)) + \
+                              RTA_LENGTH(16))
+
+NeighbourProber::NeighbourProber() : buffer(NEIGHBOUR_PROBER_BUFSIZE) {
+    this->fd = -1;
+    this->seq = 0;
+}
+
+NeighbourProber::~NeighbourProber() {
+    this->close();
+}
+
+int NeighbourProber::open() {
+    this->fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+    if (this->fd < 0) {
+        RFLOG_ERROR("Cannot open neighbour probe socket: %s",
+                    strerror(errno));
+        return -1;
+    }
+
+    struct sockaddr_nl local;
+    memset(&local, 0, sizeof(local));
+    local.nl_family = AF_NETLINK;
+    if (bind(this->fd, (struct sockaddr *) &local, sizeof(local)) < 0) {
+        RFLOG_ERROR("Cannot bind neighbour probe socket: %s",
+                    strerror(errno));
+        this->close();
+        return -1;
+    }
+
+    this->seq = time(NULL);
+    return 0;
+}
+
+void NeighbourProber::close() {
+    if (this->fd >= 0) {
+        ::close(this->fd);
+        this->fd = -1;
+    }
+}
+
+void NeighbourProber::probe(const IPAddress& addr, int ifindex) {
+    if (this->fd < 0) {
+        return;
+    }
+
+    Probe p;
+    p.ifindex = ifindex;
+    p.version = addr.getVersion();
+    memset(p.addr, 0, sizeof(p.addr));
+    addr.toArray(p.addr);
+
+    boost::lock_guard<boost::mutex> lock(this->pendingMutex);
+    this->pending.push_back(p);
+    this->queued.notify_one();
+}
+
+void NeighbourProber::run() {
+    std::vector<Probe> probes;
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(this->pendingMutex);
+            while (this->pending.empty()) {
+                this->queued.wait(lock);
+            }
+            probes.swap(this->pending);
+        }
+
+        this->send(probes);
+        probes.clear();
+    }
+}
+
+/**
+ * Send a request for each probe, in as few datagrams as possible. Returns -1
+ * if any datagram could not be sent.
+ */
+int NeighbourProber::send(const std::vector<Probe>& probes) {
+    int ret = 0;
+    size_t len = 0;
+    size_t first = 0;
+    uint32_t firstSeq = this->seq;
+
+    for (size_t i = 0; i < probes.size(); i++) {
+        if (len + PROBE_LEN > this->buffer.size()) {
+            if (this->sendBuffer(len, probes, first, firstSeq) < 0) {
+                ret = -1;
+            }
+            len = 0;
+            first = i;
+            firstSeq = this->seq;
+        }
+
+        const Probe& p = probes[i];
+        int addrlen = (p.version == IPV6) ? 16 : 4;
+
+        struct nlmsghdr* n = (struct nlmsghdr *) &this->buffer[len];
+        memset(n, 0, PROBE_LEN);
+        n->nlmsg_len = NLMSG_LENGTH(sizeof(struct ndmsg));
+        n->nlmsg_type = RTM_NEWNEIGH;
+        n->nlmsg_flags = NLM_F_REQUEST | NLM_F_CREATE;
+        n->nlmsg_seq = this->seq++;
+
+        struct ndmsg* ndm = (struct ndmsg *) NLMSG_DATA(n);
+        ndm->ndm_family = (p.version == IPV6) ? AF_INET6 : AF_INET;
+        ndm->ndm_ifindex = p.ifindex;
+        ndm->ndm_state = NUD_NONE;
+        ndm->ndm_flags = NTF_USE;
+
+        struct rtattr* rta = (struct rtattr *) ((char *) n +
+                                                NLMSG_ALIGN(n->nlmsg_len));
+        rta->rta_type = NDA_DST;
+        rta->rta_len = RTA_LENGTH(addrlen);
+        memcpy(RTA_DATA(rta), p.addr, addrlen);
+        n->nlmsg_len = NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+
+        len += NLMSG_ALIGN(n->nlmsg_len);
+    }
+
+    if (len > 0 && this->sendBuffer(len, probes, first, firstSeq) < 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+int NeighbourProber::sendBuffer(size_t len, const std::vector<Probe>& probes,
+                                size_t first, uint32_t firstSeq) {
+    struct sockaddr_nl kernel;
+    memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+
+    if (sendto(this->fd, &this->buffer[0], len, 0,
+               (struct sockaddr *) &kernel, sizeof(kernel)) < 0) {
+        RFLOG_ERROR("Cannot send neighbour probes: %s", strerror(errno));
+        return -1;
+    }
+
+    // The kernel handles requests as they are sent, so any errors are
+    // already waiting.
+    this->readErrors(probes, first, this->seq - firstSeq, firstSeq);
+    return 0;
+}
+
+/**
+ * Report probes that the kernel rejected. Requests are not acknowledged
+ * unless they fail, so the socket holds only errors.
+ */
+void NeighbourProber::readErrors(const std::vector<Probe>& probes,
+                                 size_t first, size_t count,
+                                 uint32_t firstSeq) {
+    char reply[8192];
+    while (true) {
+        ssize_t len = recv(this->fd, reply, sizeof(reply), MSG_DONTWAIT);
+        if (len <= 0) {
+            return;
+        }
+
+        struct nlmsghdr* n = (struct nlmsghdr *) reply;
+        for (; NLMSG_OK(n, len); n = NLMSG_NEXT(n, len)) {
+            if (n->nlmsg_type != NLMSG_ERROR) {
+                continue;
+            }
+            struct nlmsgerr* err = (struct nlmsgerr *) NLMSG_DATA(n);
+            if (err->error == 0) {
+                continue;
+            }
+
+            uint32_t index = n->nlmsg_seq - firstSeq;
+            if (index >= count) {
+                continue;
+            }
+            const Probe& p = probes[first + index];
+            IPAddress addr(p.version, p.addr);
+            RFLOG_WARN("Cannot probe neighbour %s on interface %d: %s", addr,
+                       p.ifindex, strerror(-err->error));
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef NEIGHBOURPROBER_HH
+#define NEIGHBOURPROBER_HH
+
+#include <stdint.h>
+
+#include <vector>
+#include <boost/thread.hpp>
+
+#include "libnetlink.hh"
+#include "types/IPAddress.h"
+
+// Space for the probes sent in one datagram (in bytes)
+#define NEIGHBOUR_PROBER_BUFSIZE 65536
+// Time to wait for a probed neighbour before probing it again (ms), doubling
+// after each probe, and the number of probes before giving up on it
+#define NEIGHBOUR_PROBE_INTERVAL 1000
+#define NEIGHBOUR_PROBE_ATTEMPTS 6
+
+/**
+ * Asks the kernel to resolve neighbours, over a single netlink socket.
+ *
+ * Each probe is an RTM_NEWNEIGH request with NTF_USE set, which creates the
+ * neighbour entry if needed and starts ARP or neighbour discovery for it,
+ * just as sending a packet to it would. The result arrives as an ordinary
+ * neighbour message.
+ *
+ * Probes may be queued from any thread. run() sends everything queued since
+ * its last send together, packing as many requests into each datagram as
+ * fit, so the cost does not grow with the number of pending neighbours.
+ */
+class NeighbourProber {
+    public:
+        NeighbourProber();
+        ~NeighbourProber();
+
+        /* Open the netlink socket. Returns -1 on error. */
+        int open();
+        void close();
+
+        /* Queue a probe for 'addr' through interface 'ifindex' */
+        void probe(const IPAddress& addr, int ifindex);
+
+        /* Send queued probes until interrupted */
+        void run();
+
+    private:
+        struct Probe {
+            int ifindex;
+            int version;
+            uint8_t addr[16];
+        };
+
+        int fd;
+        uint32_t seq;
+        std::vector<char> buffer;
+
+        boost::mutex pendingMutex;
+        boost::condition_variable queued;
+        std::vector<Probe> pending;
+
+        int send(const std::vector<Probe>& probes);
+        int sendBuffer(size_t len, const std::vector<Probe>& probes,
+                       size_t first, uint32_t firstSeq);
+        void readErrors(const std::vector<Probe>& probes, size_t first,
+                        size_t count, uint32_t firstSeq);
+
+        NeighbourProber(const NeighbourProber&);
+        NeighbourProber& operator=(const NeighbourProber&);
+};
+
+#endif /* NEIGHBOURPROBER_HH */
@@ -0,0 +1,149 @@
+#include <string.h>
+#include <sys/socket.h>
+
+#include "NetlinkEvent.hh"
+
+static int address_length(uint8_t family) {
+    if (family == AF_INET) {
+        return 4;
+    } else if (family == AF_INET6) {
+        return 16;
+    }
+    return -1;
+}
+
+/* Copy an address attribute, which must be exactly 'len' bytes long */
+static int copy_address(const struct rtattr* rta, int len, uint8_t* out) {
+    if ((int) RTA_PAYLOAD(rta) != len) {
+        return -1;
+    }
+    memcpy(out, RTA_DATA(rta), len);
+    return 0;
+}
+
+int parseRouteEvent(const struct nlmsghdr* n, RouteEvent& ev) {
+    if (n->nlmsg_len < NLMSG_LENGTH(sizeof(struct rtmsg))) {
+        return -1;
+    }
+    const struct rtmsg* rtm = (const struct rtmsg *) NLMSG_DATA(n);
+    int addrlen = address_length(rtm->rtm_family);
+    if (addrlen < 0) {
+        return -1;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = n->nlmsg_type;
+    ev.family = rtm->rtm_family;
+    ev.table = rtm->rtm_table;
+    ev.protocol = rtm->rtm_protocol;
+    ev.dst_len = rtm->rtm_dst_len;
+    ev.npaths = 1;
+    ev.paths[0].weight = 1;
+
+    const struct rtattr* rta = RTM_RTA(rtm);
+    int len = RTM_PAYLOAD(n);
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        switch (rta->rta_type) {
+        case RTA_TABLE:
+            // Tables above 255 only appear here.
+            ev.table = *(const uint32_t *) RTA_DATA(rta);
+            break;
+        case RTA_DST:
+            if (copy_address(rta, addrlen, ev.dst) < 0) {
+                return -1;
+            }
+            break;
+        case RTA_GATEWAY:
+            if (ev.multipath) {
+                break;
+            }
+            if (copy_address(rta, addrlen, ev.paths[0].gateway) < 0) {
+                return -1;
+            }
+            ev.paths[0].has_gateway = true;
+            break;
+        case RTA_OIF:
+            if (!ev.multipath) {
+                ev.oif = *(const int *) RTA_DATA(rta);
+                ev.paths[0].ifindex = ev.oif;
+            }
+            break;
+        case RTA_MULTIPATH: {
+            const struct rtnexthop* rtnh =
+                (const struct rtnexthop *) RTA_DATA(rta);
+            int rtnh_len = RTA_PAYLOAD(rta);
+
+            ev.multipath = true;
+            ev.npaths = 0;
+            for (; RTNH_OK(rtnh, rtnh_len) &&
+                    ev.npaths < ROUTE_EVENT_MAX_PATHS;
+                    rtnh_len -= RTNH_ALIGN(rtnh->rtnh_len),
+                    rtnh = RTNH_NEXT(rtnh)) {
+                RouteEventPath& path = ev.paths[ev.npaths++];
+                memset(&path, 0, sizeof(path));
+                path.ifindex = rtnh->rtnh_ifindex;
+                path.weight = rtnh->rtnh_hops + 1;
+
+                int attrlen = rtnh->rtnh_len - sizeof(struct rtnexthop);
+                const struct rtattr* attr = RTNH_DATA(rtnh);
+                for (; RTA_OK(attr, attrlen); attr = RTA_NEXT(attr, attrlen)) {
+                    if (attr->rta_type == RTA_GATEWAY) {
+                        if (copy_address(attr, addrlen, path.gateway) < 0) {
+                            return -1;
+                        }
+                        path.has_gateway = true;
+                        break;
+                    }
+                }
+            }
+            ev.oif = ev.paths[0].ifindex;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    return 0;
+}
+
+int parseNeighEvent(const struct nlmsghdr* n, NeighEvent& ev) {
+    if (n->nlmsg_len < NLMSG_LENGTH(sizeof(struct ndmsg))) {
+        return -1;
+    }
+    const struct ndmsg* ndm = (const struct ndmsg *) NLMSG_DATA(n);
+    int addrlen = address_length(ndm->ndm_family);
+    if (addrlen < 0) {
+        return -1;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = n->nlmsg_type;
+    ev.family = ndm->ndm_family;
+    ev.ifindex = ndm->ndm_ifindex;
+    ev.state = ndm->ndm_state;
+
+    const struct rtattr* rta = NDA_RTA(ndm);
+    int len = NDA_PAYLOAD(n);
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        switch (rta->rta_type) {
+        case NDA_DST:
+            if (copy_address(rta, addrlen, ev.addr) < 0) {
+                return -1;
+            }
+            ev.has_addr = true;
+            break;
+        case NDA_LLADDR:
+            // Only Ethernet addresses are of use to us.
+            if (RTA_PAYLOAD(rta) == IFHWADDRLEN) {
+                memcpy(ev.lladdr, RTA_DATA(rta), IFHWADDRLEN);
+                ev.has_lladdr = true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    return 0;
+}
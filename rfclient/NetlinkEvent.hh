@@ -0,0 +1,74 @@
+#ifndef NETLINKEVENT_HH
+#define NETLINKEVENT_HH
+
+#include <stdio.h>
+#include <stdint.h>
+#include <net/if.h>
+
+#include "libnetlink.hh"
+
+#define NETLINK_EVENT_ADDR_LEN 16
+// Paths of a multipath route beyond this many are ignored
+#define ROUTE_EVENT_MAX_PATHS 16
+
+// Routing protocols missing from older kernel headers
+#ifndef RTPROT_ISIS
+#define RTPROT_ISIS 187
+#endif
+#ifndef RTPROT_OSPF
+#define RTPROT_OSPF 188
+#endif
+#ifndef RTPROT_RIP
+#define RTPROT_RIP 189
+#endif
+
+/*
+ * Netlink route and neighbour messages, decoded into fixed-size structures.
+ * Decoding copies out only the fields FlowTable uses and never allocates, so
+ * messages can be decoded on the stack and dropped cheaply if unwanted.
+ * Addresses are in network byte order, zero-filled beyond their length.
+ */
+
+struct RouteEventPath {
+    int ifindex;
+    uint32_t weight;
+    bool has_gateway;
+    uint8_t gateway[NETLINK_EVENT_ADDR_LEN];
+};
+
+struct RouteEvent {
+    uint16_t type;          /* RTM_NEWROUTE or RTM_DELROUTE */
+    uint8_t family;         /* AF_INET or AF_INET6 */
+    uint32_t table;
+    uint8_t protocol;       /* RTPROT_*, who installed the route */
+    uint8_t dst_len;
+    uint8_t dst[NETLINK_EVENT_ADDR_LEN];
+
+    /* A route has one path, or several if 'multipath' is set, in which case
+     * 'oif' and the gateway of paths[0] come from RTA_MULTIPATH. */
+    int oif;
+    bool multipath;
+    unsigned npaths;
+    RouteEventPath paths[ROUTE_EVENT_MAX_PATHS];
+};
+
+struct NeighEvent {
+    uint16_t type;          /* RTM_NEWNEIGH or RTM_DELNEIGH */
+    uint8_t family;
+    int ifindex;
+    uint16_t state;
+    bool has_addr;
+    uint8_t addr[NETLINK_EVENT_ADDR_LEN];
+    bool has_lladdr;
+    uint8_t lladdr[IFHWADDRLEN];
+};
+
+/* Decode a route message. Returns -1 if it is malformed or not for IPv4 or
+ * IPv6. */
+int parseRouteEvent(const struct nlmsghdr* n, RouteEvent& ev);
+
+/* Decode a neighbour message. Returns -1 if it is malformed or not for IPv4
+ * or IPv6. */
+int parseNeighEvent(const struct nlmsghdr* n, NeighEvent& ev);
+
+#endif /* NETLINKEVENT_HH */
@@ -0,0 +1,169 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "log/Log.h"
+#include "NetlinkReader.hh"
+
+NetlinkReader::NetlinkReader()
+        : buffers(NETLINK_READER_BATCH * NETLINK_READER_MSGSIZE) {
+    this->fd = -1;
+    this->messages = 0;
+    this->datagrams = 0;
+    this->reads = 0;
+    this->overruns = 0;
+}
+
+NetlinkReader::~NetlinkReader() {
+    this->close();
+}
+
+int NetlinkReader::open(const std::string& name, unsigned groups,
+                        int rcvbuf) {
+    this->name = name;
+    this->fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+    if (this->fd < 0) {
+        RFLOG_ERROR("Cannot open netlink socket: %s", strerror(errno));
+        return -1;
+    }
+
+    // SO_RCVBUFFORCE can exceed rmem_max, but needs CAP_NET_ADMIN.
+    if (setsockopt(this->fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf,
+                   sizeof(rcvbuf)) < 0 &&
+            setsockopt(this->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+                       sizeof(rcvbuf)) < 0) {
+        RFLOG_WARN("Cannot set netlink receive buffer: %s", strerror(errno));
+    }
+
+    struct sockaddr_nl local;
+    memset(&local, 0, sizeof(local));
+    local.nl_family = AF_NETLINK;
+    local.nl_groups = groups;
+    if (bind(this->fd, (struct sockaddr *) &local, sizeof(local)) < 0) {
+        RFLOG_ERROR("Cannot bind netlink socket: %s", strerror(errno));
+        this->close();
+        return -1;
+    }
+
+    for (int i = 0; i < NETLINK_READER_BATCH; i++) {
+        this->iovs[i].iov_base = &this->buffers[i * NETLINK_READER_MSGSIZE];
+        this->iovs[i].iov_len = NETLINK_READER_MSGSIZE;
+    }
+
+    this->lastReport = boost::get_system_time();
+    return 0;
+}
+
+void NetlinkReader::close() {
+    if (this->fd >= 0) {
+        ::close(this->fd);
+        this->fd = -1;
+    }
+}
+
+int NetlinkReader::listen(rtnl_filter_t handler,
+                          const NetlinkResyncCallback& resync, void* arg) {
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        // recvmmsg() overwrites the lengths, so reset them for every read.
+        memset(this->msgs, 0, sizeof(this->msgs));
+        for (int i = 0; i < NETLINK_READER_BATCH; i++) {
+            this->msgs[i].msg_hdr.msg_name = &this->addrs[i];
+            this->msgs[i].msg_hdr.msg_namelen = sizeof(this->addrs[i]);
+            this->msgs[i].msg_hdr.msg_iov = &this->iovs[i];
+            this->msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int count = recvmmsg(this->fd, this->msgs, NETLINK_READER_BATCH,
+                             MSG_WAITFORONE, NULL);
+        if (count < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            if (errno == ENOBUFS) {
+                this->overruns++;
+                RFLOG_WARN("%s netlink socket overran, resyncing",
+                           this->name);
+                resync();
+                continue;
+            }
+            RFLOG_ERROR("Netlink receive error: %s", strerror(errno));
+            return -1;
+        }
+
+        this->reads++;
+        bool truncated = false;
+        for (int i = 0; i < count; i++) {
+            struct msghdr* hdr = &this->msgs[i].msg_hdr;
+            if (hdr->msg_flags & MSG_TRUNC) {
+                truncated = true;
+                continue;
+            }
+            if (this->dispatch(hdr, this->msgs[i].msg_len, handler, arg) < 0) {
+                return -1;
+            }
+        }
+
+        if (truncated) {
+            this->overruns++;
+            RFLOG_WARN("%s netlink message truncated, resyncing",
+                       this->name);
+            resync();
+        }
+
+        this->report();
+    }
+}
+
+int NetlinkReader::dispatch(struct msghdr* hdr, size_t len,
+                            rtnl_filter_t handler, void* arg) {
+    struct sockaddr_nl* who = (struct sockaddr_nl *) hdr->msg_name;
+    if (hdr->msg_namelen != sizeof(*who)) {
+        RFLOG_ERROR("Sender address length == %d", hdr->msg_namelen);
+        return -1;
+    }
+    this->datagrams++;
+
+    // Only listen to the kernel.
+    if (who->nl_pid != 0) {
+        return 0;
+    }
+
+    struct nlmsghdr* h = (struct nlmsghdr *) hdr->msg_iov->iov_base;
+    int remaining = len;
+    for (; NLMSG_OK(h, remaining); h = NLMSG_NEXT(h, remaining)) {
+        if (h->nlmsg_type == NLMSG_DONE || h->nlmsg_type == NLMSG_ERROR) {
+            continue;
+        }
+        this->messages++;
+        if (handler(who, h, arg) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Print and reset the counters, once every NETLINK_READER_REPORT seconds.
+ */
+void NetlinkReader::report() {
+    boost::system_time now = boost::get_system_time();
+    boost::posix_time::time_duration elapsed = now - this->lastReport;
+    if (elapsed < boost::posix_time::seconds(NETLINK_READER_REPORT)) {
+        return;
+    }
+
+    double seconds = elapsed.total_milliseconds() / 1000.0;
+    RFLOG_INFO("%s netlink: %g msgs/s, %g datagrams/read, %lu overruns",
+               this->name, this->messages / seconds,
+               (double) this->datagrams / this->reads, this->overruns);
+
+    this->messages = 0;
+    this->datagrams = 0;
+    this->reads = 0;
+    this->overruns = 0;
+    this->lastReport = now;
+}
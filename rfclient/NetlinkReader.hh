@@ -0,0 +1,70 @@
+#ifndef NETLINKREADER_HH
+#define NETLINKREADER_HH
+
+#include <sys/socket.h>
+
+#include <string>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+#include "libnetlink.hh"
+
+// Receive buffer to ask the kernel for (in bytes)
+#define NETLINK_READER_RCVBUF (8 * 1024 * 1024)
+// Datagrams read per recvmmsg() call, and the space for each
+#define NETLINK_READER_BATCH 32
+#define NETLINK_READER_MSGSIZE 32768
+// Seconds between reports of the reader's counters
+#define NETLINK_READER_REPORT 10
+
+typedef boost::function<void ()> NetlinkResyncCallback;
+
+/**
+ * Reads netlink multicast messages in batches, with a large receive buffer.
+ *
+ * If the kernel drops messages because the receive buffer overran, the
+ * resync callback is run, so that the caller can dump the affected tables
+ * again and catch up. Counts of messages, reads and overruns are reported
+ * periodically.
+ */
+class NetlinkReader {
+    public:
+        NetlinkReader();
+        ~NetlinkReader();
+
+        /* Open a socket subscribed to 'groups'. Returns -1 on error. */
+        int open(const std::string& name, unsigned groups,
+                 int rcvbuf = NETLINK_READER_RCVBUF);
+        void close();
+
+        /* Pass every message received to 'handler' until interrupted, or
+         * until an unrecoverable error (returning -1). */
+        int listen(rtnl_filter_t handler, const NetlinkResyncCallback& resync,
+                   void* arg = NULL);
+
+    private:
+        std::string name;
+        int fd;
+
+        std::vector<char> buffers;
+        struct mmsghdr msgs[NETLINK_READER_BATCH];
+        struct iovec iovs[NETLINK_READER_BATCH];
+        struct sockaddr_nl addrs[NETLINK_READER_BATCH];
+
+        /* Counters since the last report */
+        unsigned long messages;
+        unsigned long datagrams;
+        unsigned long reads;
+        unsigned long overruns;
+        boost::system_time lastReport;
+
+        int dispatch(struct msghdr* hdr, size_t len, rtnl_filter_t handler,
+                     void* arg);
+        void report();
+
+        NetlinkReader(const NetlinkReader&);
+        NetlinkReader& operator=(const NetlinkReader&);
+};
+
+#endif /* NETLINKREADER_HH */
@@ -0,0 +1,95 @@
+#include "NextHopTable.hh"
+
+NextHopTable::NextHopTable(uint32_t first_id, uint32_t id_step) {
+    this->next_id = first_id;
+    this->id_step = id_step;
+    this->count = 0;
+}
+
+NextHop NextHopTable::acquire(const Interface& iface,
+                              const IPAddress& gateway,
+                              const MACAddress& hwaddress, bool& created) {
+    std::list<NextHop>& via = this->nexthops[AddressKey(gateway)];
+
+    std::list<NextHop>::iterator it;
+    for (it = via.begin(); it != via.end(); it++) {
+        if (it->interface.name == iface.name) {
+            it->refcount++;
+            created = false;
+            return *it;
+        }
+    }
+
+    NextHop nh;
+    nh.id = this->next_id;
+    this->next_id += this->id_step;
+    nh.interface = iface;
+    nh.gateway = gateway;
+    nh.hwaddress = hwaddress;
+    nh.refcount = 1;
+
+    via.push_back(nh);
+    this->count++;
+    created = true;
+    return nh;
+}
+
+bool NextHopTable::release(const Interface& iface, const IPAddress& gateway,
+                           NextHop& removed) {
+    AddressKey key(gateway);
+    std::list<NextHop>* via = this->nexthops.find(key);
+    if (via == NULL) {
+        return false;
+    }
+
+    std::list<NextHop>::iterator it;
+    for (it = via->begin(); it != via->end(); it++) {
+        if (it->interface.name != iface.name) {
+            continue;
+        }
+
+        if (--it->refcount > 0) {
+            return false;
+        }
+
+        removed = *it;
+        via->erase(it);
+        if (via->empty()) {
+            this->nexthops.erase(key);
+        }
+        this->count--;
+        return true;
+    }
+
+    return false;
+}
+
+std::vector<NextHop> NextHopTable::update(const Interface& iface,
+                                          const IPAddress& gateway,
+                                          const MACAddress& hwaddress) {
+    std::vector<NextHop> changed;
+    std::list<NextHop>* via = this->nexthops.find(AddressKey(gateway));
+    if (via == NULL) {
+        return changed;
+    }
+
+    std::list<NextHop>::iterator it;
+    for (it = via->begin(); it != via->end(); it++) {
+        if (it->interface.name == iface.name &&
+                !(it->hwaddress == hwaddress)) {
+            it->hwaddress = hwaddress;
+            changed.push_back(*it);
+        }
+    }
+
+    return changed;
+}
+
+size_t NextHopTable::size() const {
+    return this->count;
+}
+
+void NextHopTable::clear() {
+    this->nexthops.clear();
+    this->count = 0;
+}
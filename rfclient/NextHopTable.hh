@@ -0,0 +1,67 @@
+#ifndef NEXTHOPTABLE_HH
+#define NEXTHOPTABLE_HH
+
+#include <stdint.h>
+
+#include <list>
+#include <vector>
+
+#include "types/IPAddress.h"
+#include "types/MACAddress.h"
+#include "Interface.hh"
+#include "AddressMap.hh"
+
+/**
+ * A gateway reached through a local interface. Routes refer to next hops by
+ * ID, so a change of gateway MAC only needs to update the next hop.
+ */
+class NextHop {
+    public:
+        uint32_t id;
+        Interface interface;
+        IPAddress gateway;
+        MACAddress hwaddress;
+        unsigned int refcount;
+};
+
+/**
+ * Reference-counted set of the next hops used by installed routes.
+ *
+ * A next hop is created by the first route that uses it, and removed when
+ * the last such route is released. IDs are handed out from 'first_id' in
+ * steps of 'id_step', so that several tables can share one ID space.
+ * NextHopTable does no locking of its own.
+ */
+class NextHopTable {
+    public:
+        NextHopTable(uint32_t first_id = 1, uint32_t id_step = 1);
+
+        /* Take a reference on the next hop for 'gateway' via 'iface',
+         * creating it with 'hwaddress' if needed. 'created' is set if the
+         * next hop is new. */
+        NextHop acquire(const Interface& iface, const IPAddress& gateway,
+                        const MACAddress& hwaddress, bool& created);
+
+        /* Drop a reference on the next hop for 'gateway' via 'iface'. Returns
+         * true if that was the last reference, copying the removed next hop
+         * into 'removed'. */
+        bool release(const Interface& iface, const IPAddress& gateway,
+                     NextHop& removed);
+
+        /* Point every next hop through 'gateway' via 'iface' at 'hwaddress'.
+         * Returns the next hops that changed. */
+        std::vector<NextHop> update(const Interface& iface,
+                                    const IPAddress& gateway,
+                                    const MACAddress& hwaddress);
+
+        size_t size() const;
+        void clear();
+
+    private:
+        AddressMap< std::list<NextHop> > nexthops;
+        uint32_t next_id;
+        uint32_t id_step;
+        size_t count;
+};
+
+#endif /* NEXTHOPTABLE_HH */
@@ -0,0 +1,23 @@
+#ifndef PENDINGNEIGHBOUR_HH
+#define PENDINGNEIGHBOUR_HH
+
+#include "types/IPAddress.h"
+#include "TimerWheel.hh"
+
+/**
+ * A gateway being resolved. 'timer' is due when the gateway should be probed
+ * again, or given up on if it has been probed 'probes' times already. Each
+ * resolution gets its own 'serial', so a timer that fires after the gateway
+ * resolved can't be taken for one of a later resolution.
+ */
+struct PendingNeighbour {
+    IPAddress address;
+    int ifindex;
+    unsigned probes;
+    unsigned serial;
+    TimerId timer;
+
+    PendingNeighbour() : ifindex(0), probes(0), serial(0), timer(0) {}
+};
+
+#endif /* PENDINGNEIGHBOUR_HH */
@@ -0,0 +1,114 @@
+#ifndef PENDINGROUTE_HH
+#define PENDINGROUTE_HH
+
+#include <stdint.h>
+
+#include "defs.h"
+#include "AddressMap.hh"
+#include "RouteEntry.hh"
+
+// Delay before the first retry of a route that failed to install, doubling
+// with each further retry up to the maximum (ms)
+#define ROUTE_RETRY_DELAY 100
+#define ROUTE_RETRY_MAX_DELAY 10000
+
+/* Priority classes of route updates, most urgent first */
+enum RouteClass {
+    ROUTE_CLASS_WITHDRAW,  /* Withdrawals, and routes that lost a path */
+    ROUTE_CLASS_HOST,      /* Host routes */
+    ROUTE_CLASS_IGP,       /* The default route, static and IGP routes */
+    ROUTE_CLASS_BULK,      /* Everything else, such as BGP routes */
+    ROUTE_CLASSES
+};
+
+/* The class of an update, as far as can be told from the route itself */
+inline RouteClass route_class(RouteModType mod, const RouteEntry& re) {
+    if (mod == RMT_DELETE) {
+        return ROUTE_CLASS_WITHDRAW;
+    }
+    int len = re.netmask.toPrefixLen();
+    if (len == (int) re.address.getLength() * 8) {
+        return ROUTE_CLASS_HOST;
+    }
+    if (len == 0) {
+        return ROUTE_CLASS_IGP;
+    }
+    return ROUTE_CLASS_BULK;
+}
+
+inline const char* route_class_name(RouteClass priority) {
+    static const char* names[ROUTE_CLASSES] = {
+        "withdraw", "host", "igp", "bulk"
+    };
+    return names[priority];
+}
+
+/**
+ * A route update waiting for the gateway resolver. Routes that were parked
+ * until their gateway resolved are queued again as replays, and routes through
+ * a port that went down or up are queued again as refreshes. Updates that
+ * failed to install are queued again after a delay, counting their retries.
+ * Updates that absorbed earlier updates to the same prefix are marked as
+ * coalesced.
+ *
+ * Each update has a priority class, and updates new from the kernel are
+ * numbered by their queue, so that one overtaken by a newer update for its
+ * prefix from a more urgent class can be recognised as stale.
+ *
+ * Updates carry the times they were received and queued (see
+ * Metrics::now()), for the pipeline latency metrics.
+ */
+struct PendingRoute {
+    RouteModType mod;
+    RouteEntry entry;
+    bool replay;
+    bool refresh;
+    unsigned retries;
+    bool coalesced;
+    RouteClass priority;
+    uint64_t seq;
+    uint64_t received;  /* When received from the kernel, or 0 (ns) */
+    uint64_t queued;    /* When last queued (ns) */
+
+    PendingRoute()
+        : mod(RMT_ADD), replay(false), refresh(false), retries(0),
+          coalesced(false), priority(ROUTE_CLASS_BULK), seq(0), received(0),
+          queued(0) {}
+    PendingRoute(RouteModType mod, const RouteEntry& entry,
+                 bool replay = false)
+        : mod(mod), entry(entry), replay(replay), refresh(false),
+          retries(0), coalesced(false), priority(route_class(mod, entry)),
+          seq(0), received(0), queued(0) {}
+
+    /* Whether this update repeats one already handled, rather than being
+     * new from the kernel */
+    bool requeued() const {
+        return this->replay || this->refresh || this->retries > 0;
+    }
+
+    /* The prefix this update is for */
+    AddressKey key() const {
+        return AddressKey(this->entry.address,
+                          this->entry.netmask.toPrefixLen());
+    }
+
+    /* Absorb a later update for the same prefix. A replay, refresh or retry
+     * does not supersede a newer update, which replaces the route itself. */
+    void supersede(const PendingRoute& later) {
+        if (later.requeued() && !this->requeued()) {
+            return;
+        }
+        this->mod = later.mod;
+        this->entry = later.entry;
+        this->replay = later.replay;
+        this->refresh = later.refresh;
+        this->retries = later.retries;
+        this->priority = later.priority;
+        this->seq = later.seq;
+        this->received = later.received;
+        this->queued = later.queued;
+        this->coalesced = true;
+    }
+};
+
+#endif /* PENDINGROUTE_HH */
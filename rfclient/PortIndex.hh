@@ -0,0 +1,114 @@
+#ifndef PORTINDEX_HH
+#define PORTINDEX_HH
+
+#include <stdint.h>
+
+#include <list>
+#include <map>
+#include <vector>
+
+#include "AddressMap.hh"
+
+/**
+ * Index of the entries (routes or hosts) that depend on each VM port, so that
+ * everything using a port can be found without searching every table.
+ *
+ * Entries are identified by a key, such as their prefix, and each may depend
+ * on several ports. Setting an entry again replaces it, along with the ports
+ * it depends on. PortIndex does no locking of its own.
+ */
+template<typename T>
+class PortIndex {
+    public:
+        PortIndex() {}
+
+        void set(const AddressKey& key, const std::vector<uint32_t>& ports,
+                 const T& value) {
+            this->remove(key);
+
+            Item& item = this->items[key];
+            item.value = value;
+            std::vector<uint32_t>::const_iterator port;
+            for (port = ports.begin(); port != ports.end(); port++) {
+                Keys& keys = this->ports[*port];
+                if (keys.index.find(key) != NULL) {
+                    continue;
+                }
+                keys.index[key] = keys.order.insert(keys.order.end(), key);
+                item.ports.push_back(*port);
+            }
+        }
+
+        /* Returns true if an entry was removed */
+        bool remove(const AddressKey& key) {
+            Item* item = this->items.find(key);
+            if (item == NULL) {
+                return false;
+            }
+
+            std::vector<uint32_t>::iterator port;
+            for (port = item->ports.begin(); port != item->ports.end();
+                    port++) {
+                typename std::map<uint32_t, Keys>::iterator it;
+                it = this->ports.find(*port);
+                Keys& keys = it->second;
+                keys.order.erase(*keys.index.find(key));
+                keys.index.erase(key);
+                if (keys.order.empty()) {
+                    this->ports.erase(it);
+                }
+            }
+
+            this->items.erase(key);
+            return true;
+        }
+
+        const T* find(const AddressKey& key) const {
+            const Item* item = this->items.find(key);
+            return (item != NULL) ? &item->value : NULL;
+        }
+
+        /* Copies of every entry that depends on 'port' */
+        std::vector<T> get(uint32_t port) const {
+            std::vector<T> values;
+            typename std::map<uint32_t, Keys>::const_iterator it;
+            it = this->ports.find(port);
+            if (it == this->ports.end()) {
+                return values;
+            }
+
+            values.reserve(it->second.order.size());
+            std::list<AddressKey>::const_iterator key;
+            for (key = it->second.order.begin();
+                    key != it->second.order.end(); key++) {
+                values.push_back(this->items.find(*key)->value);
+            }
+            return values;
+        }
+
+        size_t size() const {
+            return this->items.size();
+        }
+
+        void clear() {
+            this->items.clear();
+            this->ports.clear();
+        }
+
+    private:
+        struct Item {
+            T value;
+            std::vector<uint32_t> ports;
+        };
+
+        /* Keys of the entries using a port, in the order they were set */
+        struct Keys {
+            std::list<AddressKey> order;
+            AddressMap<std::list<AddressKey>::iterator> index;
+        };
+
+        AddressMap<Item> items;
+        std::map<uint32_t, Keys> ports;
+};
+
+#endif /* PORTINDEX_HH */
@@ -0,0 +1,51 @@
+#include <string.h>
+
+#include "log/Log.h"
+#include "PortState.hh"
+
+PortState::PortState() {
+    memset(this->bits, 0, sizeof(this->bits));
+}
+
+bool PortState::isDown(uint32_t port) const {
+    if (port >= PORT_STATE_MAX_PORTS) {
+        return false;
+    }
+
+    Word word = __atomic_load_n(&this->bits[port / WORD_BITS],
+                                __ATOMIC_ACQUIRE);
+    return (word >> (port % WORD_BITS)) & 1;
+}
+
+bool PortState::setDown(uint32_t port, bool down) {
+    if (port >= PORT_STATE_MAX_PORTS) {
+        RFLOG_ERROR("Cannot track state of port %u", port);
+        return false;
+    }
+
+    Word mask = (Word) 1 << (port % WORD_BITS);
+    Word old;
+    if (down) {
+        old = __atomic_fetch_or(&this->bits[port / WORD_BITS], mask,
+                                __ATOMIC_ACQ_REL);
+    } else {
+        old = __atomic_fetch_and(&this->bits[port / WORD_BITS], ~mask,
+                                 __ATOMIC_ACQ_REL);
+    }
+
+    if (((old & mask) != 0) == down) {
+        return false;
+    }
+
+    boost::lock_guard<boost::mutex> lock(this->callbackMutex);
+    std::vector<PortStateCallback>::iterator it;
+    for (it = this->callbacks.begin(); it != this->callbacks.end(); it++) {
+        (*it)(port, down);
+    }
+    return true;
+}
+
+void PortState::addCallback(const PortStateCallback& cb) {
+    boost::lock_guard<boost::mutex> lock(this->callbackMutex);
+    this->callbacks.push_back(cb);
+}
@@ -0,0 +1,47 @@
+#ifndef PORTSTATE_HH
+#define PORTSTATE_HH
+
+#include <stdint.h>
+
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+// Ports numbered at or above this are always reported as up
+#define PORT_STATE_MAX_PORTS 4096
+
+typedef boost::function<void (uint32_t port, bool down)> PortStateCallback;
+
+/**
+ * Tracks which VM ports are down, as a bitmap with one bit per port. Ports
+ * start up; RFClient marks the ports it registers as down until RFServer
+ * associates them with a datapath port.
+ *
+ * Checking a port is a single atomic load, so it is wait-free and may be done
+ * from any thread. Ports are marked down or up by the thread processing port
+ * configuration, and every registered callback is run on that thread when a
+ * port actually changes state.
+ */
+class PortState {
+    public:
+        PortState();
+
+        bool isDown(uint32_t port) const;
+
+        /* Mark 'port' as down or up. Returns true if its state changed. */
+        bool setDown(uint32_t port, bool down);
+
+        void addCallback(const PortStateCallback& cb);
+
+    private:
+        typedef unsigned long Word;
+        static const size_t WORD_BITS = sizeof(Word) * 8;
+
+        Word bits[PORT_STATE_MAX_PORTS / (sizeof(Word) * 8)];
+
+        boost::mutex callbackMutex;
+        std::vector<PortStateCallback> callbacks;
+};
+
+#endif /* PORTSTATE_HH */
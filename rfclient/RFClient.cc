@@ -3,15 +3,16 @@
 #include <arpa/inet.h>
 #include <netpacket/packet.h>
 #include <ifaddrs.h>
-#include <syslog.h>
 #include <cstdlib>
 #include <boost/thread.hpp>
 #include <iomanip>
 
 #include "RFClient.hh"
 #include "converter.h"
+#include "log/Log.h"
 #include "defs.h"
 #include "FlowTable.h"
+#include "metrics/Metrics.h"
 
 #define BUFFER_SIZE 23 /* Mapping packet size. */
 
@@ -35,7 +36,7 @@ int get_hwaddr_byname(const char * ifname, uint8_t hwaddr[]) {
     ifr.ifr_name[sizeof(ifr.ifr_name) - 1] = '\0';
 
     if (-1 == ioctl(sock, SIOCGIFHWADDR, &ifr)) {
-        perror("ioctl(SIOCGIFHWADDR) ");
+        RFLOG_ERROR("ioctl(SIOCGIFHWADDR): %s", strerror(errno));
         return -1;
     }
 
@@ -66,7 +67,7 @@ uint64_t get_interface_id(const char *ifname) {
 
 RFClient::RFClient(uint64_t id, const string &address) {
     this->id = id;
-    syslog(LOG_INFO, "Starting RFClient (vm_id=%s)", to_string<uint64_t>(this->id).c_str());
+    RFLOG_NOTICE("Starting RFClient (vm_id=%lu)", this->id);
     ipc = (IPCMessageService*) new MongoIPCMessageService(address, MONGO_DB_NAME, to_string<uint64_t>(this->id));
 
     this->init_ports = 0;
@@ -76,9 +77,12 @@ RFClient::RFClient(uint64_t id, const string &address) {
         Interface i = it->second;
         ifacesMap[i.name] = i;
 
+        // Hold back flows for the port until it is mapped to a datapath.
+        this->ports.setDown(i.port, true);
+
         PortRegister msg(this->id, i.port, i.hwaddress);
         this->ipc->send(RFCLIENT_RFSERVER_CHANNEL, RFSERVER_ID, msg);
-        syslog(LOG_INFO, "Registering client port (vm_port=%d)", i.port);
+        RFLOG_NOTICE("Registering client port (vm_port=%d)", i.port);
     }
 
     this->startFlowTable();
@@ -87,7 +91,7 @@ RFClient::RFClient(uint64_t id, const string &address) {
 }
 
 void RFClient::startFlowTable() {
-    boost::thread t(&FlowTable::start, this->id, this->ifacesMap, this->ipc, &(this->down_ports));
+    boost::thread t(&FlowTable::start, this->id, this->ifacesMap, this->ipc, &(this->ports));
     t.detach();
 }
 
@@ -99,22 +103,21 @@ bool RFClient::process(const string &, const string &, const string &, IPCMessag
         uint32_t operation_id = config->get_operation_id();
 
         if (operation_id == 0) {
-            syslog(LOG_INFO,
-                   "Received port configuration (vm_port=%d)",
-                   vm_port);
-            vector<uint32_t>::iterator it;
-            for (it=down_ports.begin(); it < down_ports.end(); it++)
-                if (*it == vm_port)
-                    down_ports.erase(it);
+            RFLOG_NOTICE("Received port configuration (vm_port=%d)",
+                         vm_port);
+            ports.setDown(vm_port, false);
             send_port_map(vm_port);
         }
         else if (operation_id == 1) {
-            syslog(LOG_INFO,
-                   "Received port reset (vm_port=%d)",
-                   vm_port);
-            down_ports.push_back(vm_port);
+            RFLOG_NOTICE("Received port reset (vm_port=%d)", vm_port);
+            ports.setDown(vm_port, true);
         }
     }
+    else if (type == ROUTE_MOD_ACK) {
+        RouteModAck *ack = dynamic_cast<RouteModAck*>(&msg);
+        FlowTable::ackRouteMod(ack->get_seq(),
+                               (RouteModStatus) ack->get_status());
+    }
     else
         return false;
 
@@ -134,18 +137,18 @@ int RFClient::send_packet(const char ethName[], uint64_t vm_id, uint8_t port) {
     strcpy(req.ifr_name, ethName);
 
     if (ioctl(SockFd, SIOCGIFFLAGS, &req) < 0) {
-        fprintf(stderr, "ERROR! ioctl() call has failed: %s\n", strerror(errno));
+        RFLOG_ERROR("ERROR! ioctl() call has failed: %s", strerror(errno));
         exit(1);
     }
 
     /* If the interface is down we can't send the packet. */
-    printf("FLAG %d\n", req.ifr_flags & IFF_UP);
+    RFLOG_DEBUG("FLAG %d", req.ifr_flags & IFF_UP);
     if (!(req.ifr_flags & IFF_UP))
         return -1;
 
     /* Get the interface index. */
     if (ioctl(SockFd, SIOCGIFINDEX, &req) < 0) {
-        fprintf(stderr, "ERROR! ioctl() call has failed: %s\n", strerror(errno));
+        RFLOG_ERROR("ERROR! ioctl() call has failed: %s", strerror(errno));
         exit(1);
     }
 
@@ -154,7 +157,7 @@ int RFClient::send_packet(const char ethName[], uint64_t vm_id, uint8_t port) {
     int addrLen = sizeof(struct sockaddr_ll);
 
     if (ioctl(SockFd, SIOCGIFHWADDR, &req) < 0) {
-        fprintf(stderr, "ERROR! ioctl() call has failed: %s\n", strerror(errno));
+        RFLOG_ERROR("ERROR! ioctl() call has failed: %s", strerror(errno));
         exit(1);
     }
     int i;
@@ -166,7 +169,7 @@ int RFClient::send_packet(const char ethName[], uint64_t vm_id, uint8_t port) {
     sll.sll_ifindex = ifindex;
 
     if (bind(SockFd, (struct sockaddr *) &sll, addrLen) < 0) {
-        fprintf(stderr, "ERROR! bind() call has failed: %s\n", strerror(errno));
+        RFLOG_ERROR("ERROR! bind() call has failed: %s", strerror(errno));
         exit(1);
     }
 
@@ -201,7 +204,7 @@ int RFClient::set_hwaddr_byname(const char * ifname, uint8_t hwaddr[], int16_t f
     ifr.ifr_ifru.ifru_flags = flags & (~IFF_UP);
 
     if (-1 == ioctl(sock, SIOCSIFFLAGS, &ifr)) {
-        perror("ioctl(SIOCSIFFLAGS) ");
+        RFLOG_ERROR("ioctl(SIOCSIFFLAGS): %s", strerror(errno));
         return -1;
     }
 
@@ -209,14 +212,14 @@ int RFClient::set_hwaddr_byname(const char * ifname, uint8_t hwaddr[], int16_t f
     std::memcpy(ifr.ifr_ifru.ifru_hwaddr.sa_data, hwaddr, IFHWADDRLEN);
 
     if (-1 == ioctl(sock, SIOCSIFHWADDR, &ifr)) {
-        perror("ioctl(SIOCSIFHWADDR) ");
+        RFLOG_ERROR("ioctl(SIOCSIFHWADDR): %s", strerror(errno));
         return -1;
     }
 
     ifr.ifr_ifru.ifru_flags = flags | IFF_UP;
 
     if (-1 == ioctl(sock, SIOCSIFFLAGS, &ifr)) {
-        perror("ioctl(SIOCSIFFLAGS) ");
+        RFLOG_ERROR("ioctl(SIOCSIFFLAGS): %s", strerror(errno));
         return -1;
     }
 
@@ -232,7 +235,7 @@ void RFClient::load_interfaces() {
     int intfNum;
 
     if (getifaddrs(&ifaddr) == -1) {
-        perror("getifaddrs");
+        RFLOG_ERROR("getifaddrs: %s", strerror(errno));
         exit( EXIT_FAILURE);
     }
 
@@ -255,7 +258,7 @@ void RFClient::load_interfaces() {
 	        interface.hwaddress = MACAddress(hwaddress);
 	        interface.active = true;
 
-	        printf("Loaded interface %s\n", interface.name.c_str());
+	        RFLOG_INFO("Loaded interface %s", interface.name);
 
 	        this->interfaces[interface.port] = interface;
 	        intfNum++;
@@ -269,11 +272,10 @@ void RFClient::load_interfaces() {
 void RFClient::send_port_map(uint32_t port) {
     Interface i = this->interfaces[port];
     if (send_packet(i.name.c_str(), this->id, i.port) == -1)
-        syslog(LOG_INFO, "Error sending mapping packet (vm_port=%d)",
-               i.port);
+        RFLOG_NOTICE("Error sending mapping packet (vm_port=%d)", i.port);
     else
-        syslog(LOG_INFO, "Mapping packet was sent to RFVS (vm_port=%d)",
-               i.port);
+        RFLOG_NOTICE("Mapping packet was sent to RFVS (vm_port=%d)",
+                     i.port);
 }
 
 int main(int argc, char* argv[]) {
@@ -282,7 +284,11 @@ int main(int argc, char* argv[]) {
     string id;
     string address = MONGO_ADDRESS;
 
-    while ((c = getopt (argc, argv, "n:i:a:")) != -1)
+    size_t queueCapacity = MPSC_RING_CAPACITY;
+    RingPolicy queuePolicy = RING_COALESCE;
+    string metricsFile;
+
+    while ((c = getopt (argc, argv, "n:i:a:w:f:b:q:p:W:m:")) != -1)
         switch (c) {
             case 'n':
                 fprintf (stderr, "Custom naming not supported yet.");
@@ -305,8 +311,42 @@ int main(int argc, char* argv[]) {
             case 'a':
                 address = optarg;
                 break;
+            case 'w':
+                FlowTable::setResolverThreads(atoi(optarg));
+                break;
+            case 'f':
+                FlowTable::setFlapWindow(atoi(optarg));
+                break;
+            case 'b':
+                FlowTable::setNetlinkBuffer(atoi(optarg));
+                break;
+            case 'q':
+                queueCapacity = strtoul(optarg, NULL, 10);
+                break;
+            case 'p':
+                if (strcmp(optarg, "block") == 0) {
+                    queuePolicy = RING_BLOCK;
+                } else if (strcmp(optarg, "drop-oldest") == 0) {
+                    queuePolicy = RING_DROP_OLDEST;
+                } else if (strcmp(optarg, "coalesce") == 0) {
+                    queuePolicy = RING_COALESCE;
+                } else {
+                    fprintf(stderr, "Queue policy must be block, drop-oldest "
+                                    "or coalesce.\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'W':
+                FlowTable::setAckWindow(strtoul(optarg, NULL, 10));
+                break;
+            case 'm':
+                metricsFile = optarg;
+                break;
             case '?':
-                if (optopt == 'n' || optopt == 'i' || optopt == 'a')
+                if (optopt == 'n' || optopt == 'i' || optopt == 'a' ||
+                    optopt == 'w' || optopt == 'f' || optopt == 'b' ||
+                    optopt == 'q' || optopt == 'p' || optopt == 'W' ||
+                    optopt == 'm')
                     fprintf(stderr, "Option -%c requires an argument.\n", optopt);
                 else if (isprint(optopt))
                     fprintf(stderr, "Unknown option `-%c'.\n", optopt);
@@ -317,8 +357,12 @@ int main(int argc, char* argv[]) {
                 abort();
         }
 
+    FlowTable::setQueue(queueCapacity, queuePolicy);
 
-    openlog("rfclient", LOG_NDELAY | LOG_NOWAIT | LOG_PID, SYSLOGFACILITY);
+    Log::openSyslog("rfclient", SYSLOGFACILITY);
+    if (!metricsFile.empty()) {
+        Metrics::startDump(metricsFile);
+    }
     RFClient s(get_interface_id(DEFAULT_RFCLIENT_INTERFACE), address);
 
     return 0;
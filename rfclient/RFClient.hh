@@ -19,7 +19,7 @@ class RFClient : private RFProtocolFactory, private IPCMessageProcessor {
 
         map<string, Interface> ifacesMap;
         map<int, Interface> interfaces;
-        vector<uint32_t> down_ports;
+        PortState ports;
 
         uint8_t hwaddress[IFHWADDRLEN];
         int init_ports;
@@ -0,0 +1,58 @@
+#include "RouteCoalescer.hh"
+
+RouteCoalescer::RouteCoalescer(unsigned int window) : window(window) {
+}
+
+size_t RouteCoalescer::add(const PendingRoute& pr) {
+    AddressKey key = pr.key();
+    std::list<Held>::iterator* found = this->prefixes.find(key);
+    if (found == NULL) {
+        Held h;
+        h.pr = pr;
+        h.deadline = boost::get_system_time() + this->window;
+        this->prefixes[key] = this->held.insert(this->held.end(), h);
+        return 0;
+    }
+
+    (*found)->pr.supersede(pr);
+    return 1;
+}
+
+bool RouteCoalescer::pop(PendingRoute& pr) {
+    if (this->held.empty() ||
+            this->held.front().deadline > boost::get_system_time()) {
+        return false;
+    }
+
+    pr = this->held.front().pr;
+    this->prefixes.erase(pr.key());
+    this->held.pop_front();
+    return true;
+}
+
+const PendingRoute* RouteCoalescer::find(const AddressKey& key) const {
+    std::list<Held>::iterator const* found = this->prefixes.find(key);
+    return (found != NULL) ? &(*found)->pr : NULL;
+}
+
+bool RouteCoalescer::erase(const AddressKey& key) {
+    std::list<Held>::iterator* found = this->prefixes.find(key);
+    if (found == NULL) {
+        return false;
+    }
+    this->held.erase(*found);
+    this->prefixes.erase(key);
+    return true;
+}
+
+boost::system_time RouteCoalescer::deadline() const {
+    return this->held.front().deadline;
+}
+
+bool RouteCoalescer::empty() const {
+    return this->held.empty();
+}
+
+size_t RouteCoalescer::size() const {
+    return this->prefixes.size();
+}
@@ -0,0 +1,59 @@
+#ifndef ROUTECOALESCER_HH
+#define ROUTECOALESCER_HH
+
+#include <list>
+#include <boost/thread.hpp>
+
+#include "AddressMap.hh"
+#include "PendingRoute.hh"
+
+// Hold route updates for this long (in milliseconds) to absorb flaps
+#define ROUTE_FLAP_WINDOW 10
+
+/**
+ * Holds route updates for a short window, so that an update superseded by a
+ * later one for the same prefix never reaches the switch.
+ *
+ * Each prefix keeps only its latest update, which is released once the first
+ * update for the prefix has waited out the window. Updates are released in
+ * the order their prefixes first arrived (see PendingRoute::supersede()).
+ *
+ * RouteCoalescer does no locking of its own.
+ */
+class RouteCoalescer {
+    public:
+        RouteCoalescer(unsigned int window = ROUTE_FLAP_WINDOW);
+
+        /* Add an update to the window. Returns the number of updates that
+         * were dropped as a result. */
+        size_t add(const PendingRoute& pr);
+
+        /* Take the oldest update whose window has passed, if any */
+        bool pop(PendingRoute& pr);
+
+        /* The update held for the prefix 'key', if any */
+        const PendingRoute* find(const AddressKey& key) const;
+
+        /* Drop the update held for the prefix 'key', if any */
+        bool erase(const AddressKey& key);
+
+        /* Time at which the oldest update is due. Only valid if not empty. */
+        boost::system_time deadline() const;
+
+        bool empty() const;
+
+        /* Number of prefixes with an update held */
+        size_t size() const;
+
+    private:
+        struct Held {
+            PendingRoute pr;
+            boost::system_time deadline;
+        };
+
+        boost::posix_time::milliseconds window;
+        std::list<Held> held;
+        AddressMap<std::list<Held>::iterator> prefixes;
+};
+
+#endif /* ROUTECOALESCER_HH */
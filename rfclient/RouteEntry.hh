@@ -1,9 +1,143 @@
 #ifndef ROUTEENTRY_HH
 #define ROUTEENTRY_HH
 
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
 #include "types/IPAddress.h"
 #include "Interface.hh"
 
+// Multipath routes with up to this many paths keep them inline
+#define ROUTE_INLINE_PATHS 2
+
+/**
+ * One of the equal-cost paths of a multipath route. Traffic is shared between
+ * paths in proportion to their weight.
+ */
+class RoutePath {
+    public:
+        IPAddress gateway;
+        Interface interface;
+        uint32_t weight;
+
+        RoutePath() {
+            this->weight = 1;
+        }
+
+        RoutePath(const IPAddress& gateway, const Interface& interface,
+                  uint32_t weight = 1) {
+            this->gateway = gateway;
+            this->interface = interface;
+            this->weight = weight;
+        }
+
+        bool operator==(const RoutePath& other) const {
+            return (this->gateway == other.gateway) and
+                (this->interface == other.interface) and
+                (this->weight == other.weight);
+        }
+};
+
+/**
+ * The paths of a multipath route, with the parts of the std::vector interface
+ * that routes use. Up to ROUTE_INLINE_PATHS paths are held inline, so that
+ * building, copying and queueing most routes does not allocate; routes with
+ * more paths keep them all on the heap.
+ */
+class RoutePaths {
+    public:
+        typedef RoutePath* iterator;
+        typedef const RoutePath* const_iterator;
+
+        RoutePaths() : heap(NULL), count(0), capacity(ROUTE_INLINE_PATHS) {}
+
+        RoutePaths(const RoutePaths& other)
+            : heap(NULL), count(0), capacity(ROUTE_INLINE_PATHS) {
+            this->assign(other.begin(), other.end());
+        }
+
+        ~RoutePaths() {
+            delete[] this->heap;
+        }
+
+        RoutePaths& operator=(const RoutePaths& other) {
+            if (this != &other) {
+                this->assign(other.begin(), other.end());
+            }
+            return *this;
+        }
+
+        RoutePaths& operator=(const std::vector<RoutePath>& paths) {
+            const RoutePath* first = paths.empty() ? NULL : &paths[0];
+            this->assign(first, first + paths.size());
+            return *this;
+        }
+
+        bool operator==(const RoutePaths& other) const {
+            return (this->count == other.count) and
+                std::equal(this->begin(), this->end(), other.begin());
+        }
+
+        bool empty() const { return this->count == 0; }
+        size_t size() const { return this->count; }
+
+        iterator begin() { return this->data(); }
+        iterator end() { return this->data() + this->count; }
+        const_iterator begin() const { return this->data(); }
+        const_iterator end() const { return this->data() + this->count; }
+
+        RoutePath& operator[](size_t i) { return this->data()[i]; }
+        const RoutePath& operator[](size_t i) const {
+            return this->data()[i];
+        }
+
+        void reserve(size_t n) {
+            if (n <= this->capacity) {
+                return;
+            }
+            RoutePath* grown = new RoutePath[n];
+            std::copy(this->begin(), this->end(), grown);
+            delete[] this->heap;
+            this->heap = grown;
+            this->capacity = n;
+        }
+
+        void push_back(const RoutePath& path) {
+            if (this->count == this->capacity) {
+                this->reserve(this->capacity * 2);
+            }
+            this->data()[this->count++] = path;
+        }
+
+        /* Paths already held stay constructed, to be assigned over */
+        void clear() {
+            this->count = 0;
+        }
+
+    private:
+        RoutePath paths[ROUTE_INLINE_PATHS];
+        RoutePath* heap;
+        size_t count;
+        size_t capacity;
+
+        RoutePath* data() {
+            return (this->heap != NULL) ? this->heap : this->paths;
+        }
+
+        const RoutePath* data() const {
+            return (this->heap != NULL) ? this->heap : this->paths;
+        }
+
+        void assign(const RoutePath* first, const RoutePath* last) {
+            this->count = 0;
+            this->reserve(last - first);
+            std::copy(first, last, this->data());
+            this->count = last - first;
+        }
+};
+
 class RouteEntry {
     public:
         IPAddress address;
@@ -11,11 +145,26 @@ class RouteEntry {
         IPAddress netmask;
         Interface interface;
 
+        /* Every path of a multipath route, empty otherwise. For multipath
+         * routes, gateway and interface hold the first path. */
+        RoutePaths multipath;
+
+        /* The paths of this route, whether or not it is multipath */
+        std::vector<RoutePath> paths() const {
+            if (not this->multipath.empty()) {
+                return std::vector<RoutePath>(this->multipath.begin(),
+                                              this->multipath.end());
+            }
+            return std::vector<RoutePath>(1, RoutePath(this->gateway,
+                                                       this->interface));
+        }
+
         bool operator==(const RouteEntry& other) const {
             return (this->address == other.address) and
                 (this->gateway == other.gateway) and
                 (this->netmask == other.netmask) and
-                (this->interface == other.interface);
+                (this->interface == other.interface) and
+                (this->multipath == other.multipath);
         }
 };
 
@@ -0,0 +1,98 @@
+#include <algorithm>
+
+#include "RouteModBatcher.hh"
+#include "defs.h"
+#include "metrics/Metrics.h"
+
+static Counter batchesSent("rfclient_route_mod_batches_total",
+    "RouteModBatch messages sent to RFServer");
+static Histogram batchWait("rfclient_route_mod_batch_seconds",
+    "Time the oldest RouteMod of each batch waited for it to be sent");
+static Histogram batchSend("rfclient_route_mod_send_seconds",
+    "Time taken to serialise and send each batch over IPC");
+
+RouteModBatcher::RouteModBatcher() : max_delay(ROUTE_MOD_BATCH_DELAY) {
+    this->ipc = NULL;
+    this->vm_id = 0;
+    this->max_size = ROUTE_MOD_BATCH_SIZE;
+    this->started = 0;
+}
+
+void RouteModBatcher::start(IPCMessageService* ipc, uint64_t vm_id,
+                            size_t max_size, unsigned int max_delay) {
+    this->ipc = ipc;
+    this->vm_id = vm_id;
+    this->max_size = max_size;
+    this->max_delay = boost::posix_time::milliseconds(max_delay);
+
+    this->flusher = boost::thread(&RouteModBatcher::FlusherCb, this);
+}
+
+void RouteModBatcher::interrupt() {
+    this->flusher.interrupt();
+}
+
+/**
+ * Queue a RouteMod for sending. If this fills the batch, the batch is sent
+ * before returning.
+ */
+void RouteModBatcher::add(const RouteMod& rm) {
+    bool full;
+    {
+        boost::lock_guard<boost::mutex> lock(batchMutex);
+        if (this->mods.empty()) {
+            this->started = Metrics::now();
+            this->deadline = boost::get_system_time() + this->max_delay;
+            this->batchCond.notify_one();
+        }
+        this->mods.push_back(rm);
+        full = (this->mods.size() >= this->max_size);
+    }
+
+    if (full) {
+        this->flush();
+    }
+}
+
+/**
+ * Send all queued RouteMods to RFServer as a single RouteModBatch.
+ */
+void RouteModBatcher::flush() {
+    // Holding sendMutex while taking the batch keeps batches in order.
+    boost::lock_guard<boost::mutex> sendLock(sendMutex);
+    std::vector<RouteMod> out;
+    uint64_t started;
+    {
+        boost::lock_guard<boost::mutex> lock(batchMutex);
+        out.swap(this->mods);
+        started = this->started;
+    }
+
+    if (out.empty()) {
+        return;
+    }
+
+    uint64_t start = Metrics::now();
+    batchWait.record(start - std::min(start, started));
+    RouteModBatch msg(this->vm_id, out);
+    this->ipc->send(RFCLIENT_RFSERVER_CHANNEL, RFSERVER_ID, msg);
+    batchSend.since(start);
+    batchesSent.add();
+}
+
+void RouteModBatcher::FlusherCb() {
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(batchMutex);
+            while (this->mods.empty()) {
+                this->batchCond.wait(lock);
+            }
+            while (!this->mods.empty() &&
+                    boost::get_system_time() < this->deadline) {
+                this->batchCond.timed_wait(lock, this->deadline);
+            }
+        }
+
+        this->flush();
+    }
+}
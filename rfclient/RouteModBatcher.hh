@@ -0,0 +1,52 @@
+#ifndef ROUTEMODBATCHER_HH
+#define ROUTEMODBATCHER_HH
+
+#include <stdint.h>
+#include <boost/thread.hpp>
+
+#include "ipc/IPC.h"
+#include "ipc/RFProtocol.h"
+
+// Send a batch once it holds this many RouteMods...
+#define ROUTE_MOD_BATCH_SIZE 512
+// ...or once its oldest RouteMod has waited this long (in milliseconds)
+#define ROUTE_MOD_BATCH_DELAY 5
+
+/**
+ * Coalesces RouteMods bound for RFServer into RouteModBatch messages, so that
+ * a full-table load costs one IPC round trip per batch rather than per route.
+ *
+ * RouteMods are sent in the order they were added. A background thread sends
+ * partially filled batches once they reach the delay limit.
+ */
+class RouteModBatcher {
+    public:
+        RouteModBatcher();
+
+        void start(IPCMessageService* ipc, uint64_t vm_id,
+                   size_t max_size = ROUTE_MOD_BATCH_SIZE,
+                   unsigned int max_delay = ROUTE_MOD_BATCH_DELAY);
+        void interrupt();
+
+        void add(const RouteMod& rm);
+        void flush();
+
+    private:
+        IPCMessageService* ipc;
+        uint64_t vm_id;
+        size_t max_size;
+        boost::posix_time::milliseconds max_delay;
+
+        std::vector<RouteMod> mods;
+        boost::system_time deadline;
+        uint64_t started;  /* When the oldest RouteMod was added (ns) */
+
+        boost::mutex batchMutex;
+        boost::mutex sendMutex;
+        boost::condition_variable batchCond;
+        boost::thread flusher;
+
+        void FlusherCb();
+};
+
+#endif /* ROUTEMODBATCHER_HH */
@@ -0,0 +1,119 @@
+#include "RouteModWindow.hh"
+
+RouteModWindow::RouteModWindow() : size(ROUTE_MOD_WINDOW), nextSeq(0) {
+    this->counters.sent = 0;
+    this->counters.acked = 0;
+    this->counters.failed = 0;
+    this->counters.timedOut = 0;
+    this->counters.latencySum = 0;
+    this->counters.latencyMax = 0;
+}
+
+void RouteModWindow::setSize(size_t size) {
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    this->size = size;
+    this->room.notify_all();
+}
+
+size_t RouteModWindow::getSize() const {
+    return this->size;
+}
+
+uint64_t RouteModWindow::open(SentRouteMod& sent, bool wait) {
+    boost::unique_lock<boost::mutex> lock(this->mutex);
+    while (wait && this->size > 0 && this->inFlight.size() >= this->size) {
+        this->room.wait(lock);
+    }
+
+    uint64_t seq = ++this->nextSeq;
+    sent.seq = seq;
+    sent.rm.set_seq(seq);
+    sent.sent = boost::get_system_time();
+    this->inFlight[seq] = sent;
+    if (sent.keyed) {
+        this->latest[sent.prefix] = seq;
+    }
+    this->counters.sent++;
+    return seq;
+}
+
+void RouteModWindow::setTimer(uint64_t seq, TimerId timer) {
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    std::map<uint64_t, SentRouteMod>::iterator it = this->inFlight.find(seq);
+    if (it != this->inFlight.end()) {
+        it->second.timer = timer;
+    }
+}
+
+bool RouteModWindow::close(uint64_t seq, RouteModStatus status,
+                           bool timedOut, SentRouteMod& sent) {
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    std::map<uint64_t, SentRouteMod>::iterator it = this->inFlight.find(seq);
+    if (it == this->inFlight.end()) {
+        return false;
+    }
+    sent = it->second;
+    this->inFlight.erase(it);
+    this->room.notify_one();
+
+    if (timedOut) {
+        this->counters.timedOut++;
+    } else if (status != RMS_SUCCESS) {
+        this->counters.failed++;
+    } else {
+        uint64_t latency = (boost::get_system_time() - sent.sent)
+                           .total_microseconds();
+        this->counters.acked++;
+        this->counters.latencySum += latency;
+        this->counters.latencyMax = std::max(this->counters.latencyMax,
+                                             latency);
+        // Nothing is left to send again for the prefix.
+        uint64_t* last = sent.keyed ? this->latest.find(sent.prefix) : NULL;
+        if (last != NULL && *last == seq) {
+            this->latest.erase(sent.prefix);
+        }
+    }
+    return true;
+}
+
+bool RouteModWindow::isLatest(const SentRouteMod& sent) {
+    if (!sent.keyed) {
+        return true;
+    }
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    uint64_t* last = this->latest.find(sent.prefix);
+    return last != NULL && *last == sent.seq;
+}
+
+void RouteModWindow::forget(const SentRouteMod& sent) {
+    if (!sent.keyed) {
+        return;
+    }
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    uint64_t* last = this->latest.find(sent.prefix);
+    if (last != NULL && *last == sent.seq) {
+        this->latest.erase(sent.prefix);
+    }
+}
+
+size_t RouteModWindow::pending() {
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    return this->inFlight.size();
+}
+
+bool RouteModWindow::full() {
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    return this->size > 0 && this->inFlight.size() >= this->size;
+}
+
+void RouteModWindow::clear() {
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    this->inFlight.clear();
+    this->latest.clear();
+    this->room.notify_all();
+}
+
+RouteModWindowStats RouteModWindow::stats() {
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    return this->counters;
+}
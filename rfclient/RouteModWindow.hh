@@ -0,0 +1,102 @@
+#ifndef ROUTEMODWINDOW_HH
+#define ROUTEMODWINDOW_HH
+
+#include <stdint.h>
+
+#include <map>
+#include <boost/thread.hpp>
+
+#include "ipc/RFProtocol.h"
+#include "defs.h"
+#include "AddressMap.hh"
+#include "TimerWheel.hh"
+
+// RouteMods that may await acknowledgement at once, or 0 to send RouteMods
+// without asking for acknowledgements
+#define ROUTE_MOD_WINDOW 4096
+// Time to wait for a RouteMod to be acknowledged before sending it again (ms)
+#define ROUTE_MOD_ACK_TIMEOUT 5000
+// Times a RouteMod is sent before giving up on it
+#define ROUTE_MOD_ATTEMPTS 5
+
+/* A RouteMod awaiting acknowledgement */
+struct SentRouteMod {
+    RouteMod rm;
+    uint64_t seq;
+    bool keyed;
+    AddressKey prefix;  /* The prefix the RouteMod is for, if keyed */
+    unsigned attempts;  /* Earlier sends that failed */
+    boost::system_time sent;
+    TimerId timer;
+
+    SentRouteMod() : seq(0), keyed(false), attempts(0), timer(0) {}
+};
+
+/* Counters of a window since it was created. Latencies are from sending a
+ * RouteMod to its acknowledgement, for those that succeeded. */
+struct RouteModWindowStats {
+    uint64_t sent;
+    uint64_t acked;
+    uint64_t failed;
+    uint64_t timedOut;
+    uint64_t latencySum;  /* (us) */
+    uint64_t latencyMax;  /* (us) */
+};
+
+/**
+ * The RouteMods sent to RFServer and not yet acknowledged, each numbered in
+ * the order it was sent. RFServer acknowledges a RouteMod by its number once
+ * every datapath flow for it is installed, or reports that it failed.
+ *
+ * The window holds a given number of RouteMods, so senders that wait for
+ * room are paced by how fast the datapaths install flows, while keeping that
+ * many RouteMods in the pipeline. Senders may also go over the limit rather
+ * than wait.
+ *
+ * The latest RouteMod sent for each prefix is tracked, so that one that
+ * failed is only sent again if no later RouteMod for its prefix has been.
+ */
+class RouteModWindow {
+    public:
+        RouteModWindow();
+
+        void setSize(size_t size);
+        size_t getSize() const;
+
+        /* Number the RouteMod in 'sent' and record it as in flight. If
+         * 'wait' is set and the window is full, first wait for room. Returns
+         * the sequence number. */
+        uint64_t open(SentRouteMod& sent, bool wait);
+
+        /* Record the timer for the acknowledgement of 'seq' */
+        void setTimer(uint64_t seq, TimerId timer);
+
+        /* Take 'seq' out of the window once acknowledged with 'status', or
+         * once it 'timedOut', returning it in 'sent'. Returns false if it
+         * isn't in flight. */
+        bool close(uint64_t seq, RouteModStatus status, bool timedOut,
+                   SentRouteMod& sent);
+
+        /* Whether 'sent' is still the latest RouteMod for its prefix */
+        bool isLatest(const SentRouteMod& sent);
+
+        /* Stop tracking the prefix of 'sent', once it is given up on */
+        void forget(const SentRouteMod& sent);
+
+        /* Number of RouteMods in flight */
+        size_t pending();
+        bool full();
+        void clear();
+        RouteModWindowStats stats();
+
+    private:
+        boost::mutex mutex;
+        boost::condition_variable room;
+        size_t size;
+        uint64_t nextSeq;
+        std::map<uint64_t, SentRouteMod> inFlight;
+        AddressMap<uint64_t> latest;
+        RouteModWindowStats counters;
+};
+
+#endif /* ROUTEMODWINDOW_HH */
@@ -0,0 +1,201 @@
+#include <algorithm>
+
+#include "RouteQueue.hh"
+
+RouteQueue::RouteQueue(size_t capacity, RingPolicy policy, unsigned window)
+        : capacity(capacity), nextSeq(0) {
+    for (unsigned c = 0; c < ROUTE_CLASSES; c++) {
+        this->rings[c] = new MPSCRing<PendingRoute>(capacity, policy,
+                                                    &this->signal);
+        this->windows[c] = new RouteCoalescer(window);
+    }
+    this->batch.reserve(ROUTE_QUEUE_BATCH);
+}
+
+RouteQueue::~RouteQueue() {
+    for (unsigned c = 0; c < ROUTE_CLASSES; c++) {
+        delete this->rings[c];
+        delete this->windows[c];
+    }
+}
+
+size_t RouteQueue::push(const PendingRoute& pr, bool wait, size_t* dropped) {
+    if (pr.requeued()) {
+        return this->rings[pr.priority]->push(pr, wait, dropped);
+    }
+
+    PendingRoute numbered(pr);
+    numbered.seq = __sync_add_and_fetch(&this->nextSeq, 1);
+    return this->rings[pr.priority]->push(numbered, wait, dropped);
+}
+
+size_t RouteQueue::take(std::vector<PendingRoute>& out, size_t& dropped) {
+    dropped = 0;
+    while (true) {
+        dropped += this->fill();
+        size_t count = this->drain(out, dropped);
+        if (count > 0 || dropped > 0) {
+            return count;
+        }
+
+        boost::system_time deadline = boost::posix_time::pos_infin;
+        for (unsigned c = 0; c < ROUTE_CLASSES; c++) {
+            if (!this->windows[c]->empty()) {
+                deadline = std::min(deadline, this->windows[c]->deadline());
+            }
+        }
+        // Rings whose windows are full wait for updates to come due.
+        this->signal.wait(boost::bind(&RouteQueue::fillable, this),
+                          deadline);
+    }
+}
+
+/**
+ * Move queued updates into the windows of their classes, as long as there is
+ * room, so that producers still find a full ring once the resolver falls
+ * behind. Returns the number of updates absorbed by ones already held.
+ */
+size_t RouteQueue::fill() {
+    size_t dropped = 0;
+    for (unsigned c = 0; c < ROUTE_CLASSES; c++) {
+        size_t held = this->windows[c]->size();
+        while (held < this->capacity) {
+            this->batch.clear();
+            size_t max = std::min(this->capacity - held,
+                                  (size_t) ROUTE_QUEUE_BATCH);
+            if (this->rings[c]->pop_batch(this->batch, max) == 0) {
+                break;
+            }
+            std::vector<PendingRoute>::iterator it;
+            for (it = this->batch.begin(); it != this->batch.end(); it++) {
+                dropped += this->windows[c]->add(*it);
+            }
+            held = this->windows[c]->size();
+        }
+    }
+    return dropped;
+}
+
+/**
+ * Take the due updates of each class up to its weight, then fill what is
+ * left of the batch from the most urgent classes first.
+ */
+size_t RouteQueue::drain(std::vector<PendingRoute>& out, size_t& dropped) {
+    static const size_t weights[ROUTE_CLASSES] = ROUTE_CLASS_WEIGHTS;
+
+    // Classes with updates left in their rings, as their windows are full.
+    // Updates queued from now on are newer than any taken now.
+    unsigned backlog = 0;
+    for (unsigned c = 0; c < ROUTE_CLASSES; c++) {
+        if (!this->rings[c]->empty()) {
+            backlog |= 1 << c;
+        }
+    }
+
+    size_t count = 0;
+    for (unsigned pass = 0; pass < 2; pass++) {
+        for (unsigned c = 0; c < ROUTE_CLASSES; c++) {
+            size_t quota = (pass == 0) ? weights[c] : ROUTE_QUEUE_BATCH;
+            size_t n = 0;
+            PendingRoute pr;
+            while (n < quota && count < ROUTE_QUEUE_BATCH &&
+                    this->windows[c]->pop(pr)) {
+                if (this->stale(pr, c, backlog, dropped)) {
+                    dropped++;
+                    continue;
+                }
+                out.push_back(pr);
+                n++;
+                count++;
+            }
+        }
+    }
+
+    if (this->taken.size() > 0 && this->idle()) {
+        this->taken.clear();
+    }
+    return count;
+}
+
+/**
+ * Check an update taken from class 'c' against those for its prefix in the
+ * other classes. Returns true if a newer update is waiting, or has been
+ * taken already. Otherwise, older updates held in other windows are dropped,
+ * and counted in 'dropped', and if older updates could still be in the rings
+ * of the 'backlog' classes, the update is recorded in 'taken'.
+ */
+bool RouteQueue::stale(const PendingRoute& pr, unsigned c, unsigned backlog,
+                       size_t& dropped) {
+    if (pr.seq == 0) {
+        return false;
+    }
+
+    AddressKey key = pr.key();
+    if (this->taken.size() > 0) {
+        uint64_t* newest = this->taken.find(key);
+        if (newest != NULL && *newest > pr.seq) {
+            return true;
+        }
+    }
+    for (unsigned k = 0; k < ROUTE_CLASSES; k++) {
+        if (k == c) {
+            continue;
+        }
+        const PendingRoute* held = this->windows[k]->find(key);
+        if (held == NULL || held->seq == 0) {
+            continue;
+        }
+        if (held->seq > pr.seq) {
+            return true;
+        }
+        this->windows[k]->erase(key);
+        dropped++;
+    }
+    if ((backlog & ~(1 << c)) != 0) {
+        this->taken[key] = pr.seq;
+    }
+    return false;
+}
+
+/* Whether any ring has updates for the windows */
+bool RouteQueue::queued() const {
+    for (unsigned c = 0; c < ROUTE_CLASSES; c++) {
+        if (!this->rings[c]->empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Whether any ring has updates its window has room for */
+bool RouteQueue::fillable() const {
+    for (unsigned c = 0; c < ROUTE_CLASSES; c++) {
+        if (!this->rings[c]->empty() &&
+                this->windows[c]->size() < this->capacity) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Whether no update is queued or held in any class */
+bool RouteQueue::idle() const {
+    for (unsigned c = 0; c < ROUTE_CLASSES; c++) {
+        if (!this->windows[c]->empty()) {
+            return false;
+        }
+    }
+    return !this->queued();
+}
+
+uint64_t RouteQueue::pushed() const {
+    uint64_t pushed = 0;
+    for (unsigned c = 0; c < ROUTE_CLASSES; c++) {
+        pushed += this->rings[c]->stats().pushed;
+    }
+    return pushed;
+}
+
+RingStats RouteQueue::stats(RouteClass priority) const {
+    return this->rings[priority]->stats();
+}
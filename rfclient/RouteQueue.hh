@@ -0,0 +1,88 @@
+#ifndef ROUTEQUEUE_HH
+#define ROUTEQUEUE_HH
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "AddressMap.hh"
+#include "MPSCRing.hh"
+#include "PendingRoute.hh"
+#include "RouteCoalescer.hh"
+
+// Most route updates a resolver thread takes from its queue at once
+#define ROUTE_QUEUE_BATCH 256
+// Updates taken from each class in a batch when every class has some due,
+// from withdrawals down to bulk routes. Any share a class leaves unused goes
+// to the most urgent classes with updates due.
+#define ROUTE_CLASS_WEIGHTS { 128, 64, 32, 32 }
+
+/**
+ * The route updates waiting for one resolver thread, split by priority
+ * class, so that withdrawals and host, default and IGP routes don't wait
+ * behind a full table of bulk routes being loaded.
+ *
+ * Each class has its own ring, which producers push to without locking, and
+ * its own flap window (see RouteCoalescer), which the resolver moves updates
+ * into. The resolver takes due updates from the windows in weighted batches,
+ * so urgent updates go first without starving bulk routes.
+ *
+ * Updates for a prefix stay in order within a class, but an update in a
+ * more urgent class can overtake older ones for the same prefix. Updates new
+ * from the kernel are numbered as they are queued, and when one is taken,
+ * the older of it and any update for its prefix held in another window is
+ * dropped as stale. Older updates may also still be in a ring whose window is
+ * full, so while any is, taken updates are recorded to check those against.
+ * Replays, refreshes and retries are not numbered, as the resolver checks
+ * that they are still wanted.
+ */
+class RouteQueue {
+    public:
+        /* Each class holds up to 'capacity' updates in its ring, and as
+         * many in its window, and updates are held for 'window' ms. */
+        RouteQueue(size_t capacity, RingPolicy policy, unsigned window);
+        ~RouteQueue();
+
+        /* Queue an update in its class. Returns the number of queued
+         * updates it displaced, as for MPSCRing::push(), which also says
+         * what 'wait' and 'dropped' do. */
+        size_t push(const PendingRoute& pr, bool wait = true,
+                    size_t* dropped = NULL);
+
+        /* Wait for updates to be due, and append up to ROUTE_QUEUE_BATCH
+         * of them to 'out'. 'dropped' is set to the number of updates
+         * absorbed by later ones or dropped as stale, and the call returns
+         * early if there are any. Returns the number of updates appended.
+         * Only the resolver thread may call this. */
+        size_t take(std::vector<PendingRoute>& out, size_t& dropped);
+
+        /* Number of updates ever queued */
+        uint64_t pushed() const;
+
+        RingStats stats(RouteClass priority) const;
+
+    private:
+        RingSignal signal;
+        MPSCRing<PendingRoute>* rings[ROUTE_CLASSES];
+        RouteCoalescer* windows[ROUTE_CLASSES];
+        size_t capacity;
+        uint64_t nextSeq;
+
+        /* Number of the newest update taken for each prefix that older
+         * updates in the rings of other classes may still be waiting for */
+        AddressMap<uint64_t> taken;
+        std::vector<PendingRoute> batch;
+
+        size_t fill();
+        size_t drain(std::vector<PendingRoute>& out, size_t& dropped);
+        bool stale(const PendingRoute& pr, unsigned c, unsigned backlog,
+                   size_t& dropped);
+        bool queued() const;
+        bool fillable() const;
+        bool idle() const;
+
+        RouteQueue(const RouteQueue&);
+        RouteQueue& operator=(const RouteQueue&);
+};
+
+#endif /* ROUTEQUEUE_HH */
@@ -0,0 +1,65 @@
+#ifndef ROUTESHARD_HH
+#define ROUTESHARD_HH
+
+#include <stdint.h>
+
+#include <list>
+#include <boost/thread/mutex.hpp>
+
+#include "types/MACAddress.h"
+#include "RouteEntry.hh"
+#include "RouteTable.hh"
+#include "AddressMap.hh"
+#include "NextHopTable.hh"
+#include "PortIndex.hh"
+#include "GatewayIndex.hh"
+#include "RouteModBatcher.hh"
+
+/**
+ * The state kept for the prefixes handled by one resolver thread. Prefixes
+ * are sharded by the hash of their key, as route updates are queued, so a
+ * resolver only works on its own shard and only contends with the threads
+ * that look at every shard, on port changes and neighbour updates.
+ *
+ * RouteShard does no locking of its own. FlowTable holds 'mutex' while using
+ * the route tables and the copy of the host table, and 'nextHopMutex' while
+ * using the next hops, which are created and released as routes are sent.
+ */
+class RouteShard {
+    public:
+        /* Next hop IDs of shard 'index' are index + 1, then every
+         * 'count' after that, so no two shards hand out the same one. */
+        RouteShard(unsigned index, unsigned count)
+            : nextHops(index + 1, count) {}
+
+        boost::mutex mutex;
+
+        /* Routes installed */
+        RouteTable routeTable;
+
+        /* Routes as last received for each prefix, indexed by the ports they
+         * use so they can follow port state changes, and by gateway, to
+         * follow lost neighbours. */
+        PortIndex<RouteEntry> portRoutes;
+        GatewayIndex gatewayRoutes;
+
+        /* Routes waiting for their gateway to resolve, keyed by gateway, and
+         * indexed by prefix so that newer updates can supersede them. */
+        AddressMap< std::list<RouteEntry> > parkedRoutes;
+        RouteTable parkedIndex;
+
+        /* MAC address of each resolved host, copied from the host table so
+         * that gateways are looked up without leaving the shard. */
+        AddressMap<MACAddress> hosts;
+
+        /* Next hops used by the routes of this shard. Routes of different
+         * shards through the same gateway use different next hops. */
+        boost::mutex nextHopMutex;
+        NextHopTable nextHops;
+
+        /* RouteMods for the prefixes of this shard, which only need to be in
+         * order with the next hops of this shard */
+        RouteModBatcher batcher;
+};
+
+#endif /* ROUTESHARD_HH */
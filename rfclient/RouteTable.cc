@@ -0,0 +1,313 @@
+#include <string.h>
+
+#include "RouteTable.hh"
+
+#define MAX_KEY_LEN 16
+
+/**
+ * A trie node covers the first 'len' bits of 'key'. Nodes without an entry
+ * only exist to join two subtries that diverge at bit 'len', so every node on
+ * a path either holds a route or has two children.
+ */
+struct RouteTable::Node {
+    uint8_t key[MAX_KEY_LEN];
+    int len;
+    Node* child[2];
+    RouteEntry* entry;
+
+    Node(const uint8_t* key, int len);
+
+    ~Node() {
+        delete this->entry;
+    }
+};
+
+/**
+ * Clear the bits of 'key' beyond the first 'len', so that host bits in a
+ * route's address never take part in comparisons.
+ */
+static void mask_key(uint8_t* key, int len) {
+    int byte = len / 8;
+    if (byte < MAX_KEY_LEN) {
+        if (len % 8) {
+            key[byte++] &= (uint8_t) (0xff << (8 - (len % 8)));
+        }
+        memset(key + byte, 0, MAX_KEY_LEN - byte);
+    }
+}
+
+static inline int key_bit(const uint8_t* key, int bit) {
+    return (key[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+/**
+ * Returns the number of leading bits (up to 'max') that 'a' and 'b' share.
+ */
+static int common_bits(const uint8_t* a, const uint8_t* b, int max) {
+    int n = 0;
+    for (int i = 0; n < max; i++, n += 8) {
+        uint8_t diff = a[i] ^ b[i];
+        if (diff != 0) {
+            while (!(diff & 0x80)) {
+                diff <<= 1;
+                n++;
+            }
+            break;
+        }
+    }
+
+    return n < max ? n : max;
+}
+
+RouteTable::Node::Node(const uint8_t* key, int len) {
+    memcpy(this->key, key, MAX_KEY_LEN);
+    mask_key(this->key, len);
+    this->len = len;
+    this->child[0] = NULL;
+    this->child[1] = NULL;
+    this->entry = NULL;
+}
+
+RouteTable::RouteTable() {
+    this->roots[0] = NULL;
+    this->roots[1] = NULL;
+    this->count = 0;
+}
+
+RouteTable::~RouteTable() {
+    this->clear();
+}
+
+/**
+ * Insert the given route, replacing any route stored for the same prefix.
+ *
+ * Returns true if the prefix was not previously present.
+ */
+bool RouteTable::insert(const RouteEntry& re) {
+    uint8_t key[MAX_KEY_LEN];
+    int len = re.netmask.toPrefixLen();
+    make_key(re.address, len, key);
+
+    Node** link = &this->roots[family_index(re.address)];
+    while (true) {
+        Node* node = *link;
+
+        if (node == NULL) {
+            node = new Node(key, len);
+            node->entry = new RouteEntry(re);
+            *link = node;
+            this->count++;
+            return true;
+        }
+
+        int max = node->len < len ? node->len : len;
+        int common = common_bits(node->key, key, max);
+
+        if (common == node->len && node->len == len) {
+            bool added = (node->entry == NULL);
+            if (added) {
+                node->entry = new RouteEntry(re);
+                this->count++;
+            } else {
+                *node->entry = re;
+            }
+            return added;
+        }
+
+        if (common == node->len) {
+            // The node covers our prefix; keep descending.
+            link = &node->child[key_bit(key, node->len)];
+            continue;
+        }
+
+        Node* leaf = new Node(key, len);
+        leaf->entry = new RouteEntry(re);
+        this->count++;
+
+        if (common == len) {
+            // Our prefix covers the node, so it becomes the node's parent.
+            leaf->child[key_bit(node->key, len)] = node;
+            *link = leaf;
+        } else {
+            // The prefixes diverge; join them under a new glue node.
+            Node* glue = new Node(key, common);
+            glue->child[key_bit(key, common)] = leaf;
+            glue->child[key_bit(node->key, common)] = node;
+            *link = glue;
+        }
+        return true;
+    }
+}
+
+/**
+ * Remove the route stored for the given prefix, collapsing any glue nodes
+ * that are no longer needed.
+ *
+ * Returns true if a route was removed.
+ */
+bool RouteTable::remove(const IPAddress& addr, int prefix_len) {
+    uint8_t key[MAX_KEY_LEN];
+    make_key(addr, prefix_len, key);
+
+    Node** parent_link = NULL;
+    Node** link = &this->roots[family_index(addr)];
+    Node* node = *link;
+
+    while (node != NULL && node->len <= prefix_len) {
+        if (common_bits(node->key, key, node->len) != node->len) {
+            return false;
+        }
+        if (node->len == prefix_len) {
+            break;
+        }
+        parent_link = link;
+        link = &node->child[key_bit(key, node->len)];
+        node = *link;
+    }
+
+    if (node == NULL || node->len != prefix_len || node->entry == NULL) {
+        return false;
+    }
+
+    delete node->entry;
+    node->entry = NULL;
+    this->count--;
+
+    if (node->child[0] != NULL && node->child[1] != NULL) {
+        // Still needed to join its two subtries.
+        return true;
+    }
+
+    *link = (node->child[0] != NULL) ? node->child[0] : node->child[1];
+    delete node;
+
+    // A glue parent left with a single child is no longer needed either.
+    if (parent_link != NULL) {
+        Node* parent = *parent_link;
+        if (parent->entry == NULL &&
+                (parent->child[0] == NULL || parent->child[1] == NULL)) {
+            *parent_link = (parent->child[0] != NULL) ? parent->child[0]
+                                                      : parent->child[1];
+            delete parent;
+        }
+    }
+
+    return true;
+}
+
+bool RouteTable::remove(const RouteEntry& re) {
+    return this->remove(re.address, re.netmask.toPrefixLen());
+}
+
+const RouteEntry* RouteTable::find(const IPAddress& addr,
+                                   int prefix_len) const {
+    uint8_t key[MAX_KEY_LEN];
+    make_key(addr, prefix_len, key);
+
+    const Node* node = this->roots[family_index(addr)];
+    while (node != NULL && node->len <= prefix_len) {
+        if (common_bits(node->key, key, node->len) != node->len) {
+            return NULL;
+        }
+        if (node->len == prefix_len) {
+            return node->entry;
+        }
+        node = node->child[key_bit(key, node->len)];
+    }
+
+    return NULL;
+}
+
+const RouteEntry* RouteTable::find(const RouteEntry& re) const {
+    return this->find(re.address, re.netmask.toPrefixLen());
+}
+
+const RouteEntry* RouteTable::lookup(const IPAddress& addr) const {
+    uint8_t key[MAX_KEY_LEN];
+    int width = addr.getLength() * 8;
+    make_key(addr, width, key);
+
+    const RouteEntry* best = NULL;
+    const Node* node = this->roots[family_index(addr)];
+    while (node != NULL) {
+        if (common_bits(node->key, key, node->len) != node->len) {
+            break;
+        }
+        if (node->entry != NULL) {
+            best = node->entry;
+        }
+        if (node->len >= width) {
+            break;
+        }
+        node = node->child[key_bit(key, node->len)];
+    }
+
+    return best;
+}
+
+size_t RouteTable::size() const {
+    return this->count;
+}
+
+std::vector<RouteEntry> RouteTable::entries() const {
+    std::vector<RouteEntry> out;
+    out.reserve(this->count);
+
+    std::vector<const Node*> stack;
+    for (int i = 0; i < 2; i++) {
+        if (this->roots[i] != NULL) {
+            stack.push_back(this->roots[i]);
+        }
+    }
+
+    while (!stack.empty()) {
+        const Node* node = stack.back();
+        stack.pop_back();
+        if (node->entry != NULL) {
+            out.push_back(*node->entry);
+        }
+        for (int c = 1; c >= 0; c--) {
+            if (node->child[c] != NULL) {
+                stack.push_back(node->child[c]);
+            }
+        }
+    }
+
+    return out;
+}
+
+void RouteTable::clear() {
+    for (int i = 0; i < 2; i++) {
+        destroy(this->roots[i]);
+        this->roots[i] = NULL;
+    }
+    this->count = 0;
+}
+
+int RouteTable::family_index(const IPAddress& addr) {
+    return (addr.getVersion() == IPV6) ? 1 : 0;
+}
+
+void RouteTable::make_key(const IPAddress& addr, int prefix_len,
+                          uint8_t* key) {
+    memset(key, 0, MAX_KEY_LEN);
+    addr.toArray(key);
+    mask_key(key, prefix_len);
+}
+
+/* Tear down a subtrie iteratively, rotating left children up as we go. */
+void RouteTable::destroy(Node* node) {
+    while (node != NULL) {
+        if (node->child[0] != NULL) {
+            // Rotate the left subtree up so that node has no left child.
+            Node* left = node->child[0];
+            node->child[0] = left->child[1];
+            left->child[1] = node;
+            node = left;
+        } else {
+            Node* right = node->child[1];
+            delete node;
+            node = right;
+        }
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef ROUTETABLE_HH
+#define ROUTETABLE_HH
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include "types/IPAddress.h"
+#include "RouteEntry.hh"
+
+/**
+ * Route store keyed by address family and prefix.
+ *
+ * Routes are kept in a path-compressed binary trie per address family, so
+ * insertion, removal and exact lookup cost O(prefix length) no matter how many
+ * routes are stored. lookup() performs a longest-prefix match for an address.
+ *
+ * At most one route is stored per prefix. RouteTable does no locking of its
+ * own; callers sharing a table between threads must serialise access.
+ */
+class RouteTable {
+    public:
+        RouteTable();
+        ~RouteTable();
+
+        /* Returns true if the prefix is new, false if an entry was replaced */
+        bool insert(const RouteEntry& re);
+
+        /* Returns true if a route was removed */
+        bool remove(const IPAddress& addr, int prefix_len);
+        bool remove(const RouteEntry& re);
+
+        /* Exact match on the prefix. Returns NULL if no route is stored. */
+        const RouteEntry* find(const IPAddress& addr, int prefix_len) const;
+        const RouteEntry* find(const RouteEntry& re) const;
+
+        /* Longest-prefix match. Returns NULL if no route covers 'addr'. */
+        const RouteEntry* lookup(const IPAddress& addr) const;
+
+        /* Copies of every stored route */
+        std::vector<RouteEntry> entries() const;
+
+        size_t size() const;
+        void clear();
+
+    private:
+        struct Node;
+
+        Node* roots[2];
+        size_t count;
+
+        /* Not copyable */
+        RouteTable(const RouteTable&);
+        RouteTable& operator=(const RouteTable&);
+
+        static int family_index(const IPAddress& addr);
+        static void make_key(const IPAddress& addr, int prefix_len,
+                             uint8_t* key);
+        static void destroy(Node* node);
+};
+
+#endif /* ROUTETABLE_HH */
@@ -0,0 +1,201 @@
+#include <time.h>
+
+#include "TimerWheel.hh"
+
+#define LEVEL_SHIFT(level) ((level) * TIMER_WHEEL_BITS)
+#define SLOT_INDEX(ticks, level) \
+    (((ticks) >> LEVEL_SHIFT(level)) & (TIMER_WHEEL_SLOTS - 1))
+
+TimerWheel::TimerWheel(unsigned tick) {
+    this->tick = (tick > 0) ? tick : 1;
+    this->start = TimerWheel::now();
+    this->current = 0;
+    this->count = 0;
+    this->nextGeneration = 1;
+    for (size_t i = 0; i < TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS; i++) {
+        this->slots[i] = NIL;
+    }
+}
+
+uint64_t TimerWheel::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+TimerId TimerWheel::schedule(unsigned delay, const TimerCallback& cb) {
+    // A timer always waits for at least the next tick.
+    uint64_t ticks = (delay + this->tick - 1) / this->tick;
+    if (ticks == 0) {
+        ticks = 1;
+    }
+    const uint64_t maxTicks =
+        ((uint64_t) 1 << LEVEL_SHIFT(TIMER_WHEEL_LEVELS)) - 1;
+    if (ticks > maxTicks) {
+        ticks = maxTicks;
+    }
+
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    uint32_t index;
+    if (this->freeNodes.empty()) {
+        index = this->nodes.size();
+        this->nodes.push_back(Node());
+    } else {
+        index = this->freeNodes.back();
+        this->freeNodes.pop_back();
+    }
+
+    Node& node = this->nodes[index];
+    node.expires = this->current + ticks;
+    node.generation = this->nextGeneration++;
+    if (this->nextGeneration == 0) {
+        this->nextGeneration = 1;
+    }
+    node.cb = cb;
+    this->insert(index);
+    this->count++;
+
+    return ((TimerId) node.generation << 32) | index;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    uint32_t index = id & 0xffffffff;
+    uint32_t generation = id >> 32;
+
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    if (index >= this->nodes.size() || generation == 0 ||
+            this->nodes[index].generation != generation) {
+        return false;
+    }
+
+    this->unlink(index);
+    this->release(index);
+    return true;
+}
+
+size_t TimerWheel::advance() {
+    return this->advance(TimerWheel::now());
+}
+
+size_t TimerWheel::advance(uint64_t now) {
+    std::vector<TimerCallback> due;
+    {
+        boost::lock_guard<boost::mutex> lock(this->mutex);
+        uint64_t target = (now > this->start)
+                              ? (now - this->start) / this->tick : 0;
+        while (this->current < target) {
+            // Skip ahead over ticks that can have nothing to do.
+            if (this->count == 0) {
+                this->current = target;
+                break;
+            }
+
+            this->current++;
+            for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+                if (SLOT_INDEX(this->current, level - 1) != 0) {
+                    break;
+                }
+                this->cascade(level);
+            }
+            this->expire(due);
+        }
+    }
+
+    for (size_t i = 0; i < due.size(); i++) {
+        due[i]();
+    }
+    return due.size();
+}
+
+void TimerWheel::run() {
+    while (true) {
+        boost::this_thread::sleep(
+            boost::posix_time::milliseconds(this->tick));
+        this->advance();
+    }
+}
+
+void TimerWheel::clear() {
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    for (uint32_t i = 0; i < this->nodes.size(); i++) {
+        if (this->nodes[i].generation != 0) {
+            this->unlink(i);
+            this->release(i);
+        }
+    }
+}
+
+size_t TimerWheel::size() const {
+    boost::lock_guard<boost::mutex> lock(this->mutex);
+    return this->count;
+}
+
+/* Put a node in the slot covering its expiry */
+void TimerWheel::insert(uint32_t index) {
+    Node& node = this->nodes[index];
+    uint64_t delta = node.expires - this->current;
+
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 &&
+            delta >= ((uint64_t) 1 << LEVEL_SHIFT(level + 1))) {
+        level++;
+    }
+    node.slot = level * TIMER_WHEEL_SLOTS + SLOT_INDEX(node.expires, level);
+
+    node.prev = NIL;
+    node.next = this->slots[node.slot];
+    if (node.next != NIL) {
+        this->nodes[node.next].prev = index;
+    }
+    this->slots[node.slot] = index;
+}
+
+void TimerWheel::unlink(uint32_t index) {
+    Node& node = this->nodes[index];
+    if (node.prev != NIL) {
+        this->nodes[node.prev].next = node.next;
+    } else {
+        this->slots[node.slot] = node.next;
+    }
+    if (node.next != NIL) {
+        this->nodes[node.next].prev = node.prev;
+    }
+}
+
+void TimerWheel::release(uint32_t index) {
+    Node& node = this->nodes[index];
+    node.generation = 0;
+    node.cb = TimerCallback();
+    this->freeNodes.push_back(index);
+    this->count--;
+}
+
+/* Move the timers in the current slot of 'level' down to lower levels */
+void TimerWheel::cascade(int level) {
+    uint32_t slot = level * TIMER_WHEEL_SLOTS +
+                    SLOT_INDEX(this->current, level);
+    uint32_t index = this->slots[slot];
+    this->slots[slot] = NIL;
+
+    while (index != NIL) {
+        uint32_t next = this->nodes[index].next;
+        this->insert(index);
+        index = next;
+    }
+}
+
+/* Take the callbacks of the timers due at the current tick */
+void TimerWheel::expire(std::vector<TimerCallback>& due) {
+    uint32_t slot = SLOT_INDEX(this->current, 0);
+    uint32_t index = this->slots[slot];
+    this->slots[slot] = NIL;
+
+    while (index != NIL) {
+        Node& node = this->nodes[index];
+        uint32_t next = node.next;
+        due.push_back(TimerCallback());
+        due.back().swap(node.cb);
+        this->release(index);
+        index = next;
+    }
+}
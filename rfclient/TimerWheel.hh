@@ -0,0 +1,99 @@
+#ifndef TIMERWHEEL_HH
+#define TIMERWHEEL_HH
+
+#include <stdint.h>
+
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+// Resolution of timers (in milliseconds)
+#define TIMER_WHEEL_TICK 10
+// Each level of the wheel has 2^TIMER_WHEEL_BITS slots
+#define TIMER_WHEEL_BITS 8
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+// Timers due more than TIMER_WHEEL_SLOTS^TIMER_WHEEL_LEVELS ticks ahead
+// (about 16 months) fire at that point instead
+#define TIMER_WHEEL_LEVELS 4
+
+typedef boost::function<void ()> TimerCallback;
+
+/* Identifies a scheduled timer. 0 is never a valid timer. */
+typedef uint64_t TimerId;
+
+/**
+ * Timers held in a hierarchical timing wheel.
+ *
+ * The first level has a slot for each of the next TIMER_WHEEL_SLOTS ticks,
+ * and each further level has slots covering TIMER_WHEEL_SLOTS times as many
+ * ticks as the level below. A timer goes in the slot covering its expiry,
+ * and moves down a level each time the level below wraps around, so adding
+ * and cancelling a timer are O(1), and each timer is moved at most
+ * TIMER_WHEEL_LEVELS - 1 times.
+ *
+ * Timers may be added and cancelled from any thread. Callbacks are run by
+ * the thread calling advance(), without any lock held, so they may add or
+ * cancel timers themselves. A timer cancelled while its callback is about
+ * to run may still run.
+ */
+class TimerWheel {
+    public:
+        TimerWheel(unsigned tick = TIMER_WHEEL_TICK);
+
+        /* Run 'cb' once, 'delay' ms from now, to within a tick */
+        TimerId schedule(unsigned delay, const TimerCallback& cb);
+
+        /* Cancel a timer. Returns false if it already ran or was cancelled. */
+        bool cancel(TimerId id);
+
+        /* Run every timer that is due. Returns the number run. */
+        size_t advance();
+        /* Run every timer due by 'now' ms on the wheel's clock */
+        size_t advance(uint64_t now);
+
+        /* Advance every tick until interrupted */
+        void run();
+
+        /* Cancel every timer */
+        void clear();
+
+        size_t size() const;
+
+        /* The wheel's clock (in ms) */
+        static uint64_t now();
+
+    private:
+        static const uint32_t NIL = 0xffffffff;
+
+        struct Node {
+            uint64_t expires;  /* in ticks */
+            uint32_t generation;
+            uint32_t slot;
+            uint32_t prev;
+            uint32_t next;
+            TimerCallback cb;
+        };
+
+        unsigned tick;
+        uint64_t start;
+        uint64_t current;  /* The last tick processed */
+        size_t count;
+
+        std::vector<Node> nodes;
+        std::vector<uint32_t> freeNodes;
+        uint32_t nextGeneration;
+        uint32_t slots[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
+
+        mutable boost::mutex mutex;
+
+        void insert(uint32_t index);
+        void unlink(uint32_t index);
+        void release(uint32_t index);
+        void cascade(int level);
+        void expire(std::vector<TimerCallback>& due);
+
+        TimerWheel(const TimerWheel&);
+        TimerWheel& operator=(const TimerWheel&);
+};
+
+#endif /* TIMERWHEEL_HH */
@@ -0,0 +1,27 @@
+#ifndef BENCHUTIL_HH
+#define BENCHUTIL_HH
+
+#include <stdint.h>
+#include <time.h>
+
+/* Helpers shared by the benchmarks */
+
+/* Monotonic time in seconds */
+inline double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The next of a sequence of pseudo-random numbers that is the same on every
+ * run, so that results can be compared between runs. */
+inline uint32_t next_rand() {
+    // xorshift32: cheap and deterministic between runs.
+    static uint32_t state = 0x9e3779b9;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+#endif /* BENCHUTIL_HH */
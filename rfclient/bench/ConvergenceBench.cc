@@ -0,0 +1,588 @@
+/*
+ * Measures how long rfclient takes to turn a routing table into RouteMods,
+ * end to end. Route updates are fed to FlowTable as the kernel or zebra
+ * would send them, resolved by the resolver threads, batched, serialised and
+ * handed to an IPCMessageService that stands in for RFServer. The stand-in
+ * acknowledges every RouteMod as it arrives, and tracks the latest RouteMod
+ * for each prefix. The table has converged once the latest RouteMod for every
+ * prefix matches the last update fed for it.
+ *
+ * Every prefix is first added through one of num_nexthops gateways (one in
+ * MULTIPATH_SHARE through two), then num_churn updates each move a random
+ * prefix to another gateway, withdraw it, or add it back. The links and
+ * neighbours for the gateways are set up beforehand. Updates are fed as
+ * netlink messages to FlowTable::updateRouteTable(), as the route socket
+ * reader does, or as FPM frames to FPMServer::process_fpm_msg() in builds
+ * with FPM_ENABLED.
+ *
+ * The table is loaded with num_resolvers resolver threads, or once with
+ * each of RESOLVER_COUNTS if num_resolvers is 0 (the default), to show how
+ * throughput scales with them. FlowTable is static, so each load runs in a
+ * process of its own.
+ *
+ * Nothing is read from the kernel, so no privileges or routing daemon are
+ * needed. FlowTable logs every route to stdout at info level, so results go
+ * to stderr; build with -DRFLOG_LEVEL=LOG_NOTICE to measure without logging.
+ *
+ * Usage: ConvergenceBench [netlink|fpm] [num_prefixes] [num_nexthops]
+ *                         [num_churn] [num_resolvers]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+
+#include "BenchUtil.hh"
+#include "defs.h"
+#include "log/Log.h"
+#include "FlowTable.h"
+#include "FPMServer.hh"
+
+#define DEFAULT_PREFIXES 100000
+#define DEFAULT_NEXTHOPS 64
+#define MAX_NEXTHOPS 0xfffe
+#define NUM_PORTS 4
+#define IFINDEX_BASE 100
+#define MULTIPATH_SHARE 8 /* One prefix in MULTIPATH_SHARE has two paths */
+#define MESSAGE_SIZE 512
+#define FRAME_SIZE (MESSAGE_SIZE + 16) /* A message after an FPM header */
+#define PREFIX_BASE 0x0a000000 /* Prefixes are /24s from 10.0.0.0 */
+#define GATEWAY_BASE 0xac100001 /* Gateways are from 172.16.0.1 */
+// Time to wait for the table to converge (s)
+#define CONVERGE_TIMEOUT 120
+
+/* Resolver thread counts compared when none is given */
+static const unsigned RESOLVER_COUNTS[] = { 1, 2, 4, 8, 16 };
+
+/*
+ * What a prefix is routed through: 0 if it is withdrawn, otherwise one more
+ * than the index of its first gateway, plus one more than that of its second
+ * shifted up 16 bits if it has two.
+ */
+static uint32_t route_state(uint32_t first, int second) {
+    uint32_t state = first + 1;
+    if (second >= 0) {
+        state |= (uint32_t) (second + 1) << 16;
+    }
+    return state;
+}
+
+/* The state of prefix 'i' when routed through gateway 'gateway' */
+static uint32_t prefix_state(size_t i, uint32_t gateway, size_t nexthops) {
+    if (i % MULTIPATH_SHARE == 0 && nexthops > 1) {
+        return route_state(gateway, (gateway + 1) % nexthops);
+    }
+    return route_state(gateway, -1);
+}
+
+/* Stands in for RFServer: serialises every message as MongoIPC would, has
+ * each RouteMod acknowledged, and tracks the state of every prefix from the
+ * RouteMods sent for it. */
+class CapturingIPC : public IPCMessageService {
+    public:
+        CapturingIPC(size_t prefixes)
+            : seen(prefixes, 0), expected(prefixes, 0), matched(prefixes),
+              done(false), lastChange(0), messages(0), bytes(0),
+              routeMods(0) {}
+
+        void listen(const string&, IPCMessageFactory*, IPCMessageProcessor*,
+                    bool) {
+        }
+
+        bool send(const string&, const string&, IPCMessage& msg) {
+            const char* data = msg.to_BSON();
+            int32_t size;
+            memcpy(&size, data, sizeof(size));
+            delete[] data;
+
+            boost::lock_guard<boost::mutex> lock(this->mutex);
+            this->messages++;
+            this->bytes += size;
+            if (msg.get_type() == NEXT_HOP_MOD) {
+                this->nextHopMod(static_cast<NextHopMod&>(msg));
+            } else if (msg.get_type() == ROUTE_MOD_BATCH) {
+                std::vector<RouteMod> mods;
+                mods = static_cast<RouteModBatch&>(msg).get_mods();
+                for (size_t i = 0; i < mods.size(); i++) {
+                    this->routeMod(mods[i]);
+                }
+            }
+            return true;
+        }
+
+        /* Record that prefix 'i' should end up in 'state' */
+        void expect(size_t i, uint32_t state) {
+            boost::lock_guard<boost::mutex> lock(this->mutex);
+            this->update(this->expected, i, state);
+        }
+
+        /* Wait until every update has been fed and every prefix is in its
+         * expected state. Returns the time the last prefix got there, or 0
+         * if that took longer than 'timeout' seconds. */
+        double waitConverged(double timeout) {
+            boost::unique_lock<boost::mutex> lock(this->mutex);
+            this->done = true;
+            boost::system_time deadline = boost::get_system_time() +
+                boost::posix_time::milliseconds((long) (timeout * 1000));
+            while (this->matched < this->seen.size()) {
+                if (!this->converged.timed_wait(lock, deadline)) {
+                    return 0;
+                }
+            }
+            return this->lastChange;
+        }
+
+        /* Wait until at least 'count' RouteMods have been sent */
+        void waitRouteMods(size_t count) {
+            boost::unique_lock<boost::mutex> lock(this->mutex);
+            while (this->routeMods < count) {
+                this->converged.wait(lock);
+            }
+        }
+
+        /* Acknowledge RouteMods as successfully installed, as they come */
+        void acknowledge() {
+            std::deque<uint64_t> seqs;
+            while (true) {
+                {
+                    boost::unique_lock<boost::mutex> lock(this->ackMutex);
+                    while (this->acks.empty()) {
+                        this->acked.wait(lock);
+                    }
+                    seqs.swap(this->acks);
+                }
+                for (size_t i = 0; i < seqs.size(); i++) {
+                    FlowTable::ackRouteMod(seqs[i], RMS_SUCCESS);
+                }
+                seqs.clear();
+            }
+        }
+
+        size_t getMatched() {
+            boost::lock_guard<boost::mutex> lock(this->mutex);
+            return this->matched;
+        }
+
+        size_t getMessages() {
+            boost::lock_guard<boost::mutex> lock(this->mutex);
+            return this->messages;
+        }
+
+        size_t getBytes() {
+            boost::lock_guard<boost::mutex> lock(this->mutex);
+            return this->bytes;
+        }
+
+        size_t getRouteMods() {
+            boost::lock_guard<boost::mutex> lock(this->mutex);
+            return this->routeMods;
+        }
+
+    private:
+        boost::mutex mutex;
+        boost::condition_variable converged;
+        std::vector<uint32_t> seen;
+        std::vector<uint32_t> expected;
+        size_t matched;  /* Prefixes whose seen state is the expected one */
+        bool done;
+        double lastChange;
+        std::map<uint32_t, uint32_t> nextHops;  /* Gateway of each next hop */
+        size_t messages;
+        size_t bytes;
+        size_t routeMods;
+
+        boost::mutex ackMutex;
+        boost::condition_variable acked;
+        std::deque<uint64_t> acks;
+
+        void update(std::vector<uint32_t>& states, size_t i, uint32_t state) {
+            bool before = (this->seen[i] == this->expected[i]);
+            states[i] = state;
+            bool after = (this->seen[i] == this->expected[i]);
+            this->matched += (size_t) after - (size_t) before;
+        }
+
+        /* Gateways are told apart by the last three bytes of their MAC */
+        void nextHopMod(NextHopMod& msg) {
+            if (msg.get_mod() == RMT_DELETE) {
+                return;
+            }
+            std::vector<Action> actions = msg.get_actions();
+            for (size_t i = 0; i < actions.size(); i++) {
+                if (actions[i].getType() == RFAT_SET_ETH_DST) {
+                    const uint8_t* mac = actions[i].getValue();
+                    this->nextHops[msg.get_nexthop_id()] =
+                        (mac[3] << 16) | (mac[4] << 8) | mac[5];
+                }
+            }
+        }
+
+        void routeMod(RouteMod& rm) {
+            this->routeMods++;
+            if (rm.get_seq() != 0) {
+                boost::lock_guard<boost::mutex> lock(this->ackMutex);
+                this->acks.push_back(rm.get_seq());
+                this->acked.notify_one();
+            }
+            this->converged.notify_all();
+
+            // Only the benchmark's prefixes are tracked, not gateway hosts.
+            std::vector<Match> matches = rm.get_matches();
+            if (matches.empty() || matches[0].getType() != RFMT_IPV4) {
+                return;
+            }
+            uint32_t addr, mask;
+            memcpy(&addr, matches[0].getIPAddress(), sizeof(addr));
+            memcpy(&mask, matches[0].getIPMask(), sizeof(mask));
+            size_t i = (ntohl(addr) - PREFIX_BASE) >> 8;
+            if (ntohl(mask) != 0xffffff00 ||
+                    i >= this->seen.size()) {
+                return;
+            }
+
+            uint32_t state = 0;
+            if (rm.get_mod() != RMT_DELETE) {
+                std::vector<Action> actions = rm.get_actions();
+                unsigned paths = 0;
+                for (size_t a = 0; a < actions.size(); a++) {
+                    if (actions[a].getType() == RFAT_GROUP) {
+                        uint32_t gateway;
+                        gateway = this->nextHops[actions[a].getUint32()];
+                        state |= (gateway + 1) << (16 * paths++);
+                    }
+                }
+            }
+            this->update(this->seen, i, state);
+            this->lastChange = now();
+            if (this->done && this->matched == this->seen.size()) {
+                this->converged.notify_all();
+            }
+        }
+};
+
+/* An attribute appended to a message, as addattr_l would */
+static void add_attr(struct nlmsghdr* n, int type, const void* data,
+                     int len) {
+    struct rtattr* rta = (struct rtattr *) ((char *) n +
+                                            NLMSG_ALIGN(n->nlmsg_len));
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH(len);
+    memcpy(RTA_DATA(rta), data, len);
+    n->nlmsg_len = NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+static int gateway_ifindex(uint32_t gateway) {
+    return IFINDEX_BASE + gateway % NUM_PORTS;
+}
+
+static void make_link(struct nlmsghdr* n, unsigned port) {
+    memset(n, 0, MESSAGE_SIZE);
+    n->nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    n->nlmsg_type = RTM_NEWLINK;
+
+    struct ifinfomsg* ifi = (struct ifinfomsg *) NLMSG_DATA(n);
+    ifi->ifi_family = AF_UNSPEC;
+    ifi->ifi_index = IFINDEX_BASE + port;
+
+    char name[IFNAMSIZ];
+    snprintf(name, sizeof(name), "bench%u", port);
+    add_attr(n, IFLA_IFNAME, name, strlen(name) + 1);
+}
+
+static void make_neigh(struct nlmsghdr* n, uint32_t gateway) {
+    memset(n, 0, MESSAGE_SIZE);
+    n->nlmsg_len = NLMSG_LENGTH(sizeof(struct ndmsg));
+    n->nlmsg_type = RTM_NEWNEIGH;
+
+    struct ndmsg* ndm = (struct ndmsg *) NLMSG_DATA(n);
+    ndm->ndm_family = AF_INET;
+    ndm->ndm_ifindex = gateway_ifindex(gateway);
+    ndm->ndm_state = NUD_REACHABLE;
+
+    uint32_t dst = htonl(GATEWAY_BASE + gateway);
+    uint8_t mac[IFHWADDRLEN] = { 0x02, 0, 0, (uint8_t) (gateway >> 16),
+                                 (uint8_t) (gateway >> 8), (uint8_t) gateway };
+    add_attr(n, NDA_DST, &dst, sizeof(dst));
+    add_attr(n, NDA_LLADDR, mac, sizeof(mac));
+}
+
+/* An update for prefix 'i' through the gateways of 'state', as zebra would
+ * send it */
+static void make_route(struct nlmsghdr* n, int type, size_t i,
+                       uint32_t state) {
+    memset(n, 0, MESSAGE_SIZE);
+    n->nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+    n->nlmsg_type = type;
+
+    struct rtmsg* rtm = (struct rtmsg *) NLMSG_DATA(n);
+    rtm->rtm_family = AF_INET;
+    rtm->rtm_dst_len = 24;
+    rtm->rtm_table = RT_TABLE_MAIN;
+    rtm->rtm_protocol = RTPROT_ZEBRA;
+    rtm->rtm_type = RTN_UNICAST;
+
+    uint32_t dst = htonl(PREFIX_BASE + ((uint32_t) i << 8));
+    add_attr(n, RTA_DST, &dst, sizeof(dst));
+
+    uint32_t first = (state & 0xffff) - 1;
+    if (state >> 16 == 0) {
+        uint32_t gw = htonl(GATEWAY_BASE + first);
+        int oif = gateway_ifindex(first);
+        add_attr(n, RTA_GATEWAY, &gw, sizeof(gw));
+        add_attr(n, RTA_OIF, &oif, sizeof(oif));
+        return;
+    }
+
+    uint32_t gateways[2] = { first, (state >> 16) - 1 };
+    char buf[128];
+    int len = 0;
+    for (int p = 0; p < 2; p++) {
+        struct rtnexthop* rtnh = (struct rtnexthop *) (buf + len);
+        rtnh->rtnh_flags = 0;
+        rtnh->rtnh_hops = 0;
+        rtnh->rtnh_ifindex = gateway_ifindex(gateways[p]);
+
+        struct rtattr* attr = RTNH_DATA(rtnh);
+        uint32_t gw = htonl(GATEWAY_BASE + gateways[p]);
+        attr->rta_type = RTA_GATEWAY;
+        attr->rta_len = RTA_LENGTH(sizeof(gw));
+        memcpy(RTA_DATA(attr), &gw, sizeof(gw));
+
+        rtnh->rtnh_len = sizeof(*rtnh) + attr->rta_len;
+        len += RTNH_ALIGN(rtnh->rtnh_len);
+    }
+    add_attr(n, RTA_MULTIPATH, buf, len);
+}
+
+/* Feed an update for prefix 'i' to FlowTable, as a netlink message or
+ * wrapped in an FPM frame. 'state' is the route being added or withdrawn. */
+static void feed(bool fpm, char* buf, int type, size_t i, uint32_t state) {
+    if (!fpm) {
+        struct nlmsghdr* n = (struct nlmsghdr *) buf;
+        make_route(n, type, i, state);
+        FlowTable::updateRouteTable(n);
+        return;
+    }
+#ifdef FPM_ENABLED
+    fpm_msg_hdr_t* hdr = (fpm_msg_hdr_t *) buf;
+    struct nlmsghdr* n = (struct nlmsghdr *) fpm_msg_data(hdr);
+    make_route(n, type, i, state);
+    hdr->version = FPM_PROTO_VERSION;
+    hdr->msg_type = FPM_MSG_TYPE_NETLINK;
+    hdr->msg_len = htons(fpm_data_len_to_msg_len(n->nlmsg_len));
+    FPMServer::process_fpm_msg(hdr);
+#endif /* FPM_ENABLED */
+}
+
+/* Load the table with 'resolvers' resolver threads, and report the updates
+ * per second to converge (0 if it didn't) on the descriptor 'result'. Never
+ * returns, as the pipeline threads can't be stopped. */
+static void run(bool fpm, size_t prefixes, size_t nexthops, size_t churn,
+                unsigned resolvers, int result) {
+    CapturingIPC ipc(prefixes);
+    PortState ports;
+    map<string, Interface> interfaces;
+    for (unsigned p = 0; p < NUM_PORTS; p++) {
+        char name[IFNAMSIZ];
+        snprintf(name, sizeof(name), "bench%u", p);
+        uint8_t mac[IFHWADDRLEN] = { 0x02, 0xbe, 0, 0, 0, (uint8_t) p };
+        Interface iface;
+        iface.port = p + 1;
+        iface.name = name;
+        iface.hwaddress = MACAddress(mac);
+        iface.active = true;
+        interfaces[name] = iface;
+    }
+    FlowTable::setResolverThreads(resolvers);
+    FlowTable::init(1, interfaces, &ipc, &ports);
+    boost::thread acknowledger(boost::bind(&CapturingIPC::acknowledge, &ipc));
+
+    // Messages are built in place, aligned as netlink messages would be.
+    uint32_t space[FRAME_SIZE / sizeof(uint32_t)];
+    char* buf = (char *) space;
+    struct nlmsghdr* n = (struct nlmsghdr *) buf;
+    for (unsigned p = 0; p < NUM_PORTS; p++) {
+        make_link(n, p);
+        FlowTable::updateLinkTable(NULL, n, NULL);
+    }
+    for (uint32_t g = 0; g < nexthops; g++) {
+        make_neigh(n, g);
+        FlowTable::updateHostTable(NULL, n, NULL);
+    }
+    // Start the clock once the host RouteMods for the gateways are sent.
+    ipc.waitRouteMods(nexthops);
+    size_t hostMods = ipc.getRouteMods();
+
+    // The states fed for each prefix, which the RouteMods should match
+    std::vector<uint32_t> states(prefixes, 0);
+    double start = now();
+    for (size_t i = 0; i < prefixes; i++) {
+        states[i] = prefix_state(i, i % nexthops, nexthops);
+        ipc.expect(i, states[i]);
+        feed(fpm, buf, RTM_NEWROUTE, i, states[i]);
+    }
+    size_t withdrawals = 0;
+    for (size_t c = 0; c < churn; c++) {
+        size_t i = next_rand() % prefixes;
+        uint32_t old = states[i];
+        if (old != 0 && next_rand() % 4 == 0) {
+            states[i] = 0;
+            ipc.expect(i, 0);
+            feed(fpm, buf, RTM_DELROUTE, i, old);
+            withdrawals++;
+            continue;
+        }
+
+        // Move the prefix off its gateway, or add it back.
+        uint32_t gateway = next_rand() % nexthops;
+        if (old != 0 && nexthops > 1 && gateway == (old & 0xffff) - 1) {
+            gateway = (gateway + 1) % nexthops;
+        }
+        states[i] = prefix_state(i, gateway, nexthops);
+        ipc.expect(i, states[i]);
+        feed(fpm, buf, RTM_NEWROUTE, i, states[i]);
+    }
+    double fed = now();
+    double converged = ipc.waitConverged(CONVERGE_TIMEOUT);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    size_t updates = prefixes + churn;
+    fprintf(stderr, "%s feed: %zu prefixes through %zu next hops, %zu churn "
+            "updates (%zu withdrawals), %u resolvers\n",
+            fpm ? "FPM" : "Netlink", prefixes, nexthops, churn, withdrawals,
+            resolvers);
+    fprintf(stderr, "  fed in %.0fms (%.0f updates/s)\n", (fed - start) * 1e3,
+            updates / (fed - start));
+    int status = EXIT_SUCCESS;
+    double rate = 0;
+    if (converged == 0) {
+        fprintf(stderr, "  did not converge within %us: %zu of %zu prefixes "
+                "match\n", CONVERGE_TIMEOUT, ipc.getMatched(), prefixes);
+        status = EXIT_FAILURE;
+    } else {
+        double elapsed = std::max(converged - start, 1e-9);
+        rate = updates / elapsed;
+        fprintf(stderr, "  converged in %.0fms (%.0f updates/s, %.0f "
+                "routes/s)\n", elapsed * 1e3, updates / elapsed,
+                prefixes / elapsed);
+    }
+    fprintf(stderr, "  %zu RouteMods in %zu messages (%.1f MB), peak RSS "
+            "%.1f MB\n", ipc.getRouteMods() - hostMods, ipc.getMessages(),
+            ipc.getBytes() / 1e6, usage.ru_maxrss / 1024.0);
+
+    // The pipeline threads run until the process ends, so leave without
+    // destroying the tables they use.
+    Log::stop();
+    fflush(stderr);
+    if (write(result, &rate, sizeof(rate)) != sizeof(rate)) {
+        status = EXIT_FAILURE;
+    }
+    _exit(status);
+}
+
+int main(int argc, char* argv[]) {
+    bool fpm = false;
+    size_t prefixes = DEFAULT_PREFIXES;
+    size_t nexthops = DEFAULT_NEXTHOPS;
+    size_t churn;
+    if (argc > 1) {
+        if (strcmp(argv[1], "fpm") == 0) {
+            fpm = true;
+        } else if (strcmp(argv[1], "netlink") != 0) {
+            fprintf(stderr, "Unknown feed %s: use netlink or fpm\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (argc > 2) {
+        prefixes = strtoul(argv[2], NULL, 10);
+    }
+    if (argc > 3) {
+        nexthops = strtoul(argv[3], NULL, 10);
+    }
+    churn = prefixes / 10;
+    if (argc > 4) {
+        churn = strtoul(argv[4], NULL, 10);
+    }
+    unsigned resolvers = 0;
+    if (argc > 5) {
+        resolvers = strtoul(argv[5], NULL, 10);
+    }
+#ifndef FPM_ENABLED
+    if (fpm) {
+        fprintf(stderr, "The FPM feed needs a build with FPM_ENABLED\n");
+        return EXIT_FAILURE;
+    }
+#endif /* FPM_ENABLED */
+    if (prefixes == 0 || prefixes > (1 << 22)) {
+        fprintf(stderr, "Need between 1 and %u prefixes\n", 1 << 22);
+        return EXIT_FAILURE;
+    }
+    if (nexthops == 0 || nexthops > MAX_NEXTHOPS) {
+        fprintf(stderr, "Need between 1 and %u next hops\n", MAX_NEXTHOPS);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<unsigned> counts;
+    if (resolvers > 0) {
+        counts.push_back(resolvers);
+    } else {
+        counts.assign(RESOLVER_COUNTS, RESOLVER_COUNTS +
+                      sizeof(RESOLVER_COUNTS) / sizeof(RESOLVER_COUNTS[0]));
+    }
+
+    int status = EXIT_SUCCESS;
+    std::vector<double> rates;
+    for (size_t r = 0; r < counts.size(); r++) {
+        int fds[2];
+        if (pipe(fds) < 0) {
+            perror("pipe");
+            return EXIT_FAILURE;
+        }
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return EXIT_FAILURE;
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            run(fpm, prefixes, nexthops, churn, counts[r], fds[1]);
+        }
+
+        close(fds[1]);
+        double rate = 0;
+        if (read(fds[0], &rate, sizeof(rate)) != sizeof(rate)) {
+            rate = 0;
+        }
+        close(fds[0]);
+        int exited;
+        if (waitpid(pid, &exited, 0) < 0 || !WIFEXITED(exited) ||
+                WEXITSTATUS(exited) != EXIT_SUCCESS) {
+            status = EXIT_FAILURE;
+        }
+        rates.push_back(rate);
+    }
+
+    if (counts.size() > 1) {
+        fprintf(stderr, "Resolvers  Updates/s  Speedup\n");
+        for (size_t r = 0; r < counts.size(); r++) {
+            fprintf(stderr, "%9u  %9.0f  %6.2fx\n", counts[r], rates[r],
+                    rates[0] > 0 ? rates[r] / rates[0] : 0);
+        }
+    }
+    if (status != EXIT_SUCCESS) {
+        fprintf(stderr, "ERRORS\n");
+    }
+    return status;
+}
@@ -0,0 +1,147 @@
+/*
+ * Compares host lookups through the string-keyed std::map that findHost used
+ * to search against the binary-keyed AddressMap it uses now. Both lookups take
+ * a mutex, as findHost does.
+ *
+ * Usage: HostTableBench [num_hosts] [num_lookups]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "BenchUtil.hh"
+#include "AddressMap.hh"
+#include "HostEntry.hh"
+
+#define DEFAULT_HOSTS 4096
+#define DEFAULT_LOOKUPS 10000000
+#define IPV6_SHARE 4 /* One host in IPV6_SHARE is IPv6 */
+
+static boost::mutex tableMutex;
+static std::map<string, HostEntry> stringTable;
+static AddressMap<HostEntry> addressTable;
+static const MACAddress MAC_ADDR_NONE("00:00:00:00:00:00");
+
+static IPAddress make_host(size_t i) {
+    uint8_t data[16];
+    for (int b = 0; b < 16; b += 4) {
+        uint32_t r = next_rand();
+        memcpy(data + b, &r, sizeof(r));
+    }
+
+    if (i % IPV6_SHARE == 0) {
+        data[0] = 0xfe; /* fe80::/64 */
+        data[1] = 0x80;
+        memset(data + 2, 0, 6);
+        return IPAddress(IPV6, data);
+    }
+    data[0] = 10;
+    return IPAddress(IPV4, data);
+}
+
+/* findHost() as it was before hostTable was re-keyed */
+static MACAddress find_by_string(const IPAddress& host) {
+    boost::lock_guard<boost::mutex> lock(tableMutex);
+    std::map<string, HostEntry>::iterator iter;
+    iter = stringTable.find(host.toString());
+    if (iter != stringTable.end()) {
+        return iter->second.hwaddress;
+    }
+    return MAC_ADDR_NONE;
+}
+
+/* findHost() as it is now */
+static MACAddress find_by_key(const IPAddress& host) {
+    boost::lock_guard<boost::mutex> lock(tableMutex);
+    const HostEntry* entry = addressTable.find(AddressKey(host));
+    if (entry != NULL) {
+        return entry->hwaddress;
+    }
+    return MAC_ADDR_NONE;
+}
+
+static void report(const char* stage, size_t ops, double elapsed) {
+    printf("%-12s %10zu ops %10.3f s %12.0f ops/s %8.1f ns/op\n", stage, ops,
+           elapsed, ops / elapsed, elapsed * 1e9 / ops);
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = DEFAULT_HOSTS;
+    size_t lookups = DEFAULT_LOOKUPS;
+    if (argc > 1) {
+        n = strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        lookups = strtoul(argv[2], NULL, 10);
+    }
+
+    printf("Generating %zu hosts...\n", n);
+    std::vector<HostEntry> hosts(n);
+    for (size_t i = 0; i < n; i++) {
+        uint8_t mac[IFHWADDRLEN] = { 0x02, 0, 0, 0, 0, 0 };
+        uint32_t r = next_rand();
+        memcpy(mac + 2, &r, sizeof(r));
+
+        hosts[i].address = make_host(i);
+        hosts[i].hwaddress = MACAddress(mac);
+        stringTable[hosts[i].address.toString()] = hosts[i];
+        addressTable[AddressKey(hosts[i].address)] = hosts[i];
+    }
+
+    // Mostly hits, with one lookup in eight for an unknown host.
+    std::vector<IPAddress> queries;
+    queries.reserve(lookups);
+    for (size_t i = 0; i < lookups; i++) {
+        if (i % 8 == 7) {
+            queries.push_back(make_host(i));
+        } else {
+            queries.push_back(hosts[next_rand() % n].address);
+        }
+    }
+
+    size_t string_hits = 0;
+    double start = now();
+    for (size_t i = 0; i < lookups; i++) {
+        if (!(find_by_string(queries[i]) == MAC_ADDR_NONE)) {
+            string_hits++;
+        }
+    }
+    report("std::map", lookups, now() - start);
+
+    size_t key_hits = 0;
+    start = now();
+    for (size_t i = 0; i < lookups; i++) {
+        if (!(find_by_key(queries[i]) == MAC_ADDR_NONE)) {
+            key_hits++;
+        }
+    }
+    report("AddressMap", lookups, now() - start);
+
+    // Remove every other host and check both tables still agree.
+    for (size_t i = 0; i < n; i += 2) {
+        stringTable.erase(hosts[i].address.toString());
+        addressTable.erase(AddressKey(hosts[i].address));
+    }
+    size_t mismatches = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!(find_by_string(hosts[i].address) ==
+              find_by_key(hosts[i].address))) {
+            mismatches++;
+        }
+    }
+
+    if (string_hits != key_hits || mismatches != 0 ||
+            stringTable.size() != addressTable.size()) {
+        fprintf(stderr, "Tables disagree: hits=%zu/%zu mismatches=%zu\n",
+                string_hits, key_hits, mismatches);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
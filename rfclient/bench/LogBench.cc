@@ -0,0 +1,90 @@
+/*
+ * Measures what logging costs the calling thread: the time RFLOG_INFO takes
+ * to queue a message with string and address arguments for the background
+ * thread. Messages are written in bursts that fit the thread's ring, with a
+ * pause after each for the ring to be written out.
+ *
+ * Also checks that string arguments longer than a record holds are cut short
+ * without overrunning it: once one string has filled the record's text,
+ * later ones must be logged as empty.
+ *
+ * Log messages are written to a temporary file in place of stdout, and read
+ * back for the check, so results go to stderr.
+ *
+ * Usage: LogBench [num_bursts]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <boost/thread.hpp>
+
+#include "BenchUtil.hh"
+#include "log/Log.h"
+
+#define DEFAULT_BURSTS 100
+#define BURST_SIZE (LOG_RING_SIZE / 2)
+
+/* Log two strings that together overfill a record, then a third. Returns the
+ * number of lines read back that aren't as expected. */
+static size_t check_truncation(FILE* out) {
+    std::string first(LOG_TEXT_SIZE / 2, 'a');
+    std::string second(LOG_TEXT_SIZE, 'b');
+    RFLOG_INFO("check %s|%s|%s", first, second, "tail");
+    Log::stop();
+
+    // Every string is followed by a NUL in the record.
+    std::string expected = "check " + first + "|" +
+        std::string(LOG_TEXT_SIZE - first.size() - 2, 'b') + "|\n";
+    size_t errors = 1;
+    char line[1024];
+    rewind(out);
+    while (fgets(line, sizeof(line), out) != NULL) {
+        if (strncmp(line, "check ", 6) == 0) {
+            errors = (expected == line) ? 0 : 1;
+        }
+    }
+    return errors;
+}
+
+int main(int argc, char* argv[]) {
+    size_t bursts = DEFAULT_BURSTS;
+    if (argc > 1) {
+        bursts = strtoul(argv[1], NULL, 10);
+    }
+    if (bursts == 0) {
+        fprintf(stderr, "Need at least one burst\n");
+        return EXIT_FAILURE;
+    }
+
+    FILE* out = tmpfile();
+    if (out == NULL || dup2(fileno(out), STDOUT_FILENO) < 0) {
+        fprintf(stderr, "Cannot redirect stdout\n");
+        return EXIT_FAILURE;
+    }
+
+    uint8_t addr[4] = { 10, 0, 0, 1 };
+    IPAddress ip(IPV4, addr);
+    std::string iface("eth1");
+    double elapsed = 0;
+    for (size_t b = 0; b < bursts; b++) {
+        double start = now();
+        for (size_t i = 0; i < BURST_SIZE; i++) {
+            RFLOG_INFO("netlink->RTM_NEWROUTE: net=%s, dev=%s, seq=%zu", ip,
+                       iface, i);
+        }
+        elapsed += now() - start;
+        boost::this_thread::sleep(
+            boost::posix_time::milliseconds(LOG_FLUSH_INTERVAL * 4));
+    }
+    fflush(stdout);
+
+    size_t messages = bursts * BURST_SIZE;
+    size_t errors = check_truncation(out);
+    fprintf(stderr, "%zu messages queued in %.1fms (%.0fns each)%s\n",
+            messages, elapsed * 1e3, elapsed * 1e9 / messages,
+            errors > 0 ? "  ERRORS: long strings not cut short" : "");
+    return errors > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
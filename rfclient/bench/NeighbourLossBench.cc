@@ -0,0 +1,123 @@
+/*
+ * Measures how long it takes to find the routes through a lost neighbour,
+ * using the per-gateway route index that FlowTable keeps, against scanning
+ * every route. The lost gateway has the same number of routes whatever the
+ * size of the table, so the index should take the same time at every size,
+ * while the scan grows with the table.
+ *
+ * Usage: NeighbourLossBench [num_routes] [num_dependents]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+
+#include <vector>
+
+#include "BenchUtil.hh"
+#include "GatewayIndex.hh"
+#include "PortIndex.hh"
+#include "RouteEntry.hh"
+
+#define DEFAULT_ROUTES 1000000
+#define DEFAULT_DEPENDENTS 1000
+#define NUM_GATEWAYS 256
+#define REPEATS 10
+
+static IPAddress make_gateway(uint32_t i) {
+    uint8_t gw[4] = { 172, 16, (uint8_t) (i >> 8), (uint8_t) i };
+    return IPAddress(IPV4, gw);
+}
+
+/* Host routes 0 to 'dependents' - 1 go through gateway 0, and others
+ * through the other gateways in turn. One route in four has a second path. */
+static RouteEntry make_route(size_t i, size_t dependents) {
+    uint32_t addr = htonl(0x0a000000 + (uint32_t) i);
+    RouteEntry re;
+    re.address = IPAddress(IPV4, (uint8_t*) &addr);
+    re.netmask = IPAddress(IPV4, 32);
+
+    uint32_t gateway = (i < dependents) ? 0 : 1 + i % (NUM_GATEWAYS - 1);
+    re.gateway = make_gateway(gateway);
+    re.interface.port = 1;
+    if (i % 4 == 0) {
+        re.multipath.push_back(RoutePath(re.gateway, re.interface));
+        re.multipath.push_back(RoutePath(make_gateway(1 + gateway),
+                                         re.interface));
+    }
+    return re;
+}
+
+static void bench(size_t n, size_t dependents) {
+    PortIndex<RouteEntry> routes;
+    GatewayIndex gateways;
+    for (size_t i = 0; i < n; i++) {
+        RouteEntry re = make_route(i, dependents);
+        AddressKey prefix(re.address, re.netmask.toPrefixLen());
+        std::vector<uint32_t> ports;
+        std::vector<AddressKey> keys;
+        std::vector<RoutePath> paths = re.paths();
+        for (size_t p = 0; p < paths.size(); p++) {
+            ports.push_back(paths[p].interface.port);
+            keys.push_back(AddressKey(paths[p].gateway));
+        }
+        routes.set(prefix, ports, re);
+        gateways.set(prefix, keys);
+    }
+
+    AddressKey lost(make_gateway(0));
+    std::vector<RouteEntry> found;
+
+    double start = now();
+    for (int r = 0; r < REPEATS; r++) {
+        found.clear();
+        std::vector<AddressKey> prefixes = gateways.get(lost);
+        for (size_t i = 0; i < prefixes.size(); i++) {
+            found.push_back(*routes.find(prefixes[i]));
+        }
+    }
+    double indexed = (now() - start) / REPEATS;
+    size_t indexedCount = found.size();
+
+    // All the routes are on port 1, so this copies the whole table.
+    start = now();
+    for (int r = 0; r < REPEATS; r++) {
+        found.clear();
+        std::vector<RouteEntry> all = routes.get(1);
+        for (size_t i = 0; i < all.size(); i++) {
+            std::vector<RoutePath> paths = all[i].paths();
+            for (size_t p = 0; p < paths.size(); p++) {
+                if (AddressKey(paths[p].gateway) == lost) {
+                    found.push_back(all[i]);
+                    break;
+                }
+            }
+        }
+    }
+    double scanned = (now() - start) / REPEATS;
+
+    printf("%8zu routes: %6zu dependents, index %9.3f ms, "
+           "scan %9.3f ms (%zu found)\n", n, indexedCount, indexed * 1e3,
+           scanned * 1e3, found.size());
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = DEFAULT_ROUTES;
+    size_t dependents = DEFAULT_DEPENDENTS;
+    if (argc > 1) {
+        n = strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        dependents = strtoul(argv[2], NULL, 10);
+    }
+    if (dependents > n) {
+        fprintf(stderr, "Need at least as many routes as dependents\n");
+        return EXIT_FAILURE;
+    }
+
+    for (size_t size = n / 100; size <= n; size *= 10) {
+        if (size >= dependents) {
+            bench(size, dependents);
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,348 @@
+/*
+ * Measures the cost of decoding netlink route and neighbour messages, and
+ * counts the heap allocations made per message, by replacing the global
+ * operator new. Synthetic messages are decoded three ways: into a
+ * RouteEvent/NeighEvent on the stack, as FlowTable now does before deciding
+ * whether a message is wanted, then on into the RouteEntry/HostEntry queued
+ * for accepted messages, and the way FlowTable used to decode them, with
+ * heap-allocated entries and an ether_ntoa round trip for MAC addresses.
+ *
+ * Accepted messages must be decoded and queued without allocating, so the
+ * benchmark fails if the event+entry decode makes any allocation.
+ *
+ * Usage: NetlinkParseBench [num_messages]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <arpa/inet.h>
+#include <netinet/ether.h>
+
+#include <boost/scoped_ptr.hpp>
+
+#include "BenchUtil.hh"
+#include "HostEntry.hh"
+#include "NetlinkEvent.hh"
+#include "PendingRoute.hh"
+#include "RouteEntry.hh"
+
+#define DEFAULT_MESSAGES 1000000
+#define MESSAGE_SIZE 512
+
+static size_t allocations = 0;
+
+/* The interface FlowTable would find for every path and neighbour */
+static Interface iface;
+
+void* operator new(size_t size) throw (std::bad_alloc) {
+    allocations++;
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) throw (std::bad_alloc) {
+    return operator new(size);
+}
+
+void operator delete(void* p) throw () {
+    free(p);
+}
+
+void operator delete[](void* p) throw () {
+    free(p);
+}
+
+/* An attribute appended to a message, as addattr_l would */
+static void add_attr(struct nlmsghdr* n, int type, const void* data,
+                     int len) {
+    struct rtattr* rta = (struct rtattr *) ((char *) n +
+                                            NLMSG_ALIGN(n->nlmsg_len));
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH(len);
+    memcpy(RTA_DATA(rta), data, len);
+    n->nlmsg_len = NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+/* A route to 10.x.y.0/24, through two next hops if 'multipath' is set */
+static void make_route(struct nlmsghdr* n, uint32_t i, bool multipath) {
+    memset(n, 0, MESSAGE_SIZE);
+    n->nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+    n->nlmsg_type = RTM_NEWROUTE;
+
+    struct rtmsg* rtm = (struct rtmsg *) NLMSG_DATA(n);
+    rtm->rtm_family = AF_INET;
+    rtm->rtm_dst_len = 24;
+    rtm->rtm_table = RT_TABLE_MAIN;
+    rtm->rtm_type = RTN_UNICAST;
+
+    uint32_t dst = htonl(0x0a000000 | ((i & 0xffff) << 8));
+    add_attr(n, RTA_DST, &dst, sizeof(dst));
+    if (!multipath) {
+        uint32_t gw = htonl(0xac100001);
+        int oif = 2;
+        add_attr(n, RTA_GATEWAY, &gw, sizeof(gw));
+        add_attr(n, RTA_OIF, &oif, sizeof(oif));
+        return;
+    }
+
+    char buf[128];
+    int len = 0;
+    for (int p = 0; p < 2; p++) {
+        struct rtnexthop* rtnh = (struct rtnexthop *) (buf + len);
+        rtnh->rtnh_flags = 0;
+        rtnh->rtnh_hops = 0;
+        rtnh->rtnh_ifindex = 2 + p;
+
+        struct rtattr* attr = RTNH_DATA(rtnh);
+        uint32_t gw = htonl(0xac100001 + (p << 8));
+        attr->rta_type = RTA_GATEWAY;
+        attr->rta_len = RTA_LENGTH(sizeof(gw));
+        memcpy(RTA_DATA(attr), &gw, sizeof(gw));
+
+        rtnh->rtnh_len = sizeof(*rtnh) + attr->rta_len;
+        len += RTNH_ALIGN(rtnh->rtnh_len);
+    }
+    add_attr(n, RTA_MULTIPATH, buf, len);
+}
+
+static void make_neigh(struct nlmsghdr* n, uint32_t i) {
+    memset(n, 0, MESSAGE_SIZE);
+    n->nlmsg_len = NLMSG_LENGTH(sizeof(struct ndmsg));
+    n->nlmsg_type = RTM_NEWNEIGH;
+
+    struct ndmsg* ndm = (struct ndmsg *) NLMSG_DATA(n);
+    ndm->ndm_family = AF_INET;
+    ndm->ndm_ifindex = 2;
+    ndm->ndm_state = NUD_REACHABLE;
+
+    uint32_t dst = htonl(0xac100000 | (i & 0xffff));
+    uint8_t mac[IFHWADDRLEN] = { 0x02, 0, 0, 0, (uint8_t) (i >> 8),
+                                 (uint8_t) i };
+    add_attr(n, NDA_DST, &dst, sizeof(dst));
+    add_attr(n, NDA_LLADDR, mac, sizeof(mac));
+}
+
+/* The route decode FlowTable used to do, minus interface lookups */
+static int legacy_route(struct nlmsghdr* n) {
+    struct rtmsg* rtmsg_ptr = (struct rtmsg *) NLMSG_DATA(n);
+    boost::scoped_ptr<RouteEntry> rentry(new RouteEntry());
+    int version = (rtmsg_ptr->rtm_family == AF_INET6) ? IPV6 : IPV4;
+    rentry->address = IPAddress(version, 0);
+
+    struct rtattr* rtattr_ptr = (struct rtattr *) RTM_RTA(rtmsg_ptr);
+    int rtmsg_len = RTM_PAYLOAD(n);
+    for (; RTA_OK(rtattr_ptr, rtmsg_len);
+            rtattr_ptr = RTA_NEXT(rtattr_ptr, rtmsg_len)) {
+        switch (rtattr_ptr->rta_type) {
+        case RTA_DST:
+            rentry->address = IPAddress(
+                (const struct in_addr *) RTA_DATA(rtattr_ptr));
+            if (rentry->address.toString() == "") {
+                return -1;
+            }
+            break;
+        case RTA_GATEWAY:
+            rentry->gateway = IPAddress(
+                (const struct in_addr *) RTA_DATA(rtattr_ptr));
+            if (rentry->gateway.toString() == "") {
+                return -1;
+            }
+            break;
+        case RTA_MULTIPATH: {
+            struct rtnexthop* rtnh = (struct rtnexthop *) RTA_DATA(rtattr_ptr);
+            int rtnh_len = RTA_PAYLOAD(rtattr_ptr);
+            for (; RTNH_OK(rtnh, rtnh_len);
+                    rtnh_len -= RTNH_ALIGN(rtnh->rtnh_len),
+                    rtnh = RTNH_NEXT(rtnh)) {
+                RoutePath path;
+                path.weight = rtnh->rtnh_hops + 1;
+                int attrlen = rtnh->rtnh_len - sizeof(struct rtnexthop);
+                struct rtattr* attr = RTNH_DATA(rtnh);
+                for (; RTA_OK(attr, attrlen); attr = RTA_NEXT(attr, attrlen)) {
+                    if (attr->rta_type == RTA_GATEWAY) {
+                        path.gateway = IPAddress(
+                            (const struct in_addr *) RTA_DATA(attr));
+                        if (path.gateway.toString() == "") {
+                            return -1;
+                        }
+                        break;
+                    }
+                }
+                rentry->multipath.push_back(path);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    rentry->netmask = IPAddress(version, rtmsg_ptr->rtm_dst_len);
+    return rentry->netmask.toPrefixLen();
+}
+
+/* The neighbour decode FlowTable used to do, minus interface lookups */
+static int legacy_neigh(struct nlmsghdr* n) {
+    struct ndmsg* ndmsg_ptr = (struct ndmsg *) NLMSG_DATA(n);
+    boost::scoped_ptr<HostEntry> hentry(new HostEntry());
+    char mac[2 * IFHWADDRLEN + 5 + 1];
+    memset(mac, 0, sizeof(mac));
+
+    struct rtattr* rtattr_ptr = (struct rtattr *) RTM_RTA(ndmsg_ptr);
+    int rtmsg_len = RTM_PAYLOAD(n);
+    for (; RTA_OK(rtattr_ptr, rtmsg_len);
+            rtattr_ptr = RTA_NEXT(rtattr_ptr, rtmsg_len)) {
+        switch (rtattr_ptr->rta_type) {
+        case NDA_DST:
+            hentry->address = IPAddress(
+                (const struct in_addr *) RTA_DATA(rtattr_ptr));
+            if (hentry->address.toString() == "") {
+                return -1;
+            }
+            break;
+        case NDA_LLADDR:
+            strncpy(mac, ether_ntoa((ether_addr *) RTA_DATA(rtattr_ptr)),
+                    sizeof(mac));
+            break;
+        default:
+            break;
+        }
+    }
+    hentry->hwaddress = MACAddress(mac);
+    return strlen(mac) == 0 ? -1 : 0;
+}
+
+static int event_route(struct nlmsghdr* n) {
+    RouteEvent ev;
+    if (parseRouteEvent(n, ev) < 0) {
+        return -1;
+    }
+    return ev.dst_len + ev.npaths;
+}
+
+static int event_neigh(struct nlmsghdr* n) {
+    NeighEvent ev;
+    if (parseNeighEvent(n, ev) < 0 || !ev.has_lladdr) {
+        return -1;
+    }
+    return ev.ifindex;
+}
+
+/* The event decode, followed by the entry FlowTable builds from it and the
+ * update it queues */
+static int entry_route(struct nlmsghdr* n) {
+    RouteEvent ev;
+    if (parseRouteEvent(n, ev) < 0) {
+        return -1;
+    }
+    RouteEntry rentry;
+    rentry.address = IPAddress(IPV4, ev.dst);
+    rentry.netmask = IPAddress(IPV4, (int) ev.dst_len);
+    if (ev.paths[0].has_gateway) {
+        rentry.gateway = IPAddress(IPV4, ev.paths[0].gateway);
+    }
+    rentry.interface = iface;
+    if (ev.multipath) {
+        rentry.multipath.reserve(ev.npaths);
+        for (unsigned i = 0; i < ev.npaths; i++) {
+            RoutePath path;
+            path.gateway = IPAddress(IPV4, ev.paths[i].gateway);
+            path.interface = iface;
+            path.weight = ev.paths[i].weight;
+            rentry.multipath.push_back(path);
+        }
+    }
+    PendingRoute pr(RMT_ADD, rentry);
+    return pr.entry.netmask.toPrefixLen();
+}
+
+static int entry_neigh(struct nlmsghdr* n) {
+    NeighEvent ev;
+    if (parseNeighEvent(n, ev) < 0 || !ev.has_lladdr) {
+        return -1;
+    }
+    HostEntry hentry;
+    hentry.address = IPAddress(IPV4, ev.addr);
+    hentry.interface = iface;
+    hentry.hwaddress = MACAddress(ev.lladdr);
+    return 0;
+}
+
+typedef int (*decoder_t)(struct nlmsghdr* n);
+
+/* Returns the number of allocations made */
+static size_t run(const char* label, decoder_t decode,
+                  const std::vector<struct nlmsghdr*>& msgs, size_t n) {
+    size_t failed = 0;
+    size_t before = allocations;
+    double start = now();
+    for (size_t i = 0; i < n; i++) {
+        if (decode(msgs[i % msgs.size()]) < 0) {
+            failed++;
+        }
+    }
+    double elapsed = now() - start;
+    size_t allocs = allocations - before;
+
+    printf("%-14s %9zu msgs %8.1f ns/msg %6.2f allocs/msg%s\n", label, n,
+           elapsed * 1e9 / n, (double) allocs / n,
+           failed > 0 ? " (decode failures!)" : "");
+    return allocs;
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = DEFAULT_MESSAGES;
+    if (argc > 1) {
+        n = strtoul(argv[1], NULL, 10);
+    }
+    if (n == 0) {
+        fprintf(stderr, "Need at least one message\n");
+        return EXIT_FAILURE;
+    }
+
+    uint8_t mac[IFHWADDRLEN] = { 0x02, 0, 0, 0, 0, 0x02 };
+    iface.port = 1;
+    iface.name = "eth2";
+    iface.ifindex = 2;
+    iface.hwaddress = MACAddress(mac);
+    iface.active = true;
+
+    // A working set of messages small enough to stay in cache, so that the
+    // decoding itself is measured.
+    const size_t WORKING_SET = 256;
+    std::vector<struct nlmsghdr*> routes;
+    std::vector<struct nlmsghdr*> multipath;
+    std::vector<struct nlmsghdr*> neighs;
+    for (uint32_t i = 0; i < WORKING_SET; i++) {
+        routes.push_back((struct nlmsghdr *) calloc(1, MESSAGE_SIZE));
+        make_route(routes.back(), i, false);
+        multipath.push_back((struct nlmsghdr *) calloc(1, MESSAGE_SIZE));
+        make_route(multipath.back(), i, true);
+        neighs.push_back((struct nlmsghdr *) calloc(1, MESSAGE_SIZE));
+        make_neigh(neighs.back(), i);
+    }
+
+    size_t accepted = 0;
+    printf("Routes (one path):\n");
+    run("  legacy", legacy_route, routes, n);
+    run("  event", event_route, routes, n);
+    accepted += run("  event+entry", entry_route, routes, n);
+    printf("Routes (two paths):\n");
+    run("  legacy", legacy_route, multipath, n);
+    run("  event", event_route, multipath, n);
+    accepted += run("  event+entry", entry_route, multipath, n);
+    printf("Neighbours:\n");
+    run("  legacy", legacy_neigh, neighs, n);
+    run("  event", event_neigh, neighs, n);
+    accepted += run("  event+entry", entry_neigh, neighs, n);
+
+    if (accepted > 0) {
+        printf("ERRORS: %zu allocations decoding accepted messages\n",
+               accepted);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,155 @@
+/*
+ * Measures how long it takes to withdraw, and then reinstall, every route
+ * through a port that is reset, using the per-port route index that FlowTable
+ * keeps. RouteMods are serialised and counted by an IPCMessageService that
+ * stands in for RFServer, once with RouteModBatcher's usual batch size and
+ * once sending each RouteMod on its own.
+ *
+ * Usage: PortResetBench [num_routes] [num_ports]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include <vector>
+
+#include "BenchUtil.hh"
+#include "defs.h"
+#include "PortIndex.hh"
+#include "RouteEntry.hh"
+#include "RouteModBatcher.hh"
+
+#define DEFAULT_ROUTES 100000
+#define DEFAULT_PORTS 16
+#define MULTIPATH_SHARE 8 /* One route in MULTIPATH_SHARE has two paths */
+
+/* Serialises every message as MongoIPC would, without sending it */
+class CountingIPC : public IPCMessageService {
+    public:
+        size_t messages;
+        size_t bytes;
+
+        CountingIPC() : messages(0), bytes(0) {}
+
+        void listen(const string&, IPCMessageFactory*, IPCMessageProcessor*,
+                    bool) {
+        }
+
+        bool send(const string&, const string&, IPCMessage& msg) {
+            const char* data = msg.to_BSON();
+            int32_t size;
+            memcpy(&size, data, sizeof(size));
+            delete[] data;
+
+            this->messages++;
+            this->bytes += size;
+            return true;
+        }
+};
+
+static RoutePath make_path(uint32_t port) {
+    uint8_t gw[4] = { 172, 16, (uint8_t) port, 1 };
+    RoutePath path;
+    path.gateway = IPAddress(IPV4, gw);
+    path.interface.port = port;
+    path.weight = 1;
+    return path;
+}
+
+static RouteEntry make_route(size_t i, size_t num_ports) {
+    uint32_t addr = htonl(0x0a000000 | ((uint32_t) i << 8));
+    RouteEntry re;
+    re.address = IPAddress(IPV4, (uint8_t*) &addr);
+    re.netmask = IPAddress(IPV4, 24);
+
+    uint32_t port = 1 + next_rand() % num_ports;
+    RoutePath path = make_path(port);
+    re.gateway = path.gateway;
+    re.interface = path.interface;
+
+    if (i % MULTIPATH_SHARE == 0) {
+        re.multipath.push_back(path);
+        re.multipath.push_back(make_path(1 + port % num_ports));
+    }
+    return re;
+}
+
+/* The RouteMod FlowTable sends for a route through a single next hop */
+static RouteMod make_route_mod(RouteModType mod, const RouteEntry& re) {
+    RouteMod rm;
+    rm.set_mod(mod);
+    rm.set_id(1);
+    rm.add_match(Match(RFMT_IPV4, re.address, re.netmask));
+    rm.add_option(Option(RFOT_PRIORITY, (uint16_t) (PRIORITY_LOW +
+                  re.netmask.toPrefixLen() * PRIORITY_BAND)));
+    rm.add_action(Action(RFAT_GROUP, (uint32_t) re.interface.port));
+    rm.add_action(Action(RFAT_OUTPUT, (uint32_t) re.interface.port));
+    return rm;
+}
+
+static void reset_port(const PortIndex<RouteEntry>& index, uint32_t port,
+                       RouteModBatcher& batcher, CountingIPC& ipc,
+                       const char* label) {
+    const RouteModType mods[] = { RMT_DELETE, RMT_ADD };
+    const char* stages[] = { "withdraw", "reinstall" };
+    for (int s = 0; s < 2; s++) {
+        double start = now();
+        std::vector<RouteEntry> routes = index.get(port);
+        std::vector<RouteEntry>::iterator it;
+        for (it = routes.begin(); it != routes.end(); it++) {
+            batcher.add(make_route_mod(mods[s], *it));
+        }
+        batcher.flush();
+        double elapsed = now() - start;
+
+        printf("%-10s %-9s %8zu routes %7zu msgs %9zu bytes %9.3f ms "
+               "%11.0f routes/s\n", label, stages[s], routes.size(),
+               ipc.messages, ipc.bytes, elapsed * 1e3,
+               routes.size() / elapsed);
+        ipc.messages = 0;
+        ipc.bytes = 0;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = DEFAULT_ROUTES;
+    size_t num_ports = DEFAULT_PORTS;
+    if (argc > 1) {
+        n = strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        num_ports = strtoul(argv[2], NULL, 10);
+    }
+    if (num_ports == 0) {
+        fprintf(stderr, "Need at least one port\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("Indexing %zu routes over %zu ports...\n", n, num_ports);
+    PortIndex<RouteEntry> index;
+    double start = now();
+    for (size_t i = 0; i < n; i++) {
+        RouteEntry re = make_route(i, num_ports);
+        std::vector<uint32_t> ports;
+        std::vector<RoutePath> paths = re.paths();
+        for (size_t p = 0; p < paths.size(); p++) {
+            ports.push_back(paths[p].interface.port);
+        }
+        index.set(AddressKey(re.address, re.netmask.toPrefixLen()), ports,
+                  re);
+    }
+    printf("Indexed in %.3f ms\n", (now() - start) * 1e3);
+
+    // The batchers' flusher threads run until exit, so they outlive main().
+    static CountingIPC ipc;
+    static RouteModBatcher batched;
+    static RouteModBatcher unbatched;
+    batched.start(&ipc, 1, ROUTE_MOD_BATCH_SIZE);
+    unbatched.start(&ipc, 1, 1);
+
+    reset_port(index, 1, batched, ipc, "batched");
+    reset_port(index, 1, unbatched, ipc, "unbatched");
+
+    return EXIT_SUCCESS;
+}
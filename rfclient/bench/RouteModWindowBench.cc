@@ -0,0 +1,166 @@
+/*
+ * Measures how the size of the RouteModWindow paces a resolver sending
+ * RouteMods to a datapath that takes a fixed time to acknowledge each one,
+ * but can have many in progress at once. Size 1 is stop-and-wait: every
+ * RouteMod waits for the one before it to be acknowledged. Larger windows
+ * keep that many RouteMods in flight, up to what the datapath can install.
+ *
+ * The datapath acknowledges every RouteMod once, in order, and the window
+ * reports the latencies it measured. One RouteMod in FAIL_EVERY fails, and
+ * is checked to still be the latest for its prefix.
+ *
+ * Usage: RouteModWindowBench [num_routes] [ack_latency_us] [install_us]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <deque>
+#include <utility>
+#include <boost/thread.hpp>
+
+#include "BenchUtil.hh"
+#include "RouteModWindow.hh"
+
+#define DEFAULT_ROUTES 20000
+#define DEFAULT_LATENCY_US 2000
+#define DEFAULT_INSTALL_US 5
+#define FAIL_EVERY 1000
+
+/* A datapath that acknowledges each RouteMod 'latency' seconds after it was
+ * sent, and spends 'install' seconds on each. */
+class Datapath {
+    public:
+        Datapath(RouteModWindow* window, double latency, double install)
+            : window(window), latency(latency), install(install),
+              done(false), acked(0), errors(0) {}
+
+        void send(uint64_t seq) {
+            boost::lock_guard<boost::mutex> lock(this->mutex);
+            this->sent.push_back(std::make_pair(seq, now()));
+            this->cond.notify_one();
+        }
+
+        void stop() {
+            boost::lock_guard<boost::mutex> lock(this->mutex);
+            this->done = true;
+            this->cond.notify_one();
+        }
+
+        void run() {
+            while (true) {
+                std::pair<uint64_t, double> rm;
+                {
+                    boost::unique_lock<boost::mutex> lock(this->mutex);
+                    while (this->sent.empty() && !this->done) {
+                        this->cond.wait(lock);
+                    }
+                    if (this->sent.empty()) {
+                        return;
+                    }
+                    rm = this->sent.front();
+                    this->sent.pop_front();
+                }
+
+                double due = rm.second + this->latency;
+                while (now() < due) {
+                    boost::this_thread::sleep(
+                        boost::posix_time::microseconds(
+                            (long) ((due - now()) * 1e6) + 1));
+                }
+                double installed = now() + this->install;
+                while (now() < installed) {
+                }
+
+                RouteModStatus status = RMS_SUCCESS;
+                if (rm.first % FAIL_EVERY == 0) {
+                    status = RMS_FAILED;
+                }
+                SentRouteMod closed;
+                if (!this->window->close(rm.first, status, false, closed) ||
+                        closed.seq != rm.first ||
+                        (status == RMS_FAILED &&
+                         !this->window->isLatest(closed))) {
+                    this->errors++;
+                }
+                this->acked++;
+            }
+        }
+
+        size_t getAcked() const { return this->acked; }
+        size_t getErrors() const { return this->errors; }
+
+    private:
+        RouteModWindow* window;
+        double latency;
+        double install;
+        boost::mutex mutex;
+        boost::condition_variable cond;
+        std::deque< std::pair<uint64_t, double> > sent;
+        bool done;
+        size_t acked;
+        size_t errors;
+};
+
+static size_t run(size_t size, size_t routes, double latency,
+                  double install) {
+    RouteModWindow window;
+    window.setSize(size);
+    Datapath dp(&window, latency, install);
+    boost::thread datapath(boost::bind(&Datapath::run, &dp));
+
+    double start = now();
+    for (size_t i = 0; i < routes; i++) {
+        uint32_t addr = htonl(0x0a000000 + (i << 8));
+        SentRouteMod sent;
+        sent.keyed = true;
+        sent.prefix = AddressKey(IPAddress(IPV4, (uint8_t*) &addr), 24);
+        dp.send(window.open(sent, true));
+    }
+    dp.stop();
+    datapath.join();
+    double elapsed = now() - start;
+
+    RouteModWindowStats stats = window.stats();
+    size_t errors = dp.getErrors();
+    if (dp.getAcked() != routes || stats.acked + stats.failed != routes ||
+            window.pending() != 0) {
+        errors++;
+    }
+    printf("window %-5zu %zu routes in %.0fms (%.0f routes/s), latency "
+           "mean %.0fus, max %.0fus, %lu failed%s\n", size, routes,
+           elapsed * 1e3, routes / elapsed,
+           stats.acked > 0 ? (double) stats.latencySum / stats.acked : 0.0,
+           (double) stats.latencyMax, stats.failed,
+           errors > 0 ? "  ERRORS" : "");
+    return errors;
+}
+
+int main(int argc, char* argv[]) {
+    size_t routes = DEFAULT_ROUTES;
+    double latency = DEFAULT_LATENCY_US / 1e6;
+    double install = DEFAULT_INSTALL_US / 1e6;
+    if (argc > 1) {
+        routes = strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        latency = strtoul(argv[2], NULL, 10) / 1e6;
+    }
+    if (argc > 3) {
+        install = strtoul(argv[3], NULL, 10) / 1e6;
+    }
+    if (routes == 0 || routes > (1 << 24)) {
+        fprintf(stderr, "Need between 1 and %u routes\n", 1 << 24);
+        return EXIT_FAILURE;
+    }
+
+    static const size_t sizes[] = { 1, 16, 256, ROUTE_MOD_WINDOW };
+    size_t errors = 0;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        // Stop-and-wait would take minutes over the full table.
+        size_t n = (sizes[i] == 1) ? std::min(routes, (size_t) 1000) : routes;
+        errors += run(sizes[i], n, latency, install);
+    }
+    return errors > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
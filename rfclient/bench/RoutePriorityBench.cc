@@ -0,0 +1,177 @@
+/*
+ * Measures how long urgent route updates wait in a RouteQueue while a full
+ * table of bulk routes is being loaded. One producer queues the bulk routes
+ * as fast as it can, another queues a withdrawal every millisecond, and the
+ * resolver does a little work per update. The same run is done with every
+ * update in one class, as when pendingRoutes was a single FIFO.
+ *
+ * The resolver checks that every bulk route and every withdrawal comes out
+ * exactly once, and reports the time taken to load the table and how long
+ * the withdrawals queued during the load waited to be taken.
+ *
+ * Usage: RoutePriorityBench [num_routes] [flap_window_ms]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <vector>
+#include <boost/thread.hpp>
+
+#include "BenchUtil.hh"
+#include "RouteQueue.hh"
+
+#define DEFAULT_ROUTES 1000000
+#define WITHDRAW_INTERVAL_US 1000
+// Work done by the resolver for each update, in loop iterations
+#define RESOLVER_WORK 1000
+
+/* Bulk route 'i' is a /24 in 10.0.0.0/8 and up, numbered in its port.
+ * Withdrawal 'i' is for a /32 in 192.168.0.0/16. */
+static PendingRoute make_route(uint32_t i) {
+    uint32_t addr = htonl(0x0a000000 + (i << 8));
+    PendingRoute pr;
+    pr.entry.address = IPAddress(IPV4, (uint8_t*) &addr);
+    pr.entry.netmask = IPAddress(IPV4, 24);
+    pr.entry.interface.port = i;
+    pr.priority = ROUTE_CLASS_BULK;
+    return pr;
+}
+
+static PendingRoute make_withdrawal(uint32_t i, bool classes) {
+    uint32_t addr = htonl(0xc0a80000 + i);
+    RouteEntry re;
+    re.address = IPAddress(IPV4, (uint8_t*) &addr);
+    re.netmask = IPAddress(IPV4, 32);
+    re.interface.port = i;
+    PendingRoute pr(RMT_DELETE, re);
+    if (!classes) {
+        pr.priority = ROUTE_CLASS_BULK;
+    }
+    return pr;
+}
+
+static void load(RouteQueue* queue, size_t routes) {
+    for (size_t i = 0; i < routes; i++) {
+        queue->push(make_route(i));
+    }
+}
+
+static void withdraw(RouteQueue* queue, std::vector<double>* queued,
+                     bool classes, volatile bool* done) {
+    for (size_t i = 0; i < queued->size() && !*done; i++) {
+        (*queued)[i] = now();
+        queue->push(make_withdrawal(i, classes));
+        boost::this_thread::sleep(
+            boost::posix_time::microseconds(WITHDRAW_INTERVAL_US));
+    }
+}
+
+static double percentile(std::vector<double>& v, double p) {
+    size_t i = (size_t) (p * (v.size() - 1));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+static size_t run(const char* label, size_t routes, unsigned window,
+                  bool classes) {
+    RouteQueue queue(MPSC_RING_CAPACITY, RING_COALESCE, window);
+    // Enough withdrawals to go on for as long as the load could take
+    std::vector<double> queued(routes / 100 + 1000, 0);
+    std::vector<double> waited;
+    std::vector<bool> seenRoute(routes, false);
+    std::vector<bool> seenWithdrawal(queued.size(), false);
+    volatile bool done = false;
+    size_t errors = 0;
+
+    double start = now();
+    boost::thread loader(boost::bind(&load, &queue, routes));
+    boost::thread withdrawer(boost::bind(&withdraw, &queue, &queued,
+                                         classes, &done));
+
+    // Once the table is loaded, stop queueing withdrawals, and take the
+    // rest of those queued.
+    std::vector<PendingRoute> batch;
+    size_t loaded = 0;
+    size_t withdrawals = queued.size();
+    double finished = 0;
+    volatile unsigned sink = 0;
+    while (loaded < routes || waited.size() < withdrawals) {
+        if (loaded == routes && !done) {
+            finished = now();
+            done = true;
+            withdrawer.join();
+            withdrawals = queued.size() - std::count(queued.begin(),
+                                                     queued.end(), 0.0);
+            continue;
+        }
+
+        batch.clear();
+        size_t dropped;
+        queue.take(batch, dropped);
+        errors += dropped;
+        double taken = now();
+        std::vector<PendingRoute>::iterator it;
+        for (it = batch.begin(); it != batch.end(); it++) {
+            uint32_t i = it->entry.interface.port;
+            if (it->mod == RMT_DELETE) {
+                if (i >= seenWithdrawal.size() || seenWithdrawal[i]) {
+                    errors++;
+                    continue;
+                }
+                seenWithdrawal[i] = true;
+                waited.push_back(taken - queued[i]);
+            } else {
+                if (i >= routes || seenRoute[i]) {
+                    errors++;
+                    continue;
+                }
+                seenRoute[i] = true;
+                loaded++;
+            }
+            for (unsigned w = 0; w < RESOLVER_WORK; w++) {
+                sink = sink + w;
+            }
+        }
+    }
+    loader.join();
+
+    if (waited.empty()) {
+        printf("%-8s no withdrawals were taken\n", label);
+        return errors + 1;
+    }
+    double mean = 0;
+    for (size_t i = 0; i < waited.size(); i++) {
+        mean += waited[i];
+    }
+    mean /= waited.size();
+    double max = *std::max_element(waited.begin(), waited.end());
+    printf("%-8s %zu routes in %.0fms (%.0f routes/s), %zu withdrawals "
+           "waited mean %.1fms, p50 %.1fms, p99 %.1fms, max %.1fms%s\n",
+           label, routes, (finished - start) * 1e3,
+           routes / (finished - start), waited.size(), mean * 1e3,
+           percentile(waited, 0.5) * 1e3, percentile(waited, 0.99) * 1e3,
+           max * 1e3, errors > 0 ? "  LOSS/DUPLICATE ERRORS" : "");
+    return errors;
+}
+
+int main(int argc, char* argv[]) {
+    size_t routes = DEFAULT_ROUTES;
+    unsigned window = ROUTE_FLAP_WINDOW;
+    if (argc > 1) {
+        routes = strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        window = strtoul(argv[2], NULL, 10);
+    }
+    if (routes == 0 || routes > (1 << 24)) {
+        fprintf(stderr, "Need between 1 and %u routes\n", 1 << 24);
+        return EXIT_FAILURE;
+    }
+
+    size_t errors = 0;
+    errors += run("fifo", routes, window, false);
+    errors += run("classes", routes, window, true);
+    return errors > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,255 @@
+/*
+ * Measures how fast route updates pass from several producer threads to one
+ * consumer, through MPSCRing under each of its policies, and through a
+ * std::list behind a mutex and condition variable popping one update per
+ * lock, as pendingRoutes used to. The consumer takes updates in batches of
+ * ROUTE_QUEUE_BATCH, and does a little work per update, so that the queue
+ * fills up under a storm.
+ *
+ * Each producer updates its own prefixes in turn, numbering the updates to
+ * each prefix. The consumer checks that the updates to each prefix arrive in
+ * order, that none are lost with RING_BLOCK, that every prefix ends with its
+ * last update with RING_COALESCE, and that every update was either popped or
+ * displaced. RING_BLOCK is also run with the first producer pushing without
+ * waiting, as the timer and IPC threads do, so that its updates are coalesced
+ * while the ring is full rather than held back, or dropped once as many are
+ * held aside as the ring holds, so only the prefixes of the other producers
+ * must end with their last update. No ring may ever hold more than twice its
+ * capacity.
+ *
+ * Usage: RouteQueueBench [num_updates] [num_producers] [capacity]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+
+#include <list>
+#include <vector>
+#include <boost/thread.hpp>
+
+#include "BenchUtil.hh"
+#include "MPSCRing.hh"
+#include "PendingRoute.hh"
+
+#define DEFAULT_UPDATES 1000000
+#define DEFAULT_PRODUCERS 4
+#define DEFAULT_CAPACITY 4096
+#define ROUTE_QUEUE_BATCH 256
+#define PREFIXES_PER_PRODUCER 1000
+// Work done by the consumer for each update, in loop iterations
+#define CONSUMER_WORK 200
+
+/* The update numbered 'seq' (from 1) to prefix 'prefix' of 'producer'. The
+ * number is carried as the route's port. */
+static PendingRoute make_update(size_t producer, size_t prefix,
+                                uint32_t seq) {
+    uint32_t addr = htonl(0x0a000000 |
+                          ((producer * PREFIXES_PER_PRODUCER + prefix) << 8));
+    PendingRoute pr;
+    pr.entry.address = IPAddress(IPV4, (uint8_t*) &addr);
+    pr.entry.netmask = IPAddress(IPV4, 24);
+    pr.entry.interface.port = seq;
+    return pr;
+}
+
+static size_t prefix_index(const PendingRoute& pr) {
+    uint8_t addr[4];
+    pr.entry.address.toArray(addr);
+    return (addr[1] << 8) | addr[2];
+}
+
+/* The queue pendingRoutes used before MPSCRing */
+class ListQueue {
+    public:
+        size_t push(const PendingRoute& pr, bool) {
+            boost::unique_lock<boost::mutex> lock(this->mutex);
+            bool empty = this->queue.empty();
+            this->queue.push_back(pr);
+            lock.unlock();
+            if (empty) {
+                this->condition.notify_one();
+            }
+            return 0;
+        }
+
+        size_t wait_pop_batch(std::vector<PendingRoute>& out, size_t,
+                              const boost::system_time& deadline) {
+            boost::unique_lock<boost::mutex> lock(this->mutex);
+            while (this->queue.empty()) {
+                if (!this->condition.timed_wait(lock, deadline)) {
+                    return 0;
+                }
+            }
+            out.push_back(this->queue.front());
+            this->queue.pop_front();
+            return 1;
+        }
+
+    private:
+        std::list<PendingRoute> queue;
+        boost::mutex mutex;
+        boost::condition_variable condition;
+};
+
+struct Result {
+    size_t popped;
+    size_t displaced;
+    size_t errors;
+};
+
+template<typename Queue>
+static void produce(Queue* queue, size_t producer, size_t updates,
+                    bool wait, size_t* displaced) {
+    for (size_t i = 0; i < updates; i++) {
+        size_t prefix = i % PREFIXES_PER_PRODUCER;
+        uint32_t seq = 1 + i / PREFIXES_PER_PRODUCER;
+        size_t count = queue->push(make_update(producer, prefix, seq),
+                                   wait);
+        if (count > 0) {
+            __sync_add_and_fetch(displaced, count);
+        }
+    }
+}
+
+template<typename Queue>
+static Result run(Queue& queue, const char* label, size_t n,
+                  size_t producers, bool lossless, bool coalesced,
+                  bool firstWaits = true) {
+    size_t perProducer = n / producers;
+    size_t prefixes = producers * PREFIXES_PER_PRODUCER;
+    std::vector<uint32_t> last(prefixes, 0);
+    std::vector<size_t> displaced(producers, 0);
+
+    Result r = { 0, 0, 0 };
+    double start = now();
+    boost::thread_group threads;
+    for (size_t p = 0; p < producers; p++) {
+        threads.create_thread(boost::bind(&produce<Queue>, &queue, p,
+                                          perProducer, firstWaits || p > 0,
+                                          &displaced[p]));
+    }
+
+    std::vector<PendingRoute> batch;
+    batch.reserve(ROUTE_QUEUE_BATCH);
+    volatile unsigned sink = 0;
+    size_t total = perProducer * producers;
+    while (true) {
+        size_t accounted = r.popped;
+        for (size_t p = 0; p < producers; p++) {
+            accounted += __atomic_load_n(&displaced[p], __ATOMIC_RELAXED);
+        }
+        if (accounted >= total) {
+            break;
+        }
+
+        // Wake up now and then to see whether every update is accounted
+        // for, as the last ones may have been displaced.
+        batch.clear();
+        boost::system_time deadline = boost::get_system_time() +
+                                      boost::posix_time::milliseconds(10);
+        if (queue.wait_pop_batch(batch, ROUTE_QUEUE_BATCH, deadline) == 0) {
+            continue;
+        }
+        for (size_t i = 0; i < batch.size(); i++) {
+            size_t prefix = prefix_index(batch[i]);
+            uint32_t seq = batch[i].entry.interface.port;
+            if (seq <= last[prefix] ||
+                    (lossless && seq != last[prefix] + 1)) {
+                r.errors++;
+            }
+            last[prefix] = seq;
+            for (unsigned w = 0; w < CONSUMER_WORK; w++) {
+                sink = sink + w;
+            }
+        }
+        r.popped += batch.size();
+    }
+    threads.join_all();
+    double elapsed = now() - start;
+
+    for (size_t p = 0; p < producers; p++) {
+        r.displaced += displaced[p];
+    }
+    if (r.popped + r.displaced != total) {
+        r.errors++;
+    }
+    if (coalesced) {
+        // The first producer's last updates may be dropped if it never
+        // waits.
+        size_t i = firstWaits ? 0 : PREFIXES_PER_PRODUCER;
+        for (; i < prefixes; i++) {
+            size_t prefix = i % PREFIXES_PER_PRODUCER;
+            size_t updates = (prefix < perProducer)
+                ? (perProducer - prefix + PREFIXES_PER_PRODUCER - 1) /
+                  PREFIXES_PER_PRODUCER : 0;
+            if (last[i] != updates) {
+                r.errors++;
+            }
+        }
+    }
+
+    printf("%-12s %8zu updates %8zu popped %8zu displaced %8.0f updates/s"
+           "%s\n", label, total, r.popped, r.displaced, total / elapsed,
+           r.errors > 0 ? "  ORDER/LOSS ERRORS" : "");
+    return r;
+}
+
+/* Returns 1 if the ring ever held more than twice its capacity */
+static size_t report(const MPSCRing<PendingRoute>& ring) {
+    RingStats s = ring.stats();
+    bool over = s.highWater > 2 * s.capacity;
+    printf("%12s high water %zu of %zu, %lu dropped, %lu coalesced, "
+           "%lu blocked%s\n", "", s.highWater, s.capacity,
+           (unsigned long) s.dropped, (unsigned long) s.coalesced,
+           (unsigned long) s.blocked, over ? "  ERRORS: over bound" : "");
+    return over ? 1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = DEFAULT_UPDATES;
+    size_t producers = DEFAULT_PRODUCERS;
+    size_t capacity = DEFAULT_CAPACITY;
+    if (argc > 1) {
+        n = strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        producers = strtoul(argv[2], NULL, 10);
+    }
+    if (argc > 3) {
+        capacity = strtoul(argv[3], NULL, 10);
+    }
+    if (producers == 0 || n < producers) {
+        fprintf(stderr, "Need at least one update per producer\n");
+        return EXIT_FAILURE;
+    }
+
+    size_t errors = 0;
+    {
+        ListQueue queue;
+        errors += run(queue, "list", n, producers, true, false).errors;
+    }
+    {
+        MPSCRing<PendingRoute> ring(capacity, RING_BLOCK);
+        errors += run(ring, "block", n, producers, true, false).errors;
+        errors += report(ring);
+    }
+    {
+        MPSCRing<PendingRoute> ring(capacity, RING_BLOCK);
+        errors += run(ring, "block+nowait", n, producers, false, true,
+                      false).errors;
+        errors += report(ring);
+    }
+    {
+        MPSCRing<PendingRoute> ring(capacity, RING_DROP_OLDEST);
+        errors += run(ring, "drop-oldest", n, producers, false,
+                      false).errors;
+        errors += report(ring);
+    }
+    {
+        MPSCRing<PendingRoute> ring(capacity, RING_COALESCE);
+        errors += run(ring, "coalesce", n, producers, false, true).errors;
+        errors += report(ring);
+    }
+
+    return errors > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,121 @@
+/*
+ * Loads a synthetic full-table-sized set of prefixes into a RouteTable and
+ * reports the cost of insertion, exact lookup, longest-prefix match and
+ * removal.
+ *
+ * Usage: RouteTableBench [num_prefixes]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "BenchUtil.hh"
+#include "RouteTable.hh"
+
+#define DEFAULT_PREFIXES 1000000
+#define IPV6_SHARE 5 /* One prefix in IPV6_SHARE is IPv6 */
+
+/* Prefix lengths roughly follow the shape of a public BGP table. */
+static int ipv4_prefix_len() {
+    uint32_t r = next_rand() % 100;
+    if (r < 60) return 24;
+    if (r < 75) return 22 + (r % 2);
+    if (r < 90) return 16 + (r % 6);
+    return 8 + (r % 8);
+}
+
+static int ipv6_prefix_len() {
+    uint32_t r = next_rand() % 100;
+    if (r < 50) return 48;
+    if (r < 80) return 32 + (r % 16);
+    return 29 + (r % 3);
+}
+
+static RouteEntry make_route(size_t i) {
+    RouteEntry re;
+    uint8_t data[16];
+
+    for (int b = 0; b < 16; b += 4) {
+        uint32_t r = next_rand();
+        memcpy(data + b, &r, sizeof(r));
+    }
+
+    if (i % IPV6_SHARE == 0) {
+        data[0] = 0x20; /* 2000::/3 */
+        re.address = IPAddress(IPV6, data);
+        re.netmask = IPAddress(IPV6, ipv6_prefix_len());
+        re.gateway = IPAddress(IPV6, "fe80::1");
+    } else {
+        re.address = IPAddress(IPV4, data);
+        re.netmask = IPAddress(IPV4, ipv4_prefix_len());
+        re.gateway = IPAddress(IPV4, "10.0.0.1");
+    }
+
+    return re;
+}
+
+static void report(const char* stage, size_t ops, double elapsed) {
+    printf("%-12s %10zu ops %10.3f s %12.0f ops/s %8.1f ns/op\n", stage, ops,
+           elapsed, ops / elapsed, elapsed * 1e9 / ops);
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = DEFAULT_PREFIXES;
+    if (argc > 1) {
+        n = strtoul(argv[1], NULL, 10);
+    }
+
+    printf("Generating %zu synthetic prefixes...\n", n);
+    std::vector<RouteEntry> routes;
+    routes.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        routes.push_back(make_route(i));
+    }
+
+    RouteTable table;
+    double start = now();
+    for (size_t i = 0; i < n; i++) {
+        table.insert(routes[i]);
+    }
+    report("insert", n, now() - start);
+    printf("%zu unique prefixes stored\n", table.size());
+
+    size_t found = 0;
+    start = now();
+    for (size_t i = 0; i < n; i++) {
+        if (table.find(routes[i]) != NULL) {
+            found++;
+        }
+    }
+    report("find", n, now() - start);
+
+    std::vector<IPAddress> hosts;
+    hosts.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        hosts.push_back(routes[(next_rand() % n)].address);
+    }
+
+    size_t matched = 0;
+    start = now();
+    for (size_t i = 0; i < n; i++) {
+        if (table.lookup(hosts[i]) != NULL) {
+            matched++;
+        }
+    }
+    report("lookup", n, now() - start);
+
+    start = now();
+    for (size_t i = 0; i < n; i++) {
+        table.remove(routes[i]);
+    }
+    report("remove", n, now() - start);
+
+    if (found != n || matched != n || table.size() != 0) {
+        fprintf(stderr, "Inconsistent table: found=%zu matched=%zu left=%zu\n",
+                found, matched, table.size());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
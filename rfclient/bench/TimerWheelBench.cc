@@ -0,0 +1,142 @@
+/*
+ * Measures the cost of scheduling, cancelling and firing timers on the
+ * TimerWheel, against a std::multimap keyed by expiry. Timers are given
+ * delays spread over a minute, as for gateways being probed with backoff,
+ * half of them are cancelled, as for gateways that resolve, and the rest are
+ * run by advancing the wheel a tick at a time on a simulated clock. Every
+ * remaining timer is checked to have fired exactly once, within a tick of
+ * when it was due.
+ *
+ * Usage: TimerWheelBench [num_timers]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <map>
+#include <vector>
+#include <boost/bind.hpp>
+
+#include "BenchUtil.hh"
+#include "TimerWheel.hh"
+
+#define DEFAULT_TIMERS 500000
+// Longest delay given to a timer (ms)
+#define MAX_DELAY 60000
+
+static uint64_t simulated = 0;
+static std::vector<uint64_t> fired;
+
+static void fire(size_t i) {
+    fired[i] = simulated;
+}
+
+static void report(const char* label, const char* op, size_t n,
+                   double seconds) {
+    printf("%-10s %-9s %8zu timers %8.1f ns/timer\n", label, op, n,
+           seconds * 1e9 / n);
+}
+
+static int benchWheel(const std::vector<unsigned>& delays) {
+    size_t n = delays.size();
+    fired.assign(n, 0);
+
+    // The wheel's clock starts at its construction, so simulate from there.
+    uint64_t base = TimerWheel::now();
+    TimerWheel wheel;
+    std::vector<TimerId> ids(n);
+
+    double start = now();
+    for (size_t i = 0; i < n; i++) {
+        ids[i] = wheel.schedule(delays[i], boost::bind(&fire, i));
+    }
+    report("wheel", "schedule", n, now() - start);
+
+    start = now();
+    for (size_t i = 0; i < n; i += 2) {
+        if (!wheel.cancel(ids[i])) {
+            fprintf(stderr, "Cannot cancel timer %zu\n", i);
+            return -1;
+        }
+    }
+    report("wheel", "cancel", n / 2, now() - start);
+
+    size_t run = 0;
+    start = now();
+    for (simulated = 0; simulated <= MAX_DELAY + TIMER_WHEEL_TICK;
+            simulated += TIMER_WHEEL_TICK) {
+        run += wheel.advance(base + simulated + TIMER_WHEEL_TICK);
+    }
+    report("wheel", "fire", run, now() - start);
+
+    for (size_t i = 0; i < n; i++) {
+        bool cancelled = (i % 2 == 0);
+        if (cancelled ? fired[i] != 0
+                      : fired[i] + TIMER_WHEEL_TICK < delays[i] ||
+                        fired[i] > delays[i] + TIMER_WHEEL_TICK) {
+            fprintf(stderr, "Timer %zu due at %ums fired at %llums\n", i,
+                    delays[i], (unsigned long long) fired[i]);
+            return -1;
+        }
+    }
+    if (run != n - (n + 1) / 2 || wheel.size() != 0) {
+        fprintf(stderr, "%zu timers fired, %zu left\n", run, wheel.size());
+        return -1;
+    }
+    return 0;
+}
+
+static void benchMultimap(const std::vector<unsigned>& delays) {
+    typedef std::multimap<uint64_t, TimerCallback> Queue;
+    size_t n = delays.size();
+    Queue queue;
+    std::vector<Queue::iterator> ids(n);
+
+    double start = now();
+    for (size_t i = 0; i < n; i++) {
+        ids[i] = queue.insert(std::make_pair((uint64_t) delays[i],
+                                             TimerCallback(boost::bind(&fire,
+                                                                       i))));
+    }
+    report("multimap", "schedule", n, now() - start);
+
+    start = now();
+    for (size_t i = 0; i < n; i += 2) {
+        queue.erase(ids[i]);
+    }
+    report("multimap", "cancel", n / 2, now() - start);
+
+    size_t run = 0;
+    start = now();
+    for (simulated = 0; simulated <= MAX_DELAY + TIMER_WHEEL_TICK;
+            simulated += TIMER_WHEEL_TICK) {
+        while (!queue.empty() && queue.begin()->first <= simulated) {
+            queue.begin()->second();
+            queue.erase(queue.begin());
+            run++;
+        }
+    }
+    report("multimap", "fire", run, now() - start);
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = DEFAULT_TIMERS;
+    if (argc > 1) {
+        n = strtoul(argv[1], NULL, 10);
+    }
+    if (n == 0) {
+        fprintf(stderr, "Need at least one timer\n");
+        return 1;
+    }
+
+    srand(1);
+    std::vector<unsigned> delays(n);
+    for (size_t i = 0; i < n; i++) {
+        delays[i] = 1 + rand() % MAX_DELAY;
+    }
+
+    if (benchWheel(delays) < 0) {
+        return 1;
+    }
+    benchMultimap(delays);
+    return 0;
+}
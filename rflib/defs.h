@@ -31,11 +31,17 @@
 
 typedef enum route_mod_type {
 	RMT_ADD,			/* Add flow to datapath */
-	RMT_DELETE			/* Remove flow from datapath */
-	/* Future implementation */
-	//RMT_MODIFY		/* Modify existing flow (Unimplemented) */
+	RMT_DELETE,			/* Remove flow from datapath */
+	RMT_MODIFY			/* Modify existing flow */
 } RouteModType;
 
+/* Outcome of a RouteMod, reported in a RouteModAck for the RouteMod's seq */
+typedef enum route_mod_status {
+	RMS_SUCCESS,			/* Flows installed on every datapath */
+	RMS_FAILED,			/* A datapath rejected or missed a flow */
+	RMS_DROPPED			/* RFServer had nowhere to send it */
+} RouteModStatus;
+
 #define PC_MAP 0
 #define PC_RESET 1
 
@@ -46,7 +46,11 @@ DC_ALL = 255			# Send all traffic to the controller
 
 RMT_ADD = 0			# Add flow to datapath
 RMT_DELETE = 1			# Remove flow from datapath
-#RMT_MODIFY = 2		# Modify existing flow (Unimplemented)
+RMT_MODIFY = 2			# Modify existing flow
+
+RMS_SUCCESS = 0			# Flows installed on every datapath
+RMS_FAILED = 1			# A datapath rejected or missed a flow
+RMS_DROPPED = 2			# RFServer had nowhere to send it
 
 PC_MAP = 0
 PC_RESET = 1
@@ -1,6 +1,16 @@
 #include "MongoIPC.h"
+#include "metrics/Metrics.h"
 #include <boost/thread.hpp>
 
+static Counter messagesSent("ipc_messages_sent_total",
+    "Messages sent over MongoDB");
+static Counter bytesSent("ipc_bytes_sent_total",
+    "Bytes of message envelopes sent over MongoDB");
+static Histogram serialiseLatency("ipc_serialise_seconds",
+    "Time taken to serialise a message into its envelope");
+static Histogram sendLatency("ipc_send_seconds",
+    "Time taken to insert a message envelope into MongoDB");
+
 MongoIPCMessageService::MongoIPCMessageService(const string &address, const string db, const string id) {
     this->set_id(id);
     this->db = db;
@@ -62,7 +72,14 @@ bool MongoIPCMessageService::send(const string &channelId, const string &to, IPC
     string ns = this->db + "." + channelId;
 
     this->createChannel(producerConnection, ns);
-    this->producerConnection.insert(ns, putInEnvelope(this->get_id(), to, msg));
+    uint64_t start = Metrics::now();
+    mongo::BSONObj envelope = putInEnvelope(this->get_id(), to, msg);
+    uint64_t serialised = Metrics::now();
+    serialiseLatency.record(serialised - start);
+    this->producerConnection.insert(ns, envelope);
+    sendLatency.since(serialised);
+    messagesSent.add();
+    bytesSent.add(envelope.objsize());
 
     return true;
 }
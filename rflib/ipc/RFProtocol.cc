@@ -436,14 +436,16 @@ RouteMod::RouteMod() {
     set_matches(std::vector<Match>());
     set_actions(std::vector<Action>());
     set_options(std::vector<Option>());
+    set_seq(0);
 }
 
-RouteMod::RouteMod(uint8_t mod, uint64_t id, std::vector<Match> matches, std::vector<Action> actions, std::vector<Option> options) {
+RouteMod::RouteMod(uint8_t mod, uint64_t id, std::vector<Match> matches, std::vector<Action> actions, std::vector<Option> options, uint64_t seq) {
     set_mod(mod);
     set_id(id);
     set_matches(matches);
     set_actions(actions);
     set_options(options);
+    set_seq(seq);
 }
 
 int RouteMod::get_type() {
@@ -502,6 +504,14 @@ void RouteMod::add_option(const Option& option) {
     this->options.push_back(option);
 }
 
+uint64_t RouteMod::get_seq() {
+    return this->seq;
+}
+
+void RouteMod::set_seq(uint64_t seq) {
+    this->seq = seq;
+}
+
 void RouteMod::from_BSON(const char* data) {
     mongo::BSONObj obj(data);
     set_mod(string_to<uint8_t>(obj["mod"].String()));
@@ -509,6 +519,7 @@ void RouteMod::from_BSON(const char* data) {
     set_matches(MatchList::to_vector(obj["matches"].Array()));
     set_actions(ActionList::to_vector(obj["actions"].Array()));
     set_options(OptionList::to_vector(obj["options"].Array()));
+    set_seq(string_to<uint64_t>(obj["seq"].String()));
 }
 
 const char* RouteMod::to_BSON() {
@@ -518,6 +529,7 @@ const char* RouteMod::to_BSON() {
     _b.appendArray("matches", MatchList::to_BSON(get_matches()));
     _b.appendArray("actions", ActionList::to_BSON(get_actions()));
     _b.appendArray("options", OptionList::to_BSON(get_options()));
+    _b.append("seq", to_string<uint64_t>(get_seq()));
     mongo::BSONObj o = _b.obj();
     char* data = new char[o.objsize()];
     memcpy(data, o.objdata(), o.objsize());
@@ -532,9 +544,38 @@ string RouteMod::str() {
     ss << "  matches: " << MatchList::to_BSON(get_matches()) << endl;
     ss << "  actions: " << ActionList::to_BSON(get_actions()) << endl;
     ss << "  options: " << OptionList::to_BSON(get_options()) << endl;
+    ss << "  seq: " << to_string<uint64_t>(get_seq()) << endl;
     return ss.str();
 }
 
+namespace RouteModList {
+    mongo::BSONArray to_BSON(std::vector<RouteMod> list) {
+        std::vector<RouteMod>::iterator iter;
+        mongo::BSONArrayBuilder builder;
+
+        for (iter = list.begin(); iter != list.end(); ++iter) {
+            const char* data = iter->to_BSON();
+            builder.append(mongo::BSONObj(data));
+            delete[] data;
+        }
+
+        return builder.arr();
+    }
+
+    std::vector<RouteMod> to_vector(std::vector<mongo::BSONElement> array) {
+        std::vector<mongo::BSONElement>::iterator iter;
+        std::vector<RouteMod> list;
+
+        for (iter = array.begin(); iter != array.end(); ++iter) {
+            RouteMod msg;
+            msg.from_BSON(iter->Obj().objdata());
+            list.push_back(msg);
+        }
+
+        return list;
+    }
+}
+
 ControllerRegister::ControllerRegister() {
     set_ct_addr(IPAddress(IPV4));
     set_ct_port(0);
@@ -655,3 +696,212 @@ string ElectMaster::str() {
     ss << "  ct_port: " << to_string<uint32_t>(get_ct_port()) << endl;
     return ss.str();
 }
+
+RouteModBatch::RouteModBatch() {
+    set_id(0);
+    set_mods(std::vector<RouteMod>());
+}
+
+RouteModBatch::RouteModBatch(uint64_t id, std::vector<RouteMod> mods) {
+    set_id(id);
+    set_mods(mods);
+}
+
+int RouteModBatch::get_type() {
+    return ROUTE_MOD_BATCH;
+}
+
+uint64_t RouteModBatch::get_id() {
+    return this->id;
+}
+
+void RouteModBatch::set_id(uint64_t id) {
+    this->id = id;
+}
+
+std::vector<RouteMod> RouteModBatch::get_mods() {
+    return this->mods;
+}
+
+void RouteModBatch::set_mods(std::vector<RouteMod> mods) {
+    this->mods = mods;
+}
+
+void RouteModBatch::add_routemod(const RouteMod& routemod) {
+    this->mods.push_back(routemod);
+}
+
+void RouteModBatch::from_BSON(const char* data) {
+    mongo::BSONObj obj(data);
+    set_id(string_to<uint64_t>(obj["id"].String()));
+    set_mods(RouteModList::to_vector(obj["mods"].Array()));
+}
+
+const char* RouteModBatch::to_BSON() {
+    mongo::BSONObjBuilder _b;
+    _b.append("id", to_string<uint64_t>(get_id()));
+    _b.appendArray("mods", RouteModList::to_BSON(get_mods()));
+    mongo::BSONObj o = _b.obj();
+    char* data = new char[o.objsize()];
+    memcpy(data, o.objdata(), o.objsize());
+    return data;
+}
+
+string RouteModBatch::str() {
+    stringstream ss;
+    ss << "RouteModBatch" << endl;
+    ss << "  id: " << to_string<uint64_t>(get_id()) << endl;
+    ss << "  mods: " << RouteModList::to_BSON(get_mods()) << endl;
+    return ss.str();
+}
+
+NextHopMod::NextHopMod() {
+    set_mod(0);
+    set_id(0);
+    set_nexthop_id(0);
+    set_actions(std::vector<Action>());
+}
+
+NextHopMod::NextHopMod(uint8_t mod, uint64_t id, uint32_t nexthop_id, std::vector<Action> actions) {
+    set_mod(mod);
+    set_id(id);
+    set_nexthop_id(nexthop_id);
+    set_actions(actions);
+}
+
+int NextHopMod::get_type() {
+    return NEXT_HOP_MOD;
+}
+
+uint8_t NextHopMod::get_mod() {
+    return this->mod;
+}
+
+void NextHopMod::set_mod(uint8_t mod) {
+    this->mod = mod;
+}
+
+uint64_t NextHopMod::get_id() {
+    return this->id;
+}
+
+void NextHopMod::set_id(uint64_t id) {
+    this->id = id;
+}
+
+uint32_t NextHopMod::get_nexthop_id() {
+    return this->nexthop_id;
+}
+
+void NextHopMod::set_nexthop_id(uint32_t nexthop_id) {
+    this->nexthop_id = nexthop_id;
+}
+
+std::vector<Action> NextHopMod::get_actions() {
+    return this->actions;
+}
+
+void NextHopMod::set_actions(std::vector<Action> actions) {
+    this->actions = actions;
+}
+
+void NextHopMod::add_action(const Action& action) {
+    this->actions.push_back(action);
+}
+
+void NextHopMod::from_BSON(const char* data) {
+    mongo::BSONObj obj(data);
+    set_mod(string_to<uint8_t>(obj["mod"].String()));
+    set_id(string_to<uint64_t>(obj["id"].String()));
+    set_nexthop_id(string_to<uint32_t>(obj["nexthop_id"].String()));
+    set_actions(ActionList::to_vector(obj["actions"].Array()));
+}
+
+const char* NextHopMod::to_BSON() {
+    mongo::BSONObjBuilder _b;
+    _b.append("mod", to_string<uint16_t>(get_mod()));
+    _b.append("id", to_string<uint64_t>(get_id()));
+    _b.append("nexthop_id", to_string<uint32_t>(get_nexthop_id()));
+    _b.appendArray("actions", ActionList::to_BSON(get_actions()));
+    mongo::BSONObj o = _b.obj();
+    char* data = new char[o.objsize()];
+    memcpy(data, o.objdata(), o.objsize());
+    return data;
+}
+
+string NextHopMod::str() {
+    stringstream ss;
+    ss << "NextHopMod" << endl;
+    ss << "  mod: " << to_string<uint16_t>(get_mod()) << endl;
+    ss << "  id: " << to_string<uint64_t>(get_id()) << endl;
+    ss << "  nexthop_id: " << to_string<uint32_t>(get_nexthop_id()) << endl;
+    ss << "  actions: " << ActionList::to_BSON(get_actions()) << endl;
+    return ss.str();
+}
+
+RouteModAck::RouteModAck() {
+    set_id(0);
+    set_seq(0);
+    set_status(0);
+}
+
+RouteModAck::RouteModAck(uint64_t id, uint64_t seq, uint8_t status) {
+    set_id(id);
+    set_seq(seq);
+    set_status(status);
+}
+
+int RouteModAck::get_type() {
+    return ROUTE_MOD_ACK;
+}
+
+uint64_t RouteModAck::get_id() {
+    return this->id;
+}
+
+void RouteModAck::set_id(uint64_t id) {
+    this->id = id;
+}
+
+uint64_t RouteModAck::get_seq() {
+    return this->seq;
+}
+
+void RouteModAck::set_seq(uint64_t seq) {
+    this->seq = seq;
+}
+
+uint8_t RouteModAck::get_status() {
+    return this->status;
+}
+
+void RouteModAck::set_status(uint8_t status) {
+    this->status = status;
+}
+
+void RouteModAck::from_BSON(const char* data) {
+    mongo::BSONObj obj(data);
+    set_id(string_to<uint64_t>(obj["id"].String()));
+    set_seq(string_to<uint64_t>(obj["seq"].String()));
+    set_status(string_to<uint8_t>(obj["status"].String()));
+}
+
+const char* RouteModAck::to_BSON() {
+    mongo::BSONObjBuilder _b;
+    _b.append("id", to_string<uint64_t>(get_id()));
+    _b.append("seq", to_string<uint64_t>(get_seq()));
+    _b.append("status", to_string<uint16_t>(get_status()));
+    mongo::BSONObj o = _b.obj();
+    char* data = new char[o.objsize()];
+    memcpy(data, o.objdata(), o.objsize());
+    return data;
+}
+
+string RouteModAck::str() {
+    stringstream ss;
+    ss << "RouteModAck" << endl;
+    ss << "  id: " << to_string<uint64_t>(get_id()) << endl;
+    ss << "  seq: " << to_string<uint64_t>(get_seq()) << endl;
+    ss << "  status: " << to_string<uint16_t>(get_status()) << endl;
+    return ss.str();
+}
@@ -20,7 +20,10 @@ enum {
 	DATA_PLANE_MAP,
 	ROUTE_MOD,
 	CONTROLLER_REGISTER,
-	ELECT_MASTER
+	ELECT_MASTER,
+	ROUTE_MOD_BATCH,
+	NEXT_HOP_MOD,
+	ROUTE_MOD_ACK
 };
 
 class PortRegister : public IPCMessage {
@@ -184,7 +187,7 @@ class DataPlaneMap : public IPCMessage {
 class RouteMod : public IPCMessage {
     public:
         RouteMod();
-        RouteMod(uint8_t mod, uint64_t id, std::vector<Match> matches, std::vector<Action> actions, std::vector<Option> options);
+        RouteMod(uint8_t mod, uint64_t id, std::vector<Match> matches, std::vector<Action> actions, std::vector<Option> options, uint64_t seq);
 
         uint8_t get_mod();
         void set_mod(uint8_t mod);
@@ -204,6 +207,9 @@ class RouteMod : public IPCMessage {
         void set_options(std::vector<Option> options);
         void add_option(const Option& option);
 
+        uint64_t get_seq();
+        void set_seq(uint64_t seq);
+
         virtual int get_type();
         virtual void from_BSON(const char* data);
         virtual const char* to_BSON();
@@ -215,8 +221,14 @@ class RouteMod : public IPCMessage {
         std::vector<Match> matches;
         std::vector<Action> actions;
         std::vector<Option> options;
+        uint64_t seq;
 };
 
+namespace RouteModList {
+    mongo::BSONArray to_BSON(std::vector<RouteMod> list);
+    std::vector<RouteMod> to_vector(std::vector<mongo::BSONElement> array);
+}
+
 class ControllerRegister : public IPCMessage {
     public:
         ControllerRegister();
@@ -263,4 +275,81 @@ class ElectMaster : public IPCMessage {
         uint32_t ct_port;
 };
 
+class RouteModBatch : public IPCMessage {
+    public:
+        RouteModBatch();
+        RouteModBatch(uint64_t id, std::vector<RouteMod> mods);
+
+        uint64_t get_id();
+        void set_id(uint64_t id);
+
+        std::vector<RouteMod> get_mods();
+        void set_mods(std::vector<RouteMod> mods);
+        void add_routemod(const RouteMod& routemod);
+
+        virtual int get_type();
+        virtual void from_BSON(const char* data);
+        virtual const char* to_BSON();
+        virtual string str();
+
+    private:
+        uint64_t id;
+        std::vector<RouteMod> mods;
+};
+
+class NextHopMod : public IPCMessage {
+    public:
+        NextHopMod();
+        NextHopMod(uint8_t mod, uint64_t id, uint32_t nexthop_id, std::vector<Action> actions);
+
+        uint8_t get_mod();
+        void set_mod(uint8_t mod);
+
+        uint64_t get_id();
+        void set_id(uint64_t id);
+
+        uint32_t get_nexthop_id();
+        void set_nexthop_id(uint32_t nexthop_id);
+
+        std::vector<Action> get_actions();
+        void set_actions(std::vector<Action> actions);
+        void add_action(const Action& action);
+
+        virtual int get_type();
+        virtual void from_BSON(const char* data);
+        virtual const char* to_BSON();
+        virtual string str();
+
+    private:
+        uint8_t mod;
+        uint64_t id;
+        uint32_t nexthop_id;
+        std::vector<Action> actions;
+};
+
+class RouteModAck : public IPCMessage {
+    public:
+        RouteModAck();
+        RouteModAck(uint64_t id, uint64_t seq, uint8_t status);
+
+        uint64_t get_id();
+        void set_id(uint64_t id);
+
+        uint64_t get_seq();
+        void set_seq(uint64_t seq);
+
+        uint8_t get_status();
+        void set_status(uint8_t status);
+
+        virtual int get_type();
+        virtual void from_BSON(const char* data);
+        virtual const char* to_BSON();
+        virtual string str();
+
+    private:
+        uint64_t id;
+        uint64_t seq;
+        uint8_t status;
+};
+
 #endif /* __RFPROTOCOL_H__ */
\ No newline at end of file
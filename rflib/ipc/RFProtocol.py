@@ -16,6 +16,9 @@ DATA_PLANE_MAP = 5
 ROUTE_MOD = 6
 CONTROLLER_REGISTER = 7
 ELECT_MASTER = 8
+ROUTE_MOD_BATCH = 9
+NEXT_HOP_MOD = 10
+ROUTE_MOD_ACK = 11
 
 
 class PortRegister(MongoIPCMessage):
@@ -443,12 +446,13 @@ class DataPlaneMap(MongoIPCMessage):
 
 
 class RouteMod(MongoIPCMessage):
-    def __init__(self, mod=None, id=None, matches=None, actions=None, options=None):
+    def __init__(self, mod=None, id=None, matches=None, actions=None, options=None, seq=None):
         self.set_mod(mod)
         self.set_id(id)
         self.set_matches(matches)
         self.set_actions(actions)
         self.set_options(options)
+        self.set_seq(seq)
 
     def get_type(self):
         return ROUTE_MOD
@@ -512,12 +516,23 @@ class RouteMod(MongoIPCMessage):
     def add_option(self, option):
         self.options.append(option.to_dict())
 
+    def get_seq(self):
+        return self.seq
+
+    def set_seq(self, seq):
+        seq = 0 if seq is None else seq
+        try:
+            self.seq = int(seq)
+        except:
+            self.seq = 0
+
     def from_dict(self, data):
         self.set_mod(data["mod"])
         self.set_id(data["id"])
         self.set_matches(data["matches"])
         self.set_actions(data["actions"])
         self.set_options(data["options"])
+        self.set_seq(data["seq"])
 
     def to_dict(self):
         data = {}
@@ -526,6 +541,7 @@ class RouteMod(MongoIPCMessage):
         data["matches"] = self.get_matches()
         data["actions"] = self.get_actions()
         data["options"] = self.get_options()
+        data["seq"] = str(self.get_seq())
         return data
 
     def from_bson(self, data):
@@ -548,6 +564,7 @@ class RouteMod(MongoIPCMessage):
         s += "  options:\n"
         for option in self.get_options():
             s += "    " + str(Option.from_dict(option)) + "\n"
+        s += "  seq: " + format_id(self.get_seq()) + "\n"
         return s
 
 
@@ -667,3 +684,211 @@ class ElectMaster(MongoIPCMessage):
         s += "  ct_addr: " + str(self.get_ct_addr()) + "\n"
         s += "  ct_port: " + str(self.get_ct_port()) + "\n"
         return s
+
+
+class RouteModBatch(MongoIPCMessage):
+    def __init__(self, id=None, mods=None):
+        self.set_id(id)
+        self.set_mods(mods)
+
+    def get_type(self):
+        return ROUTE_MOD_BATCH
+
+    def get_id(self):
+        return self.id
+
+    def set_id(self, id):
+        id = 0 if id is None else id
+        try:
+            self.id = int(id)
+        except:
+            self.id = 0
+
+    def get_mods(self):
+        return self.mods
+
+    def set_mods(self, mods):
+        mods = list() if mods is None else mods
+        try:
+            self.mods = list(mods)
+        except:
+            self.mods = list()
+
+    def add_routemod(self, routemod):
+        self.mods.append(routemod.to_dict())
+
+    def from_dict(self, data):
+        self.set_id(data["id"])
+        self.set_mods(data["mods"])
+
+    def to_dict(self):
+        data = {}
+        data["id"] = str(self.get_id())
+        data["mods"] = self.get_mods()
+        return data
+
+    def from_bson(self, data):
+        data = bson.BSON.decode(data)
+        self.from_dict(data)
+
+    def to_bson(self):
+        return bson.BSON.encode(self.get_dict())
+
+    def __str__(self):
+        s = "RouteModBatch\n"
+        s += "  id: " + format_id(self.get_id()) + "\n"
+        s += "  mods:\n"
+        for routemod in self.get_mods():
+            s += "    " + str(RouteMod(**routemod)) + "\n"
+        return s
+
+
+class NextHopMod(MongoIPCMessage):
+    def __init__(self, mod=None, id=None, nexthop_id=None, actions=None):
+        self.set_mod(mod)
+        self.set_id(id)
+        self.set_nexthop_id(nexthop_id)
+        self.set_actions(actions)
+
+    def get_type(self):
+        return NEXT_HOP_MOD
+
+    def get_mod(self):
+        return self.mod
+
+    def set_mod(self, mod):
+        mod = 0 if mod is None else mod
+        try:
+            self.mod = int(mod)
+        except:
+            self.mod = 0
+
+    def get_id(self):
+        return self.id
+
+    def set_id(self, id):
+        id = 0 if id is None else id
+        try:
+            self.id = int(id)
+        except:
+            self.id = 0
+
+    def get_nexthop_id(self):
+        return self.nexthop_id
+
+    def set_nexthop_id(self, nexthop_id):
+        nexthop_id = 0 if nexthop_id is None else nexthop_id
+        try:
+            self.nexthop_id = int(nexthop_id)
+        except:
+            self.nexthop_id = 0
+
+    def get_actions(self):
+        return self.actions
+
+    def set_actions(self, actions):
+        actions = list() if actions is None else actions
+        try:
+            self.actions = list(actions)
+        except:
+            self.actions = list()
+
+    def add_action(self, action):
+        self.actions.append(action.to_dict())
+
+    def from_dict(self, data):
+        self.set_mod(data["mod"])
+        self.set_id(data["id"])
+        self.set_nexthop_id(data["nexthop_id"])
+        self.set_actions(data["actions"])
+
+    def to_dict(self):
+        data = {}
+        data["mod"] = str(self.get_mod())
+        data["id"] = str(self.get_id())
+        data["nexthop_id"] = str(self.get_nexthop_id())
+        data["actions"] = self.get_actions()
+        return data
+
+    def from_bson(self, data):
+        data = bson.BSON.decode(data)
+        self.from_dict(data)
+
+    def to_bson(self):
+        return bson.BSON.encode(self.get_dict())
+
+    def __str__(self):
+        s = "NextHopMod\n"
+        s += "  mod: " + str(self.get_mod()) + "\n"
+        s += "  id: " + format_id(self.get_id()) + "\n"
+        s += "  nexthop_id: " + str(self.get_nexthop_id()) + "\n"
+        s += "  actions:\n"
+        for action in self.get_actions():
+            s += "    " + str(Action.from_dict(action)) + "\n"
+        return s
+
+
+class RouteModAck(MongoIPCMessage):
+    def __init__(self, id=None, seq=None, status=None):
+        self.set_id(id)
+        self.set_seq(seq)
+        self.set_status(status)
+
+    def get_type(self):
+        return ROUTE_MOD_ACK
+
+    def get_id(self):
+        return self.id
+
+    def set_id(self, id):
+        id = 0 if id is None else id
+        try:
+            self.id = int(id)
+        except:
+            self.id = 0
+
+    def get_seq(self):
+        return self.seq
+
+    def set_seq(self, seq):
+        seq = 0 if seq is None else seq
+        try:
+            self.seq = int(seq)
+        except:
+            self.seq = 0
+
+    def get_status(self):
+        return self.status
+
+    def set_status(self, status):
+        status = 0 if status is None else status
+        try:
+            self.status = int(status)
+        except:
+            self.status = 0
+
+    def from_dict(self, data):
+        self.set_id(data["id"])
+        self.set_seq(data["seq"])
+        self.set_status(data["status"])
+
+    def to_dict(self):
+        data = {}
+        data["id"] = str(self.get_id())
+        data["seq"] = str(self.get_seq())
+        data["status"] = str(self.get_status())
+        return data
+
+    def from_bson(self, data):
+        data = bson.BSON.decode(data)
+        self.from_dict(data)
+
+    def to_bson(self):
+        return bson.BSON.encode(self.get_dict())
+
+    def __str__(self):
+        s = "RouteModAck\n"
+        s += "  id: " + format_id(self.get_id()) + "\n"
+        s += "  seq: " + format_id(self.get_seq()) + "\n"
+        s += "  status: " + str(self.get_status()) + "\n"
+        return s
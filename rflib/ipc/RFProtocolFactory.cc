@@ -20,6 +20,12 @@ IPCMessage* RFProtocolFactory::buildForType(int type) {
             return new ControllerRegister();
         case ELECT_MASTER:
             return new ElectMaster();
+        case ROUTE_MOD_BATCH:
+            return new RouteModBatch();
+        case NEXT_HOP_MOD:
+            return new NextHopMod();
+        case ROUTE_MOD_ACK:
+            return new RouteModAck();
         default:
             return NULL;
     }
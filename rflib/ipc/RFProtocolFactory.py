@@ -21,3 +21,9 @@ class RFProtocolFactory(IPC.IPCMessageFactory):
             return ControllerRegister()
         if type_ == ELECT_MASTER:
             return ElectMaster()
+        if type_ == ROUTE_MOD_BATCH:
+            return RouteModBatch()
+        if type_ == NEXT_HOP_MOD:
+            return NextHopMod()
+        if type_ == ROUTE_MOD_ACK:
+            return RouteModAck()
@@ -105,6 +105,28 @@ pyImportType = {
 "option[]": "list({0})",
 }
 
+def regmsgtypes(messages):
+    # Messages can be carried in arrays by other messages ("routemod[]")
+    for name, msg in messages:
+        t = name.lower()
+        typesMap[t] = name + "&"
+        typesMap[t + "[]"] = "std::vector<" + name + ">"
+        defaultValues[t + "[]"] = "std::vector<" + name + ">()"
+        exportType[t + "[]"] = name + "List::to_BSON({0})"
+        importType[t + "[]"] = name + "List::to_vector({0}.Array())"
+        pyTypesMap[t] = name
+        pyDefaultValues[t + "[]"] = "list()"
+        pyExportType[t + "[]"] = "{0}"
+        pyImportType[t + "[]"] = "list({0})"
+
+def listedmsgs(messages):
+    listed = set()
+    for name, msg in messages:
+        for t, f in msg:
+            if t[-2:] == "[]":
+                listed.add(t[:-2])
+    return [(name, msg) for name, msg in messages if name.lower() in listed]
+
 def convmsgtype(string):
     result = ""
     i = 0
@@ -201,6 +223,15 @@ def genH(messages, fname):
         g.decreaseIndent();
         g.addLine("};")
         g.blankLine();
+
+        if (name, msg) in listedmsgs(messages):
+            g.addLine("namespace {0}List {1}".format(name, "{"))
+            g.increaseIndent()
+            g.addLine("mongo::BSONArray to_BSON(std::vector<{0}> list);".format(name))
+            g.addLine("std::vector<{0}> to_vector(std::vector<mongo::BSONElement> array);".format(name))
+            g.decreaseIndent()
+            g.addLine("}")
+            g.blankLine();
         
     g.addLine("#endif /* __" + fname.upper() + "_H__ */")
     return str(g)
@@ -299,9 +330,52 @@ def genCPP(messages, fname):
         g.decreaseIndent()
         g.addLine("}")
         g.blankLine();
+
+        if (name, msg) in listedmsgs(messages):
+            genCPPList(g, name)
         
     return str(g)
 
+def genCPPList(g, name):
+    g.addLine("namespace {0}List {1}".format(name, "{"))
+    g.increaseIndent()
+    g.addLine("mongo::BSONArray to_BSON(std::vector<{0}> list) {1}".format(name, "{"))
+    g.increaseIndent()
+    g.addLine("std::vector<{0}>::iterator iter;".format(name))
+    g.addLine("mongo::BSONArrayBuilder builder;")
+    g.blankLine()
+    g.addLine("for (iter = list.begin(); iter != list.end(); ++iter) {")
+    g.increaseIndent()
+    g.addLine("const char* data = iter->to_BSON();")
+    g.addLine("builder.append(mongo::BSONObj(data));")
+    g.addLine("delete[] data;")
+    g.decreaseIndent()
+    g.addLine("}")
+    g.blankLine()
+    g.addLine("return builder.arr();")
+    g.decreaseIndent()
+    g.addLine("}")
+    g.blankLine()
+    g.addLine("std::vector<{0}> to_vector(std::vector<mongo::BSONElement> array) {1}".format(name, "{"))
+    g.increaseIndent()
+    g.addLine("std::vector<mongo::BSONElement>::iterator iter;")
+    g.addLine("std::vector<{0}> list;".format(name))
+    g.blankLine()
+    g.addLine("for (iter = array.begin(); iter != array.end(); ++iter) {")
+    g.increaseIndent()
+    g.addLine("{0} msg;".format(name))
+    g.addLine("msg.from_BSON(iter->Obj().objdata());")
+    g.addLine("list.push_back(msg);")
+    g.decreaseIndent()
+    g.addLine("}")
+    g.blankLine()
+    g.addLine("return list;")
+    g.decreaseIndent()
+    g.addLine("}")
+    g.decreaseIndent()
+    g.addLine("}")
+    g.blankLine()
+
 def genHFactory(messages, fname):
     g = CodeGenerator()
 
@@ -359,6 +433,7 @@ def genPy(messages, fname):
     g = CodeGenerator()
 
     g.addLine("import bson")    
+    g.blankLine()
     for tlv in ["Match","Action","Option"]:
         g.addLine("from rflib.types.{0} import {0}".format(tlv))
     g.addLine("from MongoIPC import MongoIPCMessage")
@@ -456,7 +531,10 @@ def genPy(messages, fname):
                 g.addLine("s += \"  {0}:\\n\"".format(f))
                 g.addLine("for {0} in {1}:".format(t[:-2], value))
                 g.increaseIndent()
-                g.addLine("s += \"    \" + str({0}.from_dict({1})) + \"\\n\"".format(pyTypesMap[t[:-2]], t[:-2]))
+                if t[:-2] in [n.lower() for n, m in messages]:
+                    g.addLine("s += \"    \" + str({0}(**{1})) + \"\\n\"".format(pyTypesMap[t[:-2]], t[:-2]))
+                else:
+                    g.addLine("s += \"    \" + str({0}.from_dict({1})) + \"\\n\"".format(pyTypesMap[t[:-2]], t[:-2]))
                 g.decreaseIndent()
             elif t == "i64":
                 g.addLine("s += \"  {0}: \" + format_id({1}) + \"\\n\"".format(f, value))
@@ -513,6 +591,8 @@ for line in lines:
     else:
         print "Error: invalid line"
 
+regmsgtypes(messages)
+
 f = open(fname + ".h", "w")
 f.write(genH(messages, fname))
 f.close()
@@ -0,0 +1,395 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+#include <boost/thread.hpp>
+
+#include "Log.h"
+
+struct LogRecord {
+    uint64_t time;
+    const char* format;
+    int level;
+    int nargs;
+    LogArg args[LOG_MAX_ARGS];
+    // Strings passed as arguments are copied here.
+    char text[LOG_TEXT_SIZE];
+};
+
+/*
+ * Messages waiting to be written for one thread. Only that thread advances
+ * 'head', and only the background thread advances 'tail', so neither needs
+ * a lock. They are kept on separate cache lines.
+ */
+struct LogRing {
+    size_t head;
+    char pad1[64 - sizeof(size_t)];
+    size_t tail;
+    char pad2[64 - sizeof(size_t)];
+    unsigned long dropped;
+    LogRecord records[LOG_RING_SIZE];
+};
+
+static __thread LogRing* ring = NULL;
+
+// Rings are never freed, as a thread may log until the process exits.
+// These are left allocated at exit for the same reason.
+static boost::mutex* ringsMutex = new boost::mutex();
+static std::vector<LogRing*>* rings = new std::vector<LogRing*>();
+
+static boost::once_flag startOnce = BOOST_ONCE_INIT;
+static boost::thread* flusherThread = NULL;
+static boost::mutex* flushMutex = new boost::mutex();
+static bool useSyslog = false;
+
+LogArg::LogArg() : type(SIGNED) {
+    this->value.i = 0;
+}
+
+LogArg::LogArg(int value) : type(SIGNED) {
+    this->value.i = value;
+}
+
+LogArg::LogArg(long value) : type(SIGNED) {
+    this->value.i = value;
+}
+
+LogArg::LogArg(long long value) : type(SIGNED) {
+    this->value.i = value;
+}
+
+LogArg::LogArg(unsigned value) : type(UNSIGNED) {
+    this->value.u = value;
+}
+
+LogArg::LogArg(unsigned long value) : type(UNSIGNED) {
+    this->value.u = value;
+}
+
+LogArg::LogArg(unsigned long long value) : type(UNSIGNED) {
+    this->value.u = value;
+}
+
+LogArg::LogArg(double value) : type(DOUBLE) {
+    this->value.d = value;
+}
+
+LogArg::LogArg(const char* value) : type(STRING) {
+    if (value == NULL) {
+        value = "(null)";
+    }
+    this->value.s.data = value;
+    this->value.s.len = strlen(value);
+}
+
+LogArg::LogArg(const std::string& value) : type(STRING) {
+    this->value.s.data = value.data();
+    this->value.s.len = value.size();
+}
+
+LogArg::LogArg(const IPAddress& value) {
+    this->type = (value.getVersion() == IPV6) ? IPV6_ADDR : IPV4_ADDR;
+    value.toArray(this->value.addr);
+}
+
+LogArg::LogArg(const MACAddress& value) : type(MAC_ADDR) {
+    value.toArray(this->value.addr);
+}
+
+static uint64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void Log::write(int level, const char* format) {
+    Log::write(level, format, NULL, 0);
+}
+
+void Log::write(int level, const char* format, const LogArg& a1) {
+    const LogArg* args[] = { &a1 };
+    Log::write(level, format, args, 1);
+}
+
+void Log::write(int level, const char* format, const LogArg& a1,
+                const LogArg& a2) {
+    const LogArg* args[] = { &a1, &a2 };
+    Log::write(level, format, args, 2);
+}
+
+void Log::write(int level, const char* format, const LogArg& a1,
+                const LogArg& a2, const LogArg& a3) {
+    const LogArg* args[] = { &a1, &a2, &a3 };
+    Log::write(level, format, args, 3);
+}
+
+void Log::write(int level, const char* format, const LogArg& a1,
+                const LogArg& a2, const LogArg& a3, const LogArg& a4) {
+    const LogArg* args[] = { &a1, &a2, &a3, &a4 };
+    Log::write(level, format, args, 4);
+}
+
+void Log::write(int level, const char* format, const LogArg& a1,
+                const LogArg& a2, const LogArg& a3, const LogArg& a4,
+                const LogArg& a5) {
+    const LogArg* args[] = { &a1, &a2, &a3, &a4, &a5 };
+    Log::write(level, format, args, 5);
+}
+
+void Log::write(int level, const char* format, const LogArg& a1,
+                const LogArg& a2, const LogArg& a3, const LogArg& a4,
+                const LogArg& a5, const LogArg& a6) {
+    const LogArg* args[] = { &a1, &a2, &a3, &a4, &a5, &a6 };
+    Log::write(level, format, args, 6);
+}
+
+/**
+ * Queue a message on the calling thread's ring, or count it as dropped if
+ * the ring is full.
+ */
+void Log::write(int level, const char* format, const LogArg** args,
+                int nargs) {
+    LogRing* r = Log::threadRing();
+    size_t head = r->head;
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= LOG_RING_SIZE) {
+        __atomic_add_fetch(&r->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    LogRecord& rec = r->records[head % LOG_RING_SIZE];
+    rec.time = now();
+    rec.format = format;
+    rec.level = level;
+    rec.nargs = std::min(nargs, LOG_MAX_ARGS);
+
+    size_t used = 0;
+    for (int i = 0; i < rec.nargs; i++) {
+        rec.args[i] = *args[i];
+        if (rec.args[i].type == LogArg::STRING) {
+            // Strings that no longer fit are logged as empty.
+            if (used >= LOG_TEXT_SIZE) {
+                rec.args[i].value.s.data = "";
+                rec.args[i].value.s.len = 0;
+                continue;
+            }
+            size_t room = LOG_TEXT_SIZE - used - 1;
+            size_t len = std::min(rec.args[i].value.s.len, room);
+            memcpy(rec.text + used, rec.args[i].value.s.data, len);
+            rec.text[used + len] = '\0';
+            rec.args[i].value.s.data = rec.text + used;
+            rec.args[i].value.s.len = len;
+            used += len + 1;
+        }
+    }
+
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+LogRing* Log::threadRing() {
+    if (ring == NULL) {
+        ring = new LogRing();
+        ring->head = 0;
+        ring->tail = 0;
+        ring->dropped = 0;
+        {
+            boost::lock_guard<boost::mutex> lock(*ringsMutex);
+            rings->push_back(ring);
+        }
+        boost::call_once(&Log::start, startOnce);
+    }
+    return ring;
+}
+
+void Log::openSyslog(const char* ident, int facility) {
+    openlog(ident, LOG_NDELAY | LOG_NOWAIT | LOG_PID, facility);
+    useSyslog = true;
+}
+
+void Log::start() {
+    flusherThread = new boost::thread(&Log::flusher);
+    atexit(&Log::stop);
+}
+
+void Log::stop() {
+    if (flusherThread != NULL) {
+        flusherThread->interrupt();
+        flusherThread->join();
+    }
+    Log::flush();
+}
+
+void Log::flusher() {
+    try {
+        while (true) {
+            if (!Log::flush()) {
+                boost::this_thread::sleep(
+                    boost::posix_time::milliseconds(LOG_FLUSH_INTERVAL));
+            }
+            boost::this_thread::interruption_point();
+        }
+    } catch (boost::thread_interrupted&) {
+    }
+}
+
+static bool earlier(const LogRecord* a, const LogRecord* b) {
+    return a->time < b->time;
+}
+
+/* Format a string argument according to 'spec', which ends in 's' */
+static void format_string(std::string& out, const std::string& spec,
+                          const char* value) {
+    char buf[LOG_TEXT_SIZE + 64];
+    snprintf(buf, sizeof(buf), spec.c_str(), value);
+    out += buf;
+}
+
+/* Format one argument for a printf conversion, whatever its type */
+static void format_arg(std::string& out, std::string spec, char conv,
+                       const LogArg& arg) {
+    char buf[128];
+    switch (arg.type) {
+    case LogArg::SIGNED:
+    case LogArg::UNSIGNED:
+        if (conv == 'c') {
+            spec += conv;
+            snprintf(buf, sizeof(buf), spec.c_str(), (int) arg.value.i);
+        } else if (strchr("eEfFgGaA", conv) != NULL) {
+            spec += conv;
+            snprintf(buf, sizeof(buf), spec.c_str(),
+                     arg.type == LogArg::SIGNED ? (double) arg.value.i
+                                                : (double) arg.value.u);
+        } else {
+            if (strchr("diouxX", conv) == NULL) {
+                conv = (arg.type == LogArg::SIGNED) ? 'd' : 'u';
+            }
+            spec += "ll";
+            spec += conv;
+            if (arg.type == LogArg::SIGNED) {
+                snprintf(buf, sizeof(buf), spec.c_str(), arg.value.i);
+            } else {
+                snprintf(buf, sizeof(buf), spec.c_str(), arg.value.u);
+            }
+        }
+        out += buf;
+        break;
+    case LogArg::DOUBLE:
+        spec += (strchr("eEfFgGaA", conv) != NULL) ? conv : 'g';
+        snprintf(buf, sizeof(buf), spec.c_str(), arg.value.d);
+        out += buf;
+        break;
+    case LogArg::STRING:
+        format_string(out, spec + 's', arg.value.s.data);
+        break;
+    case LogArg::IPV4_ADDR:
+        inet_ntop(AF_INET, arg.value.addr, buf, sizeof(buf));
+        format_string(out, spec + 's', buf);
+        break;
+    case LogArg::IPV6_ADDR:
+        inet_ntop(AF_INET6, arg.value.addr, buf, sizeof(buf));
+        format_string(out, spec + 's', buf);
+        break;
+    case LogArg::MAC_ADDR: {
+        const uint8_t* mac = arg.value.addr;
+        snprintf(buf, sizeof(buf), "%02x:%02x:%02x:%02x:%02x:%02x",
+                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        format_string(out, spec + 's', buf);
+        break;
+    }
+    }
+}
+
+/**
+ * Expand a message's format string. Flags, width and precision are kept from
+ * each conversion, but the length modifier is chosen from the type of the
+ * argument, so "%d" and "%s" work for any integer and any string-like
+ * argument.
+ */
+static void format_record(std::string& out, const LogRecord& rec) {
+    const char* p = rec.format;
+    int next = 0;
+    while (*p != '\0') {
+        if (*p != '%') {
+            out += *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            out += '%';
+            p += 2;
+            continue;
+        }
+
+        std::string spec("%");
+        for (p++; *p != '\0' && strchr("-+ #0123456789.", *p) != NULL; p++) {
+            spec += *p;
+        }
+        while (*p != '\0' && strchr("hlLqjzt", *p) != NULL) {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        char conv = *p++;
+
+        if (next < rec.nargs) {
+            format_arg(out, spec, conv, rec.args[next++]);
+        } else {
+            out += spec;
+            out += conv;
+        }
+    }
+}
+
+/**
+ * Write out every queued message, oldest first. Returns false if there was
+ * nothing to write.
+ */
+bool Log::flush() {
+    boost::lock_guard<boost::mutex> flushLock(*flushMutex);
+
+    std::vector<LogRing*> current;
+    {
+        boost::lock_guard<boost::mutex> lock(*ringsMutex);
+        current = *rings;
+    }
+
+    std::vector<size_t> heads(current.size());
+    std::vector<const LogRecord*> pending;
+    unsigned long dropped = 0;
+    for (size_t i = 0; i < current.size(); i++) {
+        LogRing* r = current[i];
+        heads[i] = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        for (size_t pos = r->tail; pos != heads[i]; pos++) {
+            pending.push_back(&r->records[pos % LOG_RING_SIZE]);
+        }
+        dropped += __atomic_exchange_n(&r->dropped, 0, __ATOMIC_RELAXED);
+    }
+    std::stable_sort(pending.begin(), pending.end(), earlier);
+
+    std::string line;
+    for (size_t i = 0; i < pending.size(); i++) {
+        const LogRecord& rec = *pending[i];
+        line.clear();
+        format_record(line, rec);
+
+        if (useSyslog && rec.level <= LOG_NOTICE) {
+            syslog(rec.level, "%s", line.c_str());
+        }
+        line += '\n';
+        fputs(line.c_str(), rec.level <= LOG_NOTICE ? stderr : stdout);
+    }
+    if (dropped > 0) {
+        fprintf(stderr, "%lu log messages dropped\n", dropped);
+    }
+    fflush(stdout);
+    fflush(stderr);
+
+    // Only now can the records be reused.
+    for (size_t i = 0; i < current.size(); i++) {
+        __atomic_store_n(&current[i]->tail, heads[i], __ATOMIC_RELEASE);
+    }
+
+    return !pending.empty() || dropped > 0;
+}
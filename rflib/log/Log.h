@@ -0,0 +1,125 @@
+#ifndef __LOG_H__
+#define __LOG_H__
+
+#include <stdint.h>
+#include <syslog.h>
+
+#include <string>
+
+#include "types/IPAddress.h"
+#include "types/MACAddress.h"
+
+/*
+ * Asynchronous logging.
+ *
+ * RFLOG_*() record the format string and a copy of their arguments in a ring
+ * owned by the calling thread, which never blocks or allocates. A background
+ * thread formats queued messages, printf style, and writes them out. Debug
+ * and info messages go to stdout, and the rest to stderr. Messages at notice
+ * level and above are also sent to syslog once openSyslog() is called.
+ *
+ * Levels are syslog priorities. Messages less important than RFLOG_LEVEL are
+ * compiled out, so building with -DRFLOG_LEVEL=LOG_NOTICE removes the
+ * per-route messages entirely.
+ *
+ * Format strings must be string literals, as they are read after the call
+ * returns. Each message takes up to LOG_MAX_ARGS arguments: integers,
+ * doubles, strings (for %s, copied up to LOG_TEXT_SIZE bytes in total), and
+ * IPAddress and MACAddress values (also for %s, formatted by the background
+ * thread).
+ */
+
+#ifndef RFLOG_LEVEL
+#define RFLOG_LEVEL LOG_INFO
+#endif
+
+#define RFLOG(level, format...) \
+    do { \
+        if ((level) <= RFLOG_LEVEL) { \
+            Log::write((level), format); \
+        } \
+    } while (0)
+
+#define RFLOG_DEBUG(format...) RFLOG(LOG_DEBUG, format)
+#define RFLOG_INFO(format...) RFLOG(LOG_INFO, format)
+#define RFLOG_NOTICE(format...) RFLOG(LOG_NOTICE, format)
+#define RFLOG_WARN(format...) RFLOG(LOG_WARNING, format)
+#define RFLOG_ERROR(format...) RFLOG(LOG_ERR, format)
+
+#define LOG_MAX_ARGS 6
+#define LOG_TEXT_SIZE 192
+// Messages per thread that can wait to be written. More are dropped.
+#define LOG_RING_SIZE 1024
+// How long the background thread sleeps when there is nothing to write (ms)
+#define LOG_FLUSH_INTERVAL 10
+
+/* One argument to a log message, as passed by the caller */
+class LogArg {
+    public:
+        enum Type { SIGNED, UNSIGNED, DOUBLE, STRING, IPV4_ADDR, IPV6_ADDR,
+                    MAC_ADDR };
+
+        LogArg();
+        LogArg(int value);
+        LogArg(long value);
+        LogArg(long long value);
+        LogArg(unsigned value);
+        LogArg(unsigned long value);
+        LogArg(unsigned long long value);
+        LogArg(double value);
+        LogArg(const char* value);
+        LogArg(const std::string& value);
+        LogArg(const IPAddress& value);
+        LogArg(const MACAddress& value);
+
+        Type type;
+        union {
+            long long i;
+            unsigned long long u;
+            double d;
+            struct {
+                const char* data;
+                size_t len;
+            } s;
+            uint8_t addr[16];
+        } value;
+};
+
+struct LogRing;
+
+class Log {
+    public:
+        static void write(int level, const char* format);
+        static void write(int level, const char* format, const LogArg& a1);
+        static void write(int level, const char* format, const LogArg& a1,
+                          const LogArg& a2);
+        static void write(int level, const char* format, const LogArg& a1,
+                          const LogArg& a2, const LogArg& a3);
+        static void write(int level, const char* format, const LogArg& a1,
+                          const LogArg& a2, const LogArg& a3,
+                          const LogArg& a4);
+        static void write(int level, const char* format, const LogArg& a1,
+                          const LogArg& a2, const LogArg& a3,
+                          const LogArg& a4, const LogArg& a5);
+        static void write(int level, const char* format, const LogArg& a1,
+                          const LogArg& a2, const LogArg& a3,
+                          const LogArg& a4, const LogArg& a5,
+                          const LogArg& a6);
+
+        /* Also send messages at notice level and above to syslog */
+        static void openSyslog(const char* ident, int facility);
+
+        /* Write out every queued message, and stop the background thread.
+         * This is done automatically at exit. */
+        static void stop();
+
+    private:
+        static void write(int level, const char* format, const LogArg** args,
+                          int nargs);
+        static LogRing* threadRing();
+        static void start();
+        static void flusher();
+        static bool flush();
+};
+
+#endif /* __LOG_H__ */
@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+#include <boost/thread.hpp>
+
+#include "Metrics.h"
+#include "log/Log.h"
+
+#define CACHE_LINE 64
+
+struct HistogramCells {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[METRICS_BUCKETS];
+    uint64_t overflow;
+};
+
+/*
+ * One thread's copy of every metric. Only that thread writes to it. The
+ * last counter and histogram take the updates of metrics declared beyond the
+ * limits.
+ */
+struct MetricsBlock {
+    uint64_t counters[METRICS_MAX_COUNTERS + 1];
+    HistogramCells histograms[METRICS_MAX_HISTOGRAMS + 1];
+};
+
+struct MetricInfo {
+    std::string name;
+    std::string help;
+};
+
+/*
+ * Declared metrics, and the blocks of every thread that has updated one.
+ * Blocks are never freed, so the updates of threads that have exited still
+ * count. Metrics are declared during static initialisation, so the registry
+ * is created on first use.
+ */
+struct MetricsRegistry {
+    boost::mutex mutex;
+    std::vector<MetricInfo> counters;
+    std::vector<MetricInfo> histograms;
+    std::vector<MetricsBlock*> blocks;
+};
+
+static MetricsRegistry& registry() {
+    static MetricsRegistry* r = new MetricsRegistry();
+    return *r;
+}
+
+static __thread MetricsBlock* block = NULL;
+
+static uint64_t load(const uint64_t* p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static void store(uint64_t* p, uint64_t value) {
+    __atomic_store_n(p, value, __ATOMIC_RELAXED);
+}
+
+/* Total of counter 'id' over every thread */
+static uint64_t counter_total(unsigned id) {
+    MetricsRegistry& r = registry();
+    boost::lock_guard<boost::mutex> lock(r.mutex);
+    uint64_t total = 0;
+    for (size_t i = 0; i < r.blocks.size(); i++) {
+        total += load(&r.blocks[i]->counters[id]);
+    }
+    return total;
+}
+
+/* Totals of histogram 'id' over every thread */
+static void histogram_totals(unsigned id, HistogramSnapshot& out) {
+    memset(&out, 0, sizeof(out));
+    MetricsRegistry& r = registry();
+    boost::lock_guard<boost::mutex> lock(r.mutex);
+    for (size_t i = 0; i < r.blocks.size(); i++) {
+        const HistogramCells* h = &r.blocks[i]->histograms[id];
+        out.count += load(&h->count);
+        out.sum += load(&h->sum);
+        out.max = std::max(out.max, load(&h->max));
+        for (unsigned b = 0; b < METRICS_BUCKETS; b++) {
+            out.buckets[b] += load(&h->buckets[b]);
+        }
+        out.overflow += load(&h->overflow);
+    }
+}
+
+Counter::Counter(const char* name, const char* help) {
+    this->id = Metrics::add(false, name, help);
+}
+
+void Counter::add(uint64_t n) {
+    uint64_t* cell = &Metrics::threadBlock()->counters[this->id];
+    store(cell, *cell + n);
+}
+
+uint64_t Counter::value() const {
+    return counter_total(this->id);
+}
+
+Histogram::Histogram(const char* name, const char* help) {
+    this->id = Metrics::add(true, name, help);
+}
+
+void Histogram::record(uint64_t value) {
+    HistogramCells* h = &Metrics::threadBlock()->histograms[this->id];
+    unsigned b = Metrics::bucket(value);
+    uint64_t* cell = (b < METRICS_BUCKETS) ? &h->buckets[b] : &h->overflow;
+    store(cell, *cell + 1);
+    store(&h->sum, h->sum + value);
+    if (value > h->max) {
+        store(&h->max, value);
+    }
+    // The count is written last and read first, so that on x86 a reader
+    // never sees more values counted than are in the buckets.
+    store(&h->count, h->count + 1);
+}
+
+void Histogram::since(uint64_t start) {
+    uint64_t end = Metrics::now();
+    this->record(end > start ? end - start : 0);
+}
+
+void Histogram::snapshot(HistogramSnapshot& out) const {
+    histogram_totals(this->id, out);
+}
+
+uint64_t HistogramSnapshot::percentile(double q) const {
+    if (this->count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t) (q * this->count);
+    rank = std::min(std::max(rank, (uint64_t) 1), this->count);
+
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < METRICS_BUCKETS; b++) {
+        seen += this->buckets[b];
+        if (seen >= rank) {
+            uint64_t start = Metrics::bucketStart(b);
+            uint64_t width = Metrics::bucketStart(b + 1) - start;
+            return std::min(start + width / 2, this->max);
+        }
+    }
+    // The rank is among the values too long for any bucket.
+    return this->max;
+}
+
+uint64_t Metrics::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+unsigned Metrics::bucket(uint64_t value) {
+    if (value < METRICS_SUB_BUCKETS) {
+        return value;
+    }
+    unsigned msb = 63 - __builtin_clzll(value);
+    if (msb >= METRICS_MAX_BITS) {
+        return METRICS_BUCKETS;
+    }
+    unsigned shift = msb - METRICS_SUB_BITS;
+    return (shift + 1) * METRICS_SUB_BUCKETS +
+           ((value >> shift) & (METRICS_SUB_BUCKETS - 1));
+}
+
+uint64_t Metrics::bucketStart(unsigned bucket) {
+    if (bucket < METRICS_SUB_BUCKETS) {
+        return bucket;
+    }
+    unsigned shift = bucket / METRICS_SUB_BUCKETS - 1;
+    return (uint64_t) (METRICS_SUB_BUCKETS + bucket % METRICS_SUB_BUCKETS)
+           << shift;
+}
+
+unsigned Metrics::add(bool histogram, const char* name, const char* help) {
+    MetricsRegistry& r = registry();
+    boost::lock_guard<boost::mutex> lock(r.mutex);
+    std::vector<MetricInfo>& metrics = histogram ? r.histograms : r.counters;
+    size_t max = histogram ? METRICS_MAX_HISTOGRAMS : METRICS_MAX_COUNTERS;
+    if (metrics.size() >= max) {
+        fprintf(stderr, "Too many metrics, not recording %s\n", name);
+        return max;
+    }
+
+    MetricInfo info;
+    info.name = name;
+    info.help = help;
+    metrics.push_back(info);
+    return metrics.size() - 1;
+}
+
+/**
+ * Get the calling thread's block, allocating it on the thread's first
+ * update. Blocks are rounded up to whole cache lines.
+ */
+MetricsBlock* Metrics::threadBlock() {
+    if (block != NULL) {
+        return block;
+    }
+
+    size_t size = (sizeof(MetricsBlock) + CACHE_LINE - 1) & ~(CACHE_LINE - 1);
+    void* p;
+    if (posix_memalign(&p, CACHE_LINE, size) != 0) {
+        abort();
+    }
+    memset(p, 0, size);
+    block = static_cast<MetricsBlock*>(p);
+
+    MetricsRegistry& r = registry();
+    boost::lock_guard<boost::mutex> lock(r.mutex);
+    r.blocks.push_back(block);
+    return block;
+}
+
+std::string Metrics::expose() {
+    MetricsRegistry& r = registry();
+    std::vector<MetricInfo> counters;
+    std::vector<MetricInfo> histograms;
+    {
+        boost::lock_guard<boost::mutex> lock(r.mutex);
+        counters = r.counters;
+        histograms = r.histograms;
+    }
+
+    std::ostringstream out;
+    char value[32];
+    for (size_t i = 0; i < counters.size(); i++) {
+        out << "# HELP " << counters[i].name << " " << counters[i].help
+            << "\n# TYPE " << counters[i].name << " counter\n"
+            << counters[i].name << " " << counter_total(i) << "\n";
+    }
+
+    HistogramSnapshot* snapshot = new HistogramSnapshot;
+    for (size_t i = 0; i < histograms.size(); i++) {
+        const std::string& name = histograms[i].name;
+        histogram_totals(i, *snapshot);
+
+        out << "# HELP " << name << " " << histograms[i].help
+            << "\n# TYPE " << name << " histogram\n";
+        // Buckets up to every power of two from 1us, in seconds. The
+        // bucket holding 2^k ns starts there, so each bound is the last
+        // whole nanosecond before 2^k. Values too long for any bucket only
+        // count towards +Inf.
+        uint64_t cumulative = 0;
+        unsigned b = 0;
+        for (unsigned k = 10; k <= METRICS_MAX_BITS; k++) {
+            unsigned end = Metrics::bucket(1ULL << k);
+            for (; b < end; b++) {
+                cumulative += snapshot->buckets[b];
+            }
+            snprintf(value, sizeof(value), "%.9f", ((1ULL << k) - 1) / 1e9);
+            out << name << "_bucket{le=\"" << value << "\"} " << cumulative
+                << "\n";
+        }
+        snprintf(value, sizeof(value), "%.9f", snapshot->sum / 1e9);
+        out << name << "_bucket{le=\"+Inf\"} " << snapshot->count << "\n"
+            << name << "_sum " << value << "\n"
+            << name << "_count " << snapshot->count << "\n";
+    }
+    delete snapshot;
+
+    return out.str();
+}
+
+void Metrics::startDump(const std::string& path, unsigned interval) {
+    boost::thread t(&Metrics::dumper, path, interval);
+    t.detach();
+}
+
+void Metrics::dumper(std::string path, unsigned interval) {
+    std::string tmp = path + ".tmp";
+    bool failed = false;
+    while (true) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(interval));
+
+        std::string text = Metrics::expose();
+        FILE* f = fopen(tmp.c_str(), "w");
+        bool ok = (f != NULL);
+        if (ok) {
+            ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+            ok = (fclose(f) == 0) && ok;
+        }
+        ok = ok && rename(tmp.c_str(), path.c_str()) == 0;
+
+        // Only report the first of a run of failures.
+        if (!ok && !failed) {
+            RFLOG_WARN("Cannot write metrics to %s: %s", path,
+                       strerror(errno));
+        }
+        failed = !ok;
+    }
+}
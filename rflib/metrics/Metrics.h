@@ -0,0 +1,111 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stdint.h>
+
+#include <string>
+
+/*
+ * Counters and latency histograms.
+ *
+ * Metrics are declared as objects at file scope, which registers them by
+ * name. Each thread updates its own copy of every metric, in a block of
+ * memory that starts on a cache line of its own, so updates never take a
+ * lock or an atomic instruction, and threads never write to the same cache
+ * line. Readers add up the copies of every thread, so a snapshot may miss
+ * updates made while it is taken, but never sees a torn value.
+ *
+ * Histograms record durations in nanoseconds, HDR style: each power of two
+ * is split into 2^METRICS_SUB_BITS buckets of equal width, so any recorded
+ * value is known to within 1/2^METRICS_SUB_BITS of itself, from 1ns up to
+ * 2^METRICS_MAX_BITS ns. Longer durations are counted apart, in an overflow
+ * that only the total count includes.
+ *
+ * Metrics::expose() writes every metric out in the Prometheus text
+ * exposition format, with histograms in seconds.
+ */
+
+// Metrics of each kind that may be declared. Any more are not recorded.
+#define METRICS_MAX_COUNTERS 64
+#define METRICS_MAX_HISTOGRAMS 16
+
+#define METRICS_SUB_BITS 4
+#define METRICS_MAX_BITS 36
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BITS)
+#define METRICS_BUCKETS \
+    ((METRICS_MAX_BITS - METRICS_SUB_BITS + 1) * METRICS_SUB_BUCKETS)
+
+// How often the dump thread writes the metrics out (ms)
+#define METRICS_DUMP_INTERVAL 10000
+
+struct MetricsBlock;
+
+class Counter {
+    public:
+        Counter(const char* name, const char* help);
+
+        void add(uint64_t n = 1);
+        uint64_t value() const;
+
+    private:
+        unsigned id;
+};
+
+/* Totals of a histogram over every thread */
+struct HistogramSnapshot {
+    uint64_t count;
+    uint64_t sum;  /* (ns) */
+    uint64_t max;  /* (ns) */
+    uint64_t buckets[METRICS_BUCKETS];
+    uint64_t overflow;  /* Values of 2^METRICS_MAX_BITS ns or more */
+
+    /* Value that a fraction 'q' of recorded values are at or below, to
+     * within the width of its bucket (ns) */
+    uint64_t percentile(double q) const;
+};
+
+class Histogram {
+    public:
+        Histogram(const char* name, const char* help);
+
+        /* Record a duration in nanoseconds */
+        void record(uint64_t value);
+        /* Record the time since 'start', as given by Metrics::now() */
+        void since(uint64_t start);
+
+        void snapshot(HistogramSnapshot& out) const;
+
+    private:
+        unsigned id;
+};
+
+class Metrics {
+    public:
+        /* Monotonic time in nanoseconds, to timestamp pipeline stages */
+        static uint64_t now();
+
+        /* Every metric in the text exposition format */
+        static std::string expose();
+
+        /* Write expose() to 'path' every 'interval' ms from a background
+         * thread. The file is replaced whole each time, so readers never
+         * see a partial dump. */
+        static void startDump(const std::string& path,
+                              unsigned interval = METRICS_DUMP_INTERVAL);
+
+        /* Bucket a value falls in, or METRICS_BUCKETS if it is too long
+         * for any, and the lowest value in a bucket */
+        static unsigned bucket(uint64_t value);
+        static uint64_t bucketStart(unsigned bucket);
+
+    private:
+        friend class Counter;
+        friend class Histogram;
+
+        static unsigned add(bool histogram, const char* name,
+                            const char* help);
+        static MetricsBlock* threadBlock();
+        static void dumper(std::string path, unsigned interval);
+};
+
+#endif /* __METRICS_H__ */
@@ -39,6 +39,8 @@ std::string Action::type_to_string() const {
         case RFAT_SET_ETH_SRC:      return "RFAT_SET_ETH_SRC";
         case RFAT_SET_ETH_DST:      return "RFAT_SET_ETH_DST";
         case RFAT_POP_MPLS:         return "RFAT_POP_MPLS";
+        case RFAT_GROUP:            return "RFAT_GROUP";
+        case RFAT_WEIGHT:           return "RFAT_WEIGHT";
         case RFAT_DROP:             return "RFAT_DROP";
         case RFAT_SFLOW:            return "RFAT_SFLOW";
         default:                    return "UNKNOWN_ACTION";
@@ -50,6 +52,8 @@ size_t Action::type_to_length(uint8_t type) {
         case RFAT_OUTPUT:
         case RFAT_PUSH_MPLS:
         case RFAT_SWAP_MPLS:
+        case RFAT_GROUP:
+        case RFAT_WEIGHT:
             return sizeof(uint32_t);
         case RFAT_SET_ETH_SRC:
         case RFAT_SET_ETH_DST:
@@ -80,12 +80,10 @@ IPAddress::IPAddress(const int version, int prefix_len) {
 }
 
 IPAddress::~IPAddress() {
-    delete this->data;
 }
 
 IPAddress& IPAddress::operator=(const IPAddress &other) {
     if (this != &other) {
-        delete data;
         this->init(other.getVersion());
         other.toArray(this->data);
     }
@@ -126,7 +124,9 @@ void IPAddress::toArray(uint8_t* array) const {
  */
 uint32_t IPAddress::toUint32() const {
     if (this->version == IPV4) {
-        return ntohl(((in_addr*) this->toInAddr())->s_addr);
+        uint32_t addr;
+        memcpy(&addr, this->data, sizeof(addr));
+        return ntohl(addr);
     }
     else {
         return 0;
@@ -190,7 +190,6 @@ void IPAddress::init(const int version) {
     } else {
         throw "Constructing IPAddress with invalid version!";
     }
-    this->data = new uint8_t[this->length];
 }
 
 void IPAddress::data_from_string(const string &address) {
@@ -10,6 +10,9 @@
 
 enum { IPV4 = 4, IPV6 = 6 };
 
+// Bytes in the longest address (IPv6)
+#define IP_ADDRESS_MAX_LEN 16
+
 using namespace std;
 
 class IPAddress {
@@ -39,8 +42,10 @@ class IPAddress {
 
     private:
         int version;
-        size_t length;
-        uint8_t* data;
+        uint8_t length;
+        /* Held inline, so that addresses are built and copied without
+         * allocating */
+        uint8_t data[IP_ADDRESS_MAX_LEN];
         void init(const int version);
         void data_from_string(const string &address);
 };
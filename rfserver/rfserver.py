@@ -2,6 +2,7 @@
 #-*- coding:utf-8 -*-
 
 import sys
+import copy
 import logging
 import binascii
 import threading
@@ -32,6 +33,19 @@ class RFServer(RFProtocolFactory, IPC.IPCMessageProcessor):
         self.isltable = RFISLTable()
         self.config = RFConfig(configfile)
         self.islconf = RFISLConf(islconffile)
+        # Next hops announced by clients, keyed by (vm_id, nexthop_id), and
+        # the routes using each of them
+        self.nexthops = {}
+        self.nexthop_routes = {}
+        self.route_nexthops = {}
+        # RouteMods awaiting acknowledgement, keyed by (vm_id, seq), with the
+        # number of flows still to be acknowledged and the worst status so
+        # far. Each flow sent for one is given its own sequence number, and
+        # maps back to it along with the datapath it went to.
+        self.ack_lock = threading.Lock()
+        self.ack_seq = 0
+        self.route_acks = {}
+        self.flow_acks = {}
         # Logging
         self.log = logging.getLogger("rfserver")
         self.log.setLevel(logging.INFO)
@@ -55,6 +69,15 @@ class RFServer(RFProtocolFactory, IPC.IPCMessageProcessor):
                                   msg.get_hwaddress())
         elif type_ == ROUTE_MOD:
             self.register_route_mod(msg)
+        elif type_ == NEXT_HOP_MOD:
+            self.register_next_hop_mod(msg)
+        elif type_ == ROUTE_MOD_BATCH:
+            for mod in msg.get_mods():
+                rm = RouteMod()
+                rm.from_dict(mod)
+                self.register_route_mod(rm)
+        elif type_ == ROUTE_MOD_ACK:
+            self.ack_flow(msg.get_seq(), msg.get_status())
         elif type_ == DATAPATH_PORT_REGISTER:
             self.register_dp_port(msg.get_ct_id(),
                                   msg.get_dp_id(),
@@ -112,10 +135,31 @@ class RFServer(RFProtocolFactory, IPC.IPCMessageProcessor):
     # Handle RouteMod messages (type ROUTE_MOD)
     #
     # Takes a RouteMod, replaces its VM id,port with the associated DP id,port
-    # and sends to the corresponding controller
+    # and sends to the corresponding controller. A RouteMod with a sequence
+    # number is acknowledged to the client once every flow sent for it has
+    # been, with RMS_DROPPED if no datapath could take it.
     def register_route_mod(self, rm):
+        # Routes kept for next hop changes are sent again without one.
+        seq = rm.get_seq()
+        rm.set_seq(0)
+        if not seq:
+            self._register_route_mod(rm, None)
+            return
+
+        # Hold the acknowledgement back until every flow has been sent.
+        ack = (rm.get_id(), seq)
+        with self.ack_lock:
+            self.route_acks[ack] = [1, RMS_SUCCESS]
+        status = self._register_route_mod(rm, ack)
+        self._ack_route_mod(ack, status)
+
+    def _register_route_mod(self, rm, ack):
         vm_id = rm.get_id()
 
+        rm, paths = self._expand_next_hop(rm)
+        if rm is None:
+            return RMS_DROPPED
+
         # Find the output action
         for i, action in enumerate(rm.actions):
             if action['type'] is RFAT_OUTPUT:
@@ -132,7 +176,11 @@ class RFServer(RFProtocolFactory, IPC.IPCMessageProcessor):
                     self.log.info("Received RouteMod destined for unknown "
                                   "datapath - Dropping (vm_id=%s)" %
                                   (format_id(vm_id)))
-                    return
+                    return RMS_DROPPED
+
+                buckets = None
+                if paths is not None and rm.get_mod() is not RMT_DELETE:
+                    buckets = self._translate_paths(vm_id, entry, paths)
 
                 # Replace the VM id,port with the Datapath id.port
                 rm.set_id(int(entry.dp_id))
@@ -151,7 +199,8 @@ class RFServer(RFProtocolFactory, IPC.IPCMessageProcessor):
                                                          ct_id=entry.ct_id))
                 rm.add_option(Option.CT_ID(entry.ct_id))
 
-                self._send_rm_with_matches(rm, entry.dp_port, entries)
+                self._send_rm_with_matches(rm, entry.dp_port, entries,
+                                           buckets, ack)
 
                 remote_dps = self.isltable.get_entries(rem_ct=entry.ct_id,
                                                        rem_id=entry.dp_id)
@@ -166,25 +215,201 @@ class RFServer(RFProtocolFactory, IPC.IPCMessageProcessor):
                         rm.add_action(Action.OUTPUT(r.dp_port))
                         entries = self.rftable.get_entries(dp_id=r.dp_id,
                                                            ct_id=r.ct_id)
-                        self._send_rm_with_matches(rm, r.dp_port, entries)
+                        self._send_rm_with_matches(rm, r.dp_port, entries,
+                                                   None, ack)
 
-                return
+                return RMS_SUCCESS
 
         # If no output action is found, don't forward the routemod.
         self.log.info("Received RouteMod with no Output Port - Dropping "
                       "(vm_id=%s)" % (format_id(vm_id)))
+        return RMS_DROPPED
+
+    # Handle RouteModAck messages (type ROUTE_MOD_ACK) from the proxy, for
+    # one flow of a RouteMod.
+    def ack_flow(self, seq, status):
+        with self.ack_lock:
+            flow = self.flow_acks.pop(seq, None)
+        if flow is not None:
+            self._ack_route_mod(flow[0], status)
+
+    # Counts one flow of the RouteMod 'ack' as done with 'status', and
+    # acknowledges the RouteMod to its client once no flow is left.
+    def _ack_route_mod(self, ack, status):
+        with self.ack_lock:
+            state = self.route_acks.get(ack)
+            if state is None:
+                return
+            state[0] -= 1
+            if state[1] == RMS_SUCCESS:
+                state[1] = status
+            if state[0] > 0:
+                return
+            del self.route_acks[ack]
+        vm_id, seq = ack
+        self.ipc.send(RFCLIENT_RFSERVER_CHANNEL, str(vm_id),
+                      RouteModAck(id=vm_id, seq=seq, status=state[1]))
+
+    # Fails the flows still awaiting acknowledgement from a datapath that
+    # went down.
+    def _fail_flows(self, ct_id, dp_id):
+        with self.ack_lock:
+            lost = [seq for seq, flow in self.flow_acks.items()
+                    if flow[1] == (ct_id, dp_id)]
+        for seq in lost:
+            self.ack_flow(seq, RMS_FAILED)
+
+    # Handle NextHopMod messages (type NEXT_HOP_MOD)
+    #
+    # Records the actions of a client's next hop. The datapaths are driven
+    # through OpenFlow 1.0, which has no group table, so when a next hop
+    # changes every route using it is sent out again with the new actions.
+    def register_next_hop_mod(self, msg):
+        vm_id = msg.get_id()
+        nexthop = (vm_id, msg.get_nexthop_id())
+
+        if msg.get_mod() == RMT_DELETE:
+            self.nexthops.pop(nexthop, None)
+            for key in self.nexthop_routes.pop(nexthop, {}):
+                self.route_nexthops.pop((vm_id, key), None)
+            return
+
+        actions = msg.get_actions()
+        changed = (nexthop in self.nexthops and
+                   self.nexthops[nexthop] != actions)
+        self.nexthops[nexthop] = actions
+
+        if changed:
+            self.log.info("Next hop changed, updating %i routes (vm_id=%s)" %
+                          (len(self.nexthop_routes.get(nexthop, {})),
+                           format_id(vm_id)))
+            for route in self.nexthop_routes.get(nexthop, {}).values():
+                rm = RouteMod()
+                rm.from_dict(copy.deepcopy(route))
+                rm.set_mod(RMT_MODIFY)
+                self.register_route_mod(rm)
+
+    # Replaces the RFAT_GROUP actions of a RouteMod with the actions of the
+    # next hops they refer to, and tracks which routes use each next hop.
+    #
+    # Returns the expanded RouteMod, which forwards via the first next hop,
+    # and for multipath routes a list of (actions, weight) for every path.
+    # Returns (None, None) if a next hop is unknown.
+    def _expand_next_hop(self, rm):
+        vm_id = rm.get_id()
+        key = tuple((m['type'], str(m['value'])) for m in rm.get_matches())
+
+        for old in self.route_nexthops.pop((vm_id, key), []):
+            self.nexthop_routes.get((vm_id, old), {}).pop(key, None)
+
+        # Each group may be followed by the weight of its path.
+        groups = []
+        for action in rm.get_actions():
+            if action['type'] == RFAT_GROUP:
+                groups.append([Action.from_dict(action).get_value(), 1])
+            elif action['type'] == RFAT_WEIGHT and groups:
+                groups[-1][1] = Action.from_dict(action).get_value()
+        if not groups:
+            return rm, None
+
+        for group, weight in groups:
+            if (vm_id, group) not in self.nexthops:
+                self.log.info("Received RouteMod for unknown next hop %i - "
+                              "Dropping (vm_id=%s)" % (group, format_id(vm_id)))
+                return None, None
+
+        self.route_nexthops[(vm_id, key)] = [g for g, w in groups]
+        for group, weight in groups:
+            self.nexthop_routes.setdefault((vm_id, group), {})[key] = \
+                copy.deepcopy(rm.to_dict())
+
+        # The next hops carry their own output actions.
+        others = [copy.deepcopy(a) for a in rm.get_actions()
+                  if a['type'] not in (RFAT_GROUP, RFAT_WEIGHT, RFAT_OUTPUT)]
+        paths = [(copy.deepcopy(self.nexthops[(vm_id, g)]) + others, w)
+                 for g, w in groups]
+
+        expanded = RouteMod()
+        expanded.from_dict(copy.deepcopy(rm.to_dict()))
+        expanded.set_actions(copy.deepcopy(paths[0][0]))
+        if len(paths) == 1:
+            return expanded, None
+        return expanded, paths
+
+    # Maps the paths of a multipath route onto ports of the datapath that
+    # 'entry' belongs to. Returns a list of (actions, dp_port, weight).
+    def _translate_paths(self, vm_id, entry, paths):
+        buckets = []
+        for actions, weight in paths:
+            for i, action in enumerate(actions):
+                if action['type'] != RFAT_OUTPUT:
+                    continue
+                action_output = Action.from_dict(action)
+                path_entry = self.rftable.get_entry_by_vm_port(
+                    vm_id, action_output.get_value())
+                if path_entry is None or \
+                   path_entry.get_status() == RFENTRY_IDLE_VM_PORT or \
+                   path_entry.dp_id != entry.dp_id:
+                    break
+                action_output.set_value(path_entry.dp_port)
+                actions[i] = action_output.to_dict()
+                buckets.append((actions, path_entry.dp_port, weight))
+                break
+        return buckets
+
+    # Sends the RouteMod once for each external port of the datapath. For
+    # multipath routes, OpenFlow 1.0 has no select group to spread traffic,
+    # so each ingress port is given one of the 'buckets' in turn, in
+    # proportion to their weights.
+    def _send_rm_with_matches(self, rm, out_port, entries, buckets=None,
+                              ack=None):
+        schedule = []
+        for bucket in buckets or []:
+            schedule.extend([bucket] * bucket[2])
 
-    def _send_rm_with_matches(self, rm, out_port, entries):
         #send entries matching external ports
-        for entry in entries:
-            if out_port != entry.dp_port:
-                if entry.get_status() == RFENTRY_ACTIVE or \
-                   entry.get_status() == RFISL_ACTIVE:
-                    rm.add_match(Match.ETHERNET(entry.eth_addr))
-                    rm.add_match(Match.IN_PORT(entry.dp_port))
-                    self.ipc.send(RFSERVER_RFPROXY_CHANNEL,
-                                  str(entry.ct_id), rm)
-                    rm.set_matches(rm.get_matches()[:-2])
+        for n, entry in enumerate(entries):
+            if not (entry.get_status() == RFENTRY_ACTIVE or
+                    entry.get_status() == RFISL_ACTIVE):
+                continue
+
+            used = True
+            if schedule:
+                choices = [b for b in schedule if b[1] != entry.dp_port]
+                if choices:
+                    actions, out_port, weight = choices[n % len(choices)]
+                    rm.set_actions(copy.deepcopy(actions))
+                else:
+                    used = False
+            if out_port == entry.dp_port:
+                used = False
+
+            if used:
+                self._send_rm_for_port(rm, entry, ack)
+            elif rm.get_mod() == RMT_MODIFY:
+                # The route may have been forwarding traffic from this port
+                # before its next hop changed, so remove that flow.
+                rm_del = RouteMod()
+                rm_del.from_dict(copy.deepcopy(rm.to_dict()))
+                rm_del.set_mod(RMT_DELETE)
+                rm_del.set_actions(None)
+                self._send_rm_for_port(rm_del, entry, ack)
+
+    # Sends one flow of a RouteMod. If the RouteMod is to be acknowledged,
+    # the flow is numbered for the proxy to acknowledge it.
+    def _send_rm_for_port(self, rm, entry, ack=None):
+        if ack is not None:
+            with self.ack_lock:
+                self.ack_seq += 1
+                rm.set_seq(self.ack_seq)
+                self.route_acks[ack][0] += 1
+                self.flow_acks[self.ack_seq] = (ack, (entry.ct_id,
+                                                      entry.dp_id))
+        rm.add_match(Match.ETHERNET(entry.eth_addr))
+        rm.add_match(Match.IN_PORT(entry.dp_port))
+        self.ipc.send(RFSERVER_RFPROXY_CHANNEL, str(entry.ct_id), rm)
+        rm.set_matches(rm.get_matches()[:-2])
+        rm.set_seq(0)
 
     # DatapathPortRegister methods
     def register_dp_port(self, ct_id, dp_id, dp_port):
@@ -369,6 +594,7 @@ class RFServer(RFProtocolFactory, IPC.IPCMessageProcessor):
         for entry in self.isltable.get_entries(rem_ct=ct_id, rem_id=dp_id):
             entry.make_idle(RFISL_IDLE_DP_PORT)
             self.isltable.set_entry(entry)
+        self._fail_flows(ct_id, dp_id)
         self.log.info("Datapath down (dp_id=%s)" % format_id(dp_id))
 
     def set_dp_port_down(self, ct_id, dp_id, dp_port):